@@ -33,68 +33,400 @@
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 
+#include <stddef.h>
+
 #include "i8080.h"
+#ifdef I8080_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef I8080_SNAPSHOT
+#include <stdlib.h>
+#endif
+#if defined(I8080_SNAPSHOT) || defined(I8080_PROFILE) || \
+    defined(I8080_MEMSTATS) || I8080_LANES > 0
+#include <string.h>
+#endif
+#if I8080_LANES > 0 && !defined(I8080_LANES_SCALAR)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#endif
 #include "i8080_hal.h"
 
-#define RD_BYTE(addr) i8080_hal_memory_read_byte(addr)
-#define RD_WORD(addr) i8080_hal_memory_read_word(addr)
-
-#define WR_BYTE(addr, value) i8080_hal_memory_write_byte(addr, value)
-#define WR_WORD(addr, value) i8080_hal_memory_write_word(addr, value)
-
-typedef unsigned char           uns8;
-typedef unsigned short          uns16;
-typedef unsigned long int       uns32;
-typedef signed char             sgn8;
-typedef signed short            sgn16;
-typedef signed long int         sgn32;
-
-typedef union {
-    struct {
-        uns8 l, h;
-    } b;
-    uns16 w;
-} reg_pair;
-
-typedef struct {
-    uns8 carry_flag;
-    uns8 unused1;
-    uns8 parity_flag;
-    uns8 unused3;
-    uns8 half_carry_flag;
-    uns8 unused5;
-    uns8 zero_flag;
-    uns8 sign_flag;
-} flag_reg;
-
-struct i8080 {
-    flag_reg f;
-    reg_pair af, bc, de, hl;
-    reg_pair sp, pc;
-    uns16 iff;
-    uns16 last_pc;
-};
+#ifdef I8080_BLOCK_CACHE
+
+static void i8080_code_written(struct i8080 *cpu, int addr);
+
+// A write into a byte of a cached block invalidates it.
+#define CODE_WRITTEN(addr) \
+{                                                   \
+    if (cpu->blocks &&                              \
+        I8080_ADDR_TST(cpu->blocks->code, addr))    \
+        i8080_code_written(cpu, addr);              \
+}
+
+#else
+
+#define CODE_WRITTEN(addr)
+
+#endif
+
+#ifdef I8080_PAGE_TABLE
+
+// The memory is accessed through the page table, and only the pages not
+// mapped by `i8080_map()` go to the HAL.
+
+#define RD_BYTE(addr) i8080_read_byte(cpu, addr)
+#define RD_WORD(addr) i8080_read_word(cpu, addr)
+
+#define WR_BYTE(addr, value) i8080_write_byte(cpu, addr, value)
+#define WR_WORD(addr, value) i8080_write_word(cpu, addr, value)
+
+#ifdef I8080_SNAPSHOT
+static int i8080_cow_fault(struct i8080 *cpu, int page);
+#endif
+static void i8080_watch_hit(struct i8080 *cpu, int addr, int access);
+
+// The accesses of the host, which do not hit watchpoints.
+static int i8080_read_page(struct i8080 *cpu, int addr) {
+    uns8 const page = (uns8)(addr >> 8);
+    if (cpu->page_flags[page] & I8080_PAGE_READ)
+        return cpu->page[page][addr & 0xff];
+    return i8080_hal_memory_read_byte(cpu, addr & 0xffff);
+}
+
+static void i8080_write_page(struct i8080 *cpu, int addr, int byte) {
+    uns8 const page = (uns8)(addr >> 8);
+    if (cpu->page_flags[page] & I8080_PAGE_WRITE)
+        cpu->page[page][addr & 0xff] = (uns8)byte;
+#ifdef I8080_SNAPSHOT
+    else if ((cpu->page_flags[page] & I8080_PAGE_COW) &&
+             i8080_cow_fault(cpu, page))
+        cpu->page[page][addr & 0xff] = (uns8)byte;
+#endif
+    else
+        i8080_hal_memory_write_byte(cpu, addr & 0xffff, byte);
+    CODE_WRITTEN(addr);
+}
+
+// The accesses of the CPU. Watched and unmapped pages take the slow path,
+// kept out of line so that the fast path stays small enough to be inlined.
+#ifdef __GNUC__
+#define SLOW_PATH __attribute__((noinline))
+#else
+#define SLOW_PATH
+#endif
+
+static SLOW_PATH int i8080_read_slow(struct i8080 *cpu, int addr) {
+    if (cpu->page_flags[(addr >> 8) & 0xff] & I8080_PAGE_WATCH)
+        i8080_watch_hit(cpu, addr & 0xffff, I8080_WATCH_READ);
+    return i8080_read_page(cpu, addr);
+}
+
+static SLOW_PATH void i8080_write_slow(struct i8080 *cpu, int addr, int byte) {
+    if (cpu->page_flags[(addr >> 8) & 0xff] & I8080_PAGE_WATCH)
+        i8080_watch_hit(cpu, addr & 0xffff, I8080_WATCH_WRITE);
+    i8080_write_page(cpu, addr, byte);
+}
+
+static int i8080_read_byte(struct i8080 *cpu, int addr) {
+    uns8 const page = (uns8)(addr >> 8);
+    if ((cpu->page_flags[page] & (I8080_PAGE_READ | I8080_PAGE_WATCH)) ==
+        I8080_PAGE_READ)
+        return cpu->page[page][addr & 0xff];
+    return i8080_read_slow(cpu, addr);
+}
+
+static void i8080_write_byte(struct i8080 *cpu, int addr, int byte) {
+    uns8 const page = (uns8)(addr >> 8);
+    if ((cpu->page_flags[page] & (I8080_PAGE_WRITE | I8080_PAGE_WATCH)) ==
+        I8080_PAGE_WRITE) {
+        cpu->page[page][addr & 0xff] = (uns8)byte;
+        CODE_WRITTEN(addr);
+    } else {
+        i8080_write_slow(cpu, addr, byte);
+    }
+}
+
+static int i8080_read_word(struct i8080 *cpu, int addr) {
+    return i8080_read_byte(cpu, addr) | (i8080_read_byte(cpu, addr + 1) << 8);
+}
+
+static void i8080_write_word(struct i8080 *cpu, int addr, int word) {
+    i8080_write_byte(cpu, addr, word & 0xff);
+    i8080_write_byte(cpu, addr + 1, (word >> 8) & 0xff);
+}
+
+#elif defined(I8080_BLOCK_CACHE)
+
+#define RD_BYTE(addr) i8080_hal_memory_read_byte(cpu, addr)
+#define RD_WORD(addr) i8080_hal_memory_read_word(cpu, addr)
+
+#define WR_BYTE(addr, value) i8080_write_byte(cpu, addr, value)
+#define WR_WORD(addr, value) i8080_write_word(cpu, addr, value)
+
+static void i8080_write_byte(struct i8080 *cpu, int addr, int byte) {
+    i8080_hal_memory_write_byte(cpu, addr, byte);
+    CODE_WRITTEN(addr);
+}
+
+static void i8080_write_word(struct i8080 *cpu, int addr, int word) {
+    i8080_hal_memory_write_word(cpu, addr, word);
+    CODE_WRITTEN(addr);
+    CODE_WRITTEN(addr + 1);
+}
+
+#else
+
+#define RD_BYTE(addr) i8080_hal_memory_read_byte(cpu, addr)
+#define RD_WORD(addr) i8080_hal_memory_read_word(cpu, addr)
+
+#define WR_BYTE(addr, value) i8080_hal_memory_write_byte(cpu, addr, value)
+#define WR_WORD(addr, value) i8080_hal_memory_write_word(cpu, addr, value)
+
+#endif
+
+#ifdef I8080_PROFILE
+
+// The profiler counts the accesses to every page on top of the above.
+
+#define PROFILE_PAGE(counter, addr) \
+{                                                       \
+    if (cpu->profile)                                   \
+        cpu->profile->counter[((addr) >> 8) & 0xff]++;  \
+}
+
+static int i8080_profile_read_byte(struct i8080 *cpu, int addr) {
+    PROFILE_PAGE(reads, addr);
+    return RD_BYTE(addr);
+}
+
+static int i8080_profile_read_word(struct i8080 *cpu, int addr) {
+    PROFILE_PAGE(reads, addr);
+    PROFILE_PAGE(reads, addr + 1);
+    return RD_WORD(addr);
+}
+
+static void i8080_profile_write_byte(struct i8080 *cpu, int addr, int byte) {
+    PROFILE_PAGE(writes, addr);
+    WR_BYTE(addr, byte);
+}
+
+static void i8080_profile_write_word(struct i8080 *cpu, int addr, int word) {
+    PROFILE_PAGE(writes, addr);
+    PROFILE_PAGE(writes, addr + 1);
+    WR_WORD(addr, word);
+}
+
+#undef RD_BYTE
+#undef RD_WORD
+#undef WR_BYTE
+#undef WR_WORD
+
+#define RD_BYTE(addr) i8080_profile_read_byte(cpu, addr)
+#define RD_WORD(addr) i8080_profile_read_word(cpu, addr)
+
+#define WR_BYTE(addr, value) i8080_profile_write_byte(cpu, addr, value)
+#define WR_WORD(addr, value) i8080_profile_write_word(cpu, addr, value)
+
+#endif
+
+#ifdef I8080_MEMSTATS
+
+// The statistics count the accesses to every page on top of the above.
+// The host accesses and the instruction fetches go around them.
+
+#define STATS_PAGE(counter, addr) \
+{                                                       \
+    if (cpu->memstats)                                  \
+        cpu->memstats->counter[((addr) >> 8) & 0xff]++; \
+}
+
+static void i8080_stats_write(struct i8080 *cpu, int addr) {
+    struct i8080_memstats* const stats = cpu->memstats;
+    int const page = (addr >> 8) & 0xff;
+    if (!stats)
+        return;
+    stats->writes[page]++;
+    if (stats->fetches[page]) {
+        stats->code_writes[page]++;
+        stats->code_write_addr = (uns16)addr;
+        stats->code_write_pc = cpu->last_pc;
+    }
+}
+
+#if !defined(I8080_PAGE_TABLE) || defined(I8080_BUS)
+static int i8080_stats_peek(struct i8080 *cpu, int addr) {
+    return RD_BYTE(addr);
+}
+#endif
+
+#ifndef I8080_PAGE_TABLE
+static void i8080_stats_poke(struct i8080 *cpu, int addr, int byte) {
+    WR_BYTE(addr, byte);
+}
+#endif
+
+#ifndef I8080_BUS
+static int i8080_stats_fetch(struct i8080 *cpu, int addr) {
+    STATS_PAGE(fetches, addr);
+    return RD_BYTE(addr);
+}
+#endif
+
+static int i8080_stats_read_byte(struct i8080 *cpu, int addr) {
+    STATS_PAGE(reads, addr);
+    return RD_BYTE(addr);
+}
+
+static int i8080_stats_read_word(struct i8080 *cpu, int addr) {
+    STATS_PAGE(reads, addr);
+    STATS_PAGE(reads, addr + 1);
+    return RD_WORD(addr);
+}
+
+static void i8080_stats_write_byte(struct i8080 *cpu, int addr, int byte) {
+    i8080_stats_write(cpu, addr);
+    WR_BYTE(addr, byte);
+}
+
+static void i8080_stats_write_word(struct i8080 *cpu, int addr, int word) {
+    i8080_stats_write(cpu, addr);
+    i8080_stats_write(cpu, addr + 1);
+    WR_WORD(addr, word);
+}
+
+#undef RD_BYTE
+#undef RD_WORD
+#undef WR_BYTE
+#undef WR_WORD
+
+#define RD_BYTE(addr) i8080_stats_read_byte(cpu, addr)
+#define RD_WORD(addr) i8080_stats_read_word(cpu, addr)
+
+#define WR_BYTE(addr, value) i8080_stats_write_byte(cpu, addr, value)
+#define WR_WORD(addr, value) i8080_stats_write_word(cpu, addr, value)
+
+#else
+
+#define STATS_PAGE(counter, addr)
+
+#endif
+
+#ifdef I8080_BUS
+
+// Every access is a machine cycle of 3 T-states reported to the bus
+// handler on top of the above. The host accesses and the opcode fetch,
+// which starts the instruction, go around it.
+
+#define BUS_CYCLE(kind, addr) \
+{                                                       \
+    if (cpu->bus_handler) {                             \
+        int const waits = cpu->bus_handler(cpu, kind,   \
+            (addr) & 0xffff, cpu->bus_offset, cpu->bus_data); \
+        cpu->bus_offset += 3 + waits;                   \
+        cpu->bus_waits += waits;                        \
+    }                                                   \
+}
+
+static int i8080_bus_peek(struct i8080 *cpu, int addr) {
+#ifdef I8080_MEMSTATS
+    return i8080_stats_peek(cpu, addr);
+#else
+    return RD_BYTE(addr);
+#endif
+}
+
+#ifndef I8080_PAGE_TABLE
+static void i8080_bus_poke(struct i8080 *cpu, int addr, int byte) {
+#ifdef I8080_MEMSTATS
+    i8080_stats_poke(cpu, addr, byte);
+#else
+    WR_BYTE(addr, byte);
+#endif
+}
+#endif
+
+static int i8080_bus_read_byte(struct i8080 *cpu, int addr) {
+    BUS_CYCLE(I8080_BUS_READ, addr);
+    return RD_BYTE(addr);
+}
+
+static int i8080_bus_read_word(struct i8080 *cpu, int addr) {
+    BUS_CYCLE(I8080_BUS_READ, addr);
+    BUS_CYCLE(I8080_BUS_READ, addr + 1);
+    return RD_WORD(addr);
+}
+
+static void i8080_bus_write_byte(struct i8080 *cpu, int addr, int byte) {
+    BUS_CYCLE(I8080_BUS_WRITE, addr);
+    WR_BYTE(addr, byte);
+}
+
+static void i8080_bus_write_word(struct i8080 *cpu, int addr, int word) {
+    BUS_CYCLE(I8080_BUS_WRITE, addr);
+    BUS_CYCLE(I8080_BUS_WRITE, addr + 1);
+    WR_WORD(addr, word);
+}
+
+// The stack gets the high byte first.
+static void i8080_bus_write_stack(struct i8080 *cpu, int addr, int word) {
+    BUS_CYCLE(I8080_BUS_WRITE, addr + 1);
+    BUS_CYCLE(I8080_BUS_WRITE, addr);
+    WR_WORD(addr, word);
+}
+
+#undef RD_BYTE
+#undef RD_WORD
+#undef WR_BYTE
+#undef WR_WORD
 
-#define FLAGS           cpu.f
-#define AF              cpu.af.w
-#define BC              cpu.bc.w
-#define DE              cpu.de.w
-#define HL              cpu.hl.w
-#define SP              cpu.sp.w
-#define PC              cpu.pc.w
-#define A               cpu.af.b.h
-#define F               cpu.af.b.l
-#define B               cpu.bc.b.h
-#define C               cpu.bc.b.l
-#define D               cpu.de.b.h
-#define E               cpu.de.b.l
-#define H               cpu.hl.b.h
-#define L               cpu.hl.b.l
-#define HSP             cpu.sp.b.h
-#define LSP             cpu.sp.b.l
-#define HPC             cpu.pc.b.h
-#define LPC             cpu.pc.b.l
-#define IFF             cpu.iff
+#define RD_BYTE(addr) i8080_bus_read_byte(cpu, addr)
+#define RD_WORD(addr) i8080_bus_read_word(cpu, addr)
+
+#define WR_BYTE(addr, value) i8080_bus_write_byte(cpu, addr, value)
+#define WR_WORD(addr, value) i8080_bus_write_word(cpu, addr, value)
+#define WR_STACK(addr, value) i8080_bus_write_stack(cpu, addr, value)
+
+static int i8080_bus_fetch(struct i8080 *cpu, int addr);
+
+#define FETCH(addr)         i8080_bus_fetch(cpu, addr)
+#define BUS_WAITS           cpu->bus_waits
+
+#else
+
+#ifdef I8080_MEMSTATS
+#define FETCH(addr)         i8080_stats_fetch(cpu, addr)
+#else
+#define FETCH(addr)         RD_BYTE(addr)
+#endif
+#define BUS_WAITS           0
+
+#endif
+
+#define FLAGS           cpu->f
+#define AF              cpu->af.w
+#define BC              cpu->bc.w
+#define DE              cpu->de.w
+#define HL              cpu->hl.w
+#define SP              cpu->sp.w
+#define PC              cpu->pc.w
+#define A               cpu->af.b.h
+#define F               cpu->af.b.l
+#define B               cpu->bc.b.h
+#define C               cpu->bc.b.l
+#define D               cpu->de.b.h
+#define E               cpu->de.b.l
+#define H               cpu->hl.b.h
+#define L               cpu->hl.b.l
+#define HSP             cpu->sp.b.h
+#define LSP             cpu->sp.b.l
+#define HPC             cpu->pc.b.h
+#define LPC             cpu->pc.b.l
+#define IFF             cpu->iff
 
 #define F_CARRY         0x01
 #define F_UN1           0x02
@@ -105,6 +437,24 @@ struct i8080 {
 #define F_ZERO          0x40
 #define F_NEG           0x80
 
+#ifdef I8080_PACKED_FLAGS
+
+// Packed flags: the flags always stay in F, and the name of a flag is its bit.
+
+#define C_FLAG          F_CARRY
+#define P_FLAG          F_PARITY
+#define H_FLAG          F_HCARRY
+#define Z_FLAG          F_ZERO
+#define S_FLAG          F_NEG
+
+#define SET(flag)       (F |= (flag))
+#define CLR(flag)       (F &= ~(flag))
+#define TST(flag)       ((F & (flag)) != 0)
+#define CPL(flag)       (F ^= (flag))
+#define PUT(flag, v)    (F = (F & ~(flag)) | ((v) ? (flag) : 0))
+
+#else
+
 #define C_FLAG          FLAGS.carry_flag
 #define P_FLAG          FLAGS.parity_flag
 #define H_FLAG          FLAGS.half_carry_flag
@@ -118,127 +468,300 @@ struct i8080 {
 #define CLR(flag)       (flag = 0)
 #define TST(flag)       (flag)
 #define CPL(flag)       (flag = !flag)
+#define PUT(flag, v)    (flag = (v))
+
+#endif
+
+#ifdef I8080_8085
+
+// The 8085 keeps the undocumented overflow flag V in bit 1 and the INX/DCX
+// carry-out flag K in bit 5 of F.
+#define V_FLAG          UN1_FLAG
+#define K_FLAG          UN5_FLAG
+
+// The number of cycles taken on the 8080 or on the 8085.
+#define T85(t8080, t8085)   (t8085)
+#define FLAGS_V(v)          PUT(V_FLAG, (v) != 0)
+
+// The signed overflow of `a` + `val` or `a` - `val` giving `res`, in bit 7.
+#define ADD_V(a, val, res)  (~((a) ^ (val)) & ((a) ^ (res)) & 0x80)
+#define SUB_V(a, val, res)  (((a) ^ (val)) & ((a) ^ (res)) & 0x80)
+
+#define INX(rp)         { ++(rp); PUT(K_FLAG, (rp) == 0); }
+#define DCX(rp)         { --(rp); PUT(K_FLAG, (rp) == 0xffff); }
+
+#else
+
+#define T85(t8080, t8085)   (t8080)
+#define FLAGS_V(v)
+
+#define INX(rp)         ((rp)++)
+#define DCX(rp)         ((rp)--)
+
+#endif
 
 #define POP(reg)        { (reg) = RD_WORD(SP); SP += 2; }
-#define PUSH(reg)       { SP -= 2; WR_WORD(SP, (reg)); }
+#ifndef WR_STACK
+#define WR_STACK(addr, value) WR_WORD(addr, value)
+#endif
+
+#define PUSH(reg)       { SP -= 2; WR_STACK(SP, (reg)); }
 #define RET()           { POP(PC); }
 #define STC()           { SET(C_FLAG); }
 #define CMC()           { CPL(C_FLAG); }
 
+// The flags of arithmetic and logical instructions are set by FLAGS_xxx(),
+// with `a` and `val` being the operands and `res` the result. The carry
+// flag is always set directly by the instructions.
+
+#define HALF_CARRY_INDEX(a, val, res) \
+    ((((a) & 0x88) >> 1) | (((val) & 0x88) >> 2) | (((res) & 0x88) >> 3))
+
+#ifdef I8080_LAZY_FLAGS
+
+// Lazy flags: only the operands and the result are saved, and the S, Z, P
+// and H flags are computed from them when somebody reads them (conditional
+// instructions, PUSH PSW, DAA). Every instruction changing any of these
+// flags changes all four, so the last instruction describes them fully.
+
+#define LAZY_NONE       0   // The flags are in FLAGS.
+#define LAZY_ADD        1
+#define LAZY_SUB        2
+#define LAZY_ANA        3
+#define LAZY_LOGIC      4   // XRA, ORA
+#define LAZY_INR        5
+#define LAZY_DCR        6
+
+#define FLAGS_LAZY(kind, a, val, res) \
+{                                               \
+    cpu->lazy_kind = (kind);                    \
+    cpu->lazy_a = (uns8)(a);                    \
+    cpu->lazy_val = (uns8)(val);                \
+    cpu->lazy_res = (uns8)(res);                \
+}
+
+#define FLAGS_ADD(a, val, res)  FLAGS_LAZY(LAZY_ADD, a, val, res)
+#define FLAGS_SUB(a, val, res)  FLAGS_LAZY(LAZY_SUB, a, val, res)
+#define FLAGS_ANA(a, val, res)  FLAGS_LAZY(LAZY_ANA, a, val, res)
+#define FLAGS_LOGIC(res)        FLAGS_LAZY(LAZY_LOGIC, 0, 0, res)
+#define FLAGS_INR(res)          FLAGS_LAZY(LAZY_INR, 0, 0, res)
+#define FLAGS_DCR(res)          FLAGS_LAZY(LAZY_DCR, 0, 0, res)
+
+#define FLAGS_UPDATE()  { if (cpu->lazy_kind) i8080_lazy_flags(cpu); }
+
+#elif defined(I8080_PACKED_FLAGS)
+
+// Packed flags: S, Z and P come from a table indexed by the result, and H
+// from the tables indexed by HALF_CARRY_INDEX(), all of them holding the
+// bits in their places in F.
+
+#define FLAGS_SET(res, h) \
+    (F = (F & F_CARRY) | F_UN1 | szp_table[(res) & 0xff] | (h))
+
+#define FLAGS_ADD(a, val, res) \
+{                                               \
+    index = HALF_CARRY_INDEX(a, val, res);      \
+    FLAGS_SET(res, add_hc_table[index & 0x7]);  \
+}
+
+#define FLAGS_SUB(a, val, res) \
+{                                               \
+    index = HALF_CARRY_INDEX(a, val, res);      \
+    FLAGS_SET(res, sub_hc_table[index & 0x7]);  \
+}
+
+#define FLAGS_ANA(a, val, res) \
+    FLAGS_SET(res, (((a) | (val)) & 0x08) << 1)
+
+#define FLAGS_LOGIC(res) \
+    FLAGS_SET(res, 0)
+
+#define FLAGS_INR(res) \
+    FLAGS_SET(res, ((res) & 0x0f) == 0 ? F_HCARRY : 0)
+
+#define FLAGS_DCR(res) \
+    FLAGS_SET(res, ((res) & 0x0f) == 0x0f ? 0 : F_HCARRY)
+
+#define FLAGS_UPDATE()
+
+static const uns8 szp_table[256] = {
+    0x44, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+    0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+    0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+    0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+    0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+    0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+    0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+    0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+    0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+    0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+    0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+    0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+    0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+    0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+    0x00, 0x04, 0x04, 0x00, 0x04, 0x00, 0x00, 0x04,
+    0x04, 0x00, 0x00, 0x04, 0x00, 0x04, 0x04, 0x00,
+    0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+    0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+    0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+    0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+    0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+    0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+    0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+    0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+    0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+    0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+    0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+    0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+    0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84,
+    0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+    0x84, 0x80, 0x80, 0x84, 0x80, 0x84, 0x84, 0x80,
+    0x80, 0x84, 0x84, 0x80, 0x84, 0x80, 0x80, 0x84
+};
+
+static const uns8 add_hc_table[] = {
+    0, 0, F_HCARRY, 0, F_HCARRY, 0, F_HCARRY, F_HCARRY
+};
+
+static const uns8 sub_hc_table[] = {
+    F_HCARRY, 0, 0, 0, F_HCARRY, F_HCARRY, F_HCARRY, 0
+};
+
+#else
+
+#define FLAGS_SZP(res) \
+{                                               \
+    PUT(S_FLAG, (((res) & 0x80) != 0));         \
+    PUT(Z_FLAG, (((res) & 0xff) == 0));         \
+    PUT(P_FLAG, PARITY((res) & 0xff));          \
+}
+
+#define FLAGS_ADD(a, val, res) \
+{                                               \
+    index = HALF_CARRY_INDEX(a, val, res);      \
+    PUT(H_FLAG, half_carry_table[index & 0x7]); \
+    FLAGS_SZP(res);                             \
+}
+
+#define FLAGS_SUB(a, val, res) \
+{                                               \
+    index = HALF_CARRY_INDEX(a, val, res);      \
+    PUT(H_FLAG, !sub_half_carry_table[index & 0x7]);\
+    FLAGS_SZP(res);                             \
+}
+
+#ifdef I8080_8085
+#define FLAGS_ANA(a, val, res) \
+{                                               \
+    SET(H_FLAG);                                \
+    FLAGS_SZP(res);                             \
+}
+#else
+#define FLAGS_ANA(a, val, res) \
+{                                               \
+    PUT(H_FLAG, (((a) | (val)) & 0x08) != 0);   \
+    FLAGS_SZP(res);                             \
+}
+#endif
+
+#define FLAGS_LOGIC(res) \
+{                                               \
+    CLR(H_FLAG);                                \
+    FLAGS_SZP(res);                             \
+}
+
+#define FLAGS_INR(res) \
+{                                               \
+    PUT(H_FLAG, (((res) & 0x0f) == 0));         \
+    FLAGS_SZP(res);                             \
+}
+
+#define FLAGS_DCR(res) \
+{                                               \
+    PUT(H_FLAG, !(((res) & 0x0f) == 0x0f));     \
+    FLAGS_SZP(res);                             \
+}
+
+#define FLAGS_UPDATE()
+
+#endif
+
 #define INR(reg) \
 {                                               \
     ++(reg);                                    \
-    S_FLAG = (((reg) & 0x80) != 0);             \
-    Z_FLAG = ((reg) == 0);                      \
-    H_FLAG = (((reg) & 0x0f) == 0);             \
-    P_FLAG = PARITY(reg);                       \
+    FLAGS_INR(reg);                             \
+    FLAGS_V((reg) == 0x80);                     \
 }
 
 #define DCR(reg) \
 {                                               \
     --(reg);                                    \
-    S_FLAG = (((reg) & 0x80) != 0);             \
-    Z_FLAG = ((reg) == 0);                      \
-    H_FLAG = !(((reg) & 0x0f) == 0x0f);         \
-    P_FLAG = PARITY(reg);                       \
+    FLAGS_DCR(reg);                             \
+    FLAGS_V((reg) == 0x7f);                     \
 }
 
 #define ADD(val) \
 {                                               \
     work16 = (uns16)A + (val);                  \
-    index = ((A & 0x88) >> 1) |                 \
-            (((val) & 0x88) >> 2) |             \
-            ((work16 & 0x88) >> 3);             \
+    FLAGS_ADD(A, val, work16);                  \
+    FLAGS_V(ADD_V(A, val, work16));             \
     A = work16 & 0xff;                          \
-    S_FLAG = ((A & 0x80) != 0);                 \
-    Z_FLAG = (A == 0);                          \
-    H_FLAG = half_carry_table[index & 0x7];     \
-    P_FLAG = PARITY(A);                         \
-    C_FLAG = ((work16 & 0x0100) != 0);          \
+    PUT(C_FLAG, ((work16 & 0x0100) != 0));      \
 }
 
 #define ADC(val) \
 {                                               \
-    work16 = (uns16)A + (val) + C_FLAG;         \
-    index = ((A & 0x88) >> 1) |                 \
-            (((val) & 0x88) >> 2) |             \
-            ((work16 & 0x88) >> 3);             \
+    work16 = (uns16)A + (val) + TST(C_FLAG);    \
+    FLAGS_ADD(A, val, work16);                  \
+    FLAGS_V(ADD_V(A, val, work16));             \
     A = work16 & 0xff;                          \
-    S_FLAG = ((A & 0x80) != 0);                 \
-    Z_FLAG = (A == 0);                          \
-    H_FLAG = half_carry_table[index & 0x7];     \
-    P_FLAG = PARITY(A);                         \
-    C_FLAG = ((work16 & 0x0100) != 0);          \
+    PUT(C_FLAG, ((work16 & 0x0100) != 0));      \
 }
 
 #define SUB(val) \
-{                                                \
-    work16 = (uns16)A - (val);                   \
-    index = ((A & 0x88) >> 1) |                  \
-            (((val) & 0x88) >> 2) |              \
-            ((work16 & 0x88) >> 3);              \
-    A = work16 & 0xff;                           \
-    S_FLAG = ((A & 0x80) != 0);                  \
-    Z_FLAG = (A == 0);                           \
-    H_FLAG = !sub_half_carry_table[index & 0x7]; \
-    P_FLAG = PARITY(A);                          \
-    C_FLAG = ((work16 & 0x0100) != 0);           \
+{                                               \
+    work16 = (uns16)A - (val);                  \
+    FLAGS_SUB(A, val, work16);                  \
+    FLAGS_V(SUB_V(A, val, work16));             \
+    A = work16 & 0xff;                          \
+    PUT(C_FLAG, ((work16 & 0x0100) != 0));      \
 }
 
 #define SBB(val) \
-{                                                \
-    work16 = (uns16)A - (val) - C_FLAG;          \
-    index = ((A & 0x88) >> 1) |                  \
-            (((val) & 0x88) >> 2) |              \
-            ((work16 & 0x88) >> 3);              \
-    A = work16 & 0xff;                           \
-    S_FLAG = ((A & 0x80) != 0);                  \
-    Z_FLAG = (A == 0);                           \
-    H_FLAG = !sub_half_carry_table[index & 0x7]; \
-    P_FLAG = PARITY(A);                          \
-    C_FLAG = ((work16 & 0x0100) != 0);           \
+{                                               \
+    work16 = (uns16)A - (val) - TST(C_FLAG);    \
+    FLAGS_SUB(A, val, work16);                  \
+    FLAGS_V(SUB_V(A, val, work16));             \
+    A = work16 & 0xff;                          \
+    PUT(C_FLAG, ((work16 & 0x0100) != 0));      \
 }
 
 #define CMP(val) \
-{                                                \
-    work16 = (uns16)A - (val);                   \
-    index = ((A & 0x88) >> 1) |                  \
-            (((val) & 0x88) >> 2) |              \
-            ((work16 & 0x88) >> 3);              \
-    S_FLAG = ((work16 & 0x80) != 0);             \
-    Z_FLAG = ((work16 & 0xff) == 0);             \
-    H_FLAG = !sub_half_carry_table[index & 0x7]; \
-    C_FLAG = ((work16 & 0x0100) != 0);           \
-    P_FLAG = PARITY(work16 & 0xff);              \
+{                                               \
+    work16 = (uns16)A - (val);                  \
+    FLAGS_SUB(A, val, work16);                  \
+    FLAGS_V(SUB_V(A, val, work16));             \
+    PUT(C_FLAG, ((work16 & 0x0100) != 0));      \
 }
 
 #define ANA(val) \
 {                                               \
-    H_FLAG = ((A | val) & 0x08) != 0;           \
+    FLAGS_ANA(A, val, A & (val));               \
     A &= (val);                                 \
-    S_FLAG = ((A & 0x80) != 0);                 \
-    Z_FLAG = (A == 0);                          \
-    P_FLAG = PARITY(A);                         \
     CLR(C_FLAG);                                \
 }
 
 #define XRA(val) \
 {                                               \
     A ^= (val);                                 \
-    S_FLAG = ((A & 0x80) != 0);                 \
-    Z_FLAG = (A == 0);                          \
-    CLR(H_FLAG);                                \
-    P_FLAG = PARITY(A);                         \
+    FLAGS_LOGIC(A);                             \
     CLR(C_FLAG);                                \
 }
 
 #define ORA(val) \
 {                                               \
     A |= (val);                                 \
-    S_FLAG = ((A & 0x80) != 0);                 \
-    Z_FLAG = (A == 0);                          \
-    CLR(H_FLAG);                                \
-    P_FLAG = PARITY(A);                         \
+    FLAGS_LOGIC(A);                             \
     CLR(C_FLAG);                                \
 }
 
@@ -246,13 +769,51 @@ struct i8080 {
 {                                               \
     work32 = (uns32)HL + (reg);                 \
     HL = work32 & 0xffff;                       \
-    C_FLAG = ((work32 & 0x10000L) != 0);        \
+    PUT(C_FLAG, ((work32 & 0x10000L) != 0));    \
+}
+
+#ifdef I8080_8085
+
+// The half carry of DSUB is the one of its low byte, with the inverted
+// sense of SUB.
+#define DSUB() \
+{                                               \
+    work32 = (uns32)HL - BC;                    \
+    PUT(H_FLAG, !((L ^ C ^ work32) & 0x10));    \
+    FLAGS_V(SUB_V(H, B, work32 >> 8));          \
+    HL = work32 & 0xffff;                       \
+    PUT(C_FLAG, ((work32 & 0x10000L) != 0));    \
+    PUT(S_FLAG, ((HL & 0x8000) != 0));          \
+    PUT(Z_FLAG, (HL == 0));                     \
+    PUT(P_FLAG, PARITY(L));                     \
 }
 
+#define RDEL() \
+{                                               \
+    work32 = ((uns32)DE << 1) | TST(C_FLAG);    \
+    FLAGS_V((DE ^ work32) & 0x8000);            \
+    DE = work32 & 0xffff;                       \
+    PUT(C_FLAG, ((work32 & 0x10000L) != 0));    \
+}
+
+#define RIM()           (A = i8080_rim(cpu))
+#define SIM()           i8080_sim(cpu, A)
+
+#endif
+
+// The address is fetched before the return address is pushed, which may
+// overwrite it.
 #define CALL \
 {                                               \
+    int const target = RD_WORD(PC);             \
     PUSH(PC + 2);                               \
-    PC = RD_WORD(PC);                           \
+    PC = target;                                \
+}
+
+#define CALL_TO(addr) \
+{                                               \
+    PUSH(PC);                                   \
+    PC = (addr);                                \
 }
 
 #define RST(addr) \
@@ -261,15 +822,51 @@ struct i8080 {
     PC = (addr);                                \
 }
 
-#define PARITY(reg) i8080_getParity(reg)
+// HLT leaves PC at itself, so a halted CPU keeps executing it until an
+// interrupt is accepted.
+#define HLT() \
+{                                               \
+    PC--;                                       \
+    cpu->halted = 1;                            \
+}
+
+// The interrupts are enabled after the instruction following EI.
+#define EI() \
+{                                               \
+    IFF = 1;                                    \
+    cpu->pending |= PENDING_EI;                 \
+    i8080_hal_iff(cpu, IFF);                    \
+}
+
+#define DI() \
+{                                               \
+    IFF = 0;                                    \
+    i8080_hal_iff(cpu, IFF);                    \
+}
+
+#define PENDING_IRQ     0x01    // `cpu->irq` is requested.
+#define PENDING_EI      0x02    // The last instruction was EI.
+#define PENDING_WATCH   0x04    // The last instruction hit a watchpoint.
+#define PENDING_LINES   0x08    // An 8085 interrupt line is requested.
 
-static struct i8080 cpu;
+#define DAA() \
+{                                               \
+    FLAGS_UPDATE();                             \
+    carry = (uns8)TST(C_FLAG);                  \
+    add = 0;                                    \
+    if (TST(H_FLAG) || (A & 0x0f) > 9) {        \
+        add = 0x06;                             \
+    }                                           \
+    if (TST(C_FLAG) || (A >> 4) > 9 ||          \
+        ((A >> 4) >= 9 && (A & 0x0f) > 9)) {    \
+        add |= 0x60;                            \
+        carry = 1;                              \
+    }                                           \
+    ADD(add);                                   \
+    PUT(C_FLAG, carry);                         \
+}
 
-static uns32 work32;
-static uns16 work16;
-static uns8 work8;
-static int index;
-static uns8 carry, add;
+#define PARITY(reg) i8080_getParity(reg)
 
 int i8080_getParity(int val) {
   val ^= val >> 4;
@@ -286,95 +883,583 @@ int sub_half_carry_table[] = { 0, 1, 1, 1, 0, 0, 0, 1 };
 #define VECTOR(x) (x >> 3 & 7)
 #define RP(x) (x >> 4 & 3)
 
-uns8 M;
-uns8* REG[] = { &B, &C, &D, &E, &H, &L, &M, &A };
-uns16* PAIR[] = { &BC, &DE, &HL, &SP };
+void i8080_init(struct i8080 *cpu) {
+#ifdef I8080_PAGE_TABLE
+    int page;
+#endif
+#ifdef I8080_IO_TABLE
+    int i;
+#endif
+    AF = 0;
+    BC = 0;
+    DE = 0;
+    HL = 0;
+    SP = 0;
+    IFF = 0;
+    cpu->last_pc = 0;
+    cpu->breakpoints = 0;
+    cpu->traps = 0;
+    cpu->trap_handler = 0;
+    cpu->trap_data = 0;
+    cpu->stop_reason = I8080_STOP_BUDGET;
+    cpu->cycles = 0;
+    cpu->irq = 0;
+    cpu->pending = 0;
+    cpu->halted = 0;
+#ifdef I8080_SNAPSHOT
+    for (page = 0; page < 256; ++page)
+        cpu->cow[page] = 0;
+#endif
+#ifdef I8080_BLOCK_CACHE
+    cpu->blocks = 0;
+    cpu->block_limit = 0;
+#endif
+#ifdef I8080_IDLE
+    cpu->idle_retry = 0;
+#endif
+#ifdef I8080_TRACE
+    cpu->trace = 0;
+#endif
+#ifdef I8080_MEMSTATS
+    cpu->memstats = 0;
+#endif
+#ifdef I8080_PROFILE
+    cpu->profile = 0;
+#endif
+#ifdef I8080_BUS
+    cpu->bus_handler = 0;
+    cpu->bus_data = 0;
+    cpu->bus_offset = 0;
+    cpu->bus_waits = 0;
+#endif
+#ifdef I8080_REPLAY
+    cpu->replay = 0;
+#endif
+#ifdef I8080_IO_TABLE
+    for (i = 0; i < 256; ++i) {
+        cpu->port[i].input = 0;
+        cpu->port[i].input_data = 0;
+        cpu->port[i].output = 0;
+        cpu->port[i].output_data = 0;
+        cpu->port[i].value = -1;
+        cpu->port[i].echo = 0;
+    }
+#endif
+#if I8080_EVENTS > 0
+    cpu->events = 0;
+    cpu->next_event = I8080_NEVER;
+#endif
+#ifdef I8080_PAGE_TABLE
+    for (page = 0; page < 256; ++page)
+        cpu->page_flags[page] = 0;
+    cpu->watch_read = 0;
+    cpu->watch_write = 0;
+    cpu->watch_addr = 0;
+    cpu->watch_access = 0;
+    i8080_map(cpu, 0, 0x10000, 0, 0);
+#endif
 
-void i8080_init(void) {
+#ifdef I8080_PACKED_FLAGS
+    F = F_UN1;
+#else
     C_FLAG = 0;
     S_FLAG = 0;
     Z_FLAG = 0;
     H_FLAG = 0;
     P_FLAG = 0;
+#ifdef I8080_8085
+    UN1_FLAG = 0;
+#else
     UN1_FLAG = 1;
+#endif
     UN3_FLAG = 0;
     UN5_FLAG = 0;
+#endif
+#ifdef I8080_8085
+    cpu->lines = 0;
+    cpu->latched = 0;
+    cpu->masks = 0x07;      // RESET IN sets the masks.
+    cpu->sod = 0;
+    cpu->trap_ie = 0;
+#endif
+#ifdef I8080_LAZY_FLAGS
+    cpu->lazy_kind = LAZY_NONE;
+#endif
 
     PC = 0xF800;
 }
 
-static void i8080_store_flags(void) {
+#ifdef I8080_LAZY_FLAGS
+
+static void i8080_lazy_flags(struct i8080 *cpu) {
+    uns8 const a = cpu->lazy_a;
+    uns8 const val = cpu->lazy_val;
+    uns8 const res = cpu->lazy_res;
+
+    switch (cpu->lazy_kind) {
+        case LAZY_ADD:
+            PUT(H_FLAG, half_carry_table[HALF_CARRY_INDEX(a, val, res) & 0x7]);
+            break;
+        case LAZY_SUB:
+            PUT(H_FLAG, !sub_half_carry_table[HALF_CARRY_INDEX(a, val, res) & 0x7]);
+            break;
+        case LAZY_ANA:
+            PUT(H_FLAG, ((a | val) & 0x08) != 0);
+            break;
+        case LAZY_LOGIC:
+            CLR(H_FLAG);
+            break;
+        case LAZY_INR:
+            PUT(H_FLAG, ((res & 0x0f) == 0));
+            break;
+        case LAZY_DCR:
+            PUT(H_FLAG, !((res & 0x0f) == 0x0f));
+            break;
+    }
+    PUT(S_FLAG, ((res & 0x80) != 0));
+    PUT(Z_FLAG, (res == 0));
+    PUT(P_FLAG, PARITY(res));
+    cpu->lazy_kind = LAZY_NONE;
+}
+
+#endif
+
+static void i8080_store_flags(struct i8080 *cpu) {
+    FLAGS_UPDATE();
+#ifndef I8080_PACKED_FLAGS
     if (S_FLAG) F |= F_NEG;      else F &= ~F_NEG;
     if (Z_FLAG) F |= F_ZERO;     else F &= ~F_ZERO;
     if (H_FLAG) F |= F_HCARRY;   else F &= ~F_HCARRY;
     if (P_FLAG) F |= F_PARITY;   else F &= ~F_PARITY;
     if (C_FLAG) F |= F_CARRY;    else F &= ~F_CARRY;
+#ifdef I8080_8085
+    if (V_FLAG) F |= F_UN1;      else F &= ~F_UN1;
+    if (K_FLAG) F |= F_UN5;      else F &= ~F_UN5;
+    F &= ~F_UN3;   // UN3_FLAG is always 0.
+#else
     F |= F_UN1;    // UN1_FLAG is always 1.
     F &= ~F_UN3;   // UN3_FLAG is always 0.
     F &= ~F_UN5;   // UN5_FLAG is always 0.
+#endif
+#endif
 }
 
-static void i8080_retrieve_flags(void) {
+static void i8080_retrieve_flags(struct i8080 *cpu) {
+#ifdef I8080_LAZY_FLAGS
+    cpu->lazy_kind = LAZY_NONE;
+#endif
+#ifdef I8080_PACKED_FLAGS
+    F = (F | F_UN1) & ~(F_UN3 | F_UN5);
+#else
     S_FLAG = F & F_NEG      ? 1 : 0;
     Z_FLAG = F & F_ZERO     ? 1 : 0;
     H_FLAG = F & F_HCARRY   ? 1 : 0;
     P_FLAG = F & F_PARITY   ? 1 : 0;
     C_FLAG = F & F_CARRY    ? 1 : 0;
+#ifdef I8080_8085
+    V_FLAG = F & F_UN1      ? 1 : 0;
+    K_FLAG = F & F_UN5      ? 1 : 0;
+#endif
+#endif
 }
 
-static uns8 i8080_checkCondition(uns8 c) {
+static uns8 i8080_checkCondition(struct i8080 *cpu, uns8 c) {
+#ifdef I8080_LAZY_FLAGS
+  if (cpu->lazy_kind) {
+    switch (c) {
+      case 0: return cpu->lazy_res != 0;
+      case 1: return cpu->lazy_res == 0;
+      case 4: return !PARITY(cpu->lazy_res);
+      case 5: return PARITY(cpu->lazy_res);
+      case 6: return !(cpu->lazy_res & 0x80);
+      case 7: return (cpu->lazy_res & 0x80) != 0;
+    }
+  }
+#endif
   switch (c) {
-    case 0: return !Z_FLAG;
-    case 1: return Z_FLAG;
-    case 2: return !C_FLAG;
-    case 3: return C_FLAG;
-    case 4: return !P_FLAG;
-    case 5: return P_FLAG;
-    case 6: return !S_FLAG;
-    case 7: return S_FLAG;
+    case 0: return !TST(Z_FLAG);
+    case 1: return TST(Z_FLAG);
+    case 2: return !TST(C_FLAG);
+    case 3: return TST(C_FLAG);
+    case 4: return !TST(P_FLAG);
+    case 5: return TST(P_FLAG);
+    case 6: return !TST(S_FLAG);
+    case 7: return TST(S_FLAG);
   }
   return 0;
 }
 
-static int i8080_execute(int opcode) {
-    int cpu_cycles = 0;
+#ifdef I8080_8085
 
-    switch (opcode) {
-        case 0x00:            /* nop */
-        // Undocumented NOP.
-        case 0x08:            /* nop */
-        case 0x10:            /* nop */
-        case 0x18:            /* nop */
-        case 0x20:            /* nop */
-        case 0x28:            /* nop */
-        case 0x30:            /* nop */
-        case 0x38:            /* nop */
-            cpu_cycles = 4;
-            break;
+// Requests the interrupt of the lines at the next instruction boundary if
+// one of them may be taken.
+static void i8080_lines_changed(struct i8080 *cpu) {
+    int const requests =
+        (cpu->lines & (I8080_LINE_RST55 | I8080_LINE_RST65)) |
+        (cpu->latched & I8080_LINE_RST75);
+    if ((cpu->latched & I8080_LINE_TRAP) || (requests & ~(cpu->masks << 4))) {
+        cpu->pending |= PENDING_LINES;
+#ifdef I8080_BLOCK_CACHE
+        cpu->block_limit = 0;
+#endif
+    } else {
+        cpu->pending &= ~PENDING_LINES;
+    }
+}
 
-        case 0x07:            /* rlc */
-            cpu_cycles = 4;
-            C_FLAG = ((A & 0x80) != 0);
-            A = (A << 1) | C_FLAG;
-            break;
+void i8080_line(struct i8080 *cpu, int line, int level) {
+    int const old = cpu->lines;
+    if (level)
+        cpu->lines |= line;
+    else
+        cpu->lines &= ~line;
+    if (level && !(old & line))
+        cpu->latched |= line & (I8080_LINE_TRAP | I8080_LINE_RST75);
+    i8080_lines_changed(cpu);
+}
 
-        case 0x0F:            /* rrc */
-            cpu_cycles = 4;
-            C_FLAG = A & 0x01;
-            A = (A >> 1) | (C_FLAG << 7);
+int i8080_sod(struct i8080 *cpu) {
+    return cpu->sod;
+}
+
+// The first RIM after a TRAP reads the interrupt enable from before it.
+static uns8 i8080_rim(struct i8080 *cpu) {
+    int ie = IFF;
+    if (cpu->trap_ie) {
+        ie = cpu->trap_ie - 1;
+        cpu->trap_ie = 0;
+    }
+    return (uns8)((cpu->masks & 0x07) | (ie ? 0x08 : 0) |
+        (cpu->lines & (I8080_LINE_RST55 | I8080_LINE_RST65 | I8080_LINE_SID)) |
+        (cpu->latched & I8080_LINE_RST75));
+}
+
+static void i8080_sim(struct i8080 *cpu, uns8 a) {
+    if (a & 0x08)
+        cpu->masks = a & 0x07;
+    if (a & 0x10)
+        cpu->latched &= ~I8080_LINE_RST75;
+    if (a & 0x40)
+        cpu->sod = a >> 7;
+    i8080_lines_changed(cpu);
+}
+
+#endif
+
+// What the instruction bodies in i8080_opcodes.inc use beyond the register
+// and memory macros.
+#define COND(c)             i8080_checkCondition(cpu, c)
+#define STORE_FLAGS()       i8080_store_flags(cpu)
+#define RETRIEVE_FLAGS()    i8080_retrieve_flags(cpu)
+
+#ifdef I8080_IO_TABLE
+#define DEVICE_INPUT(port) \
+    (cpu->port[(port) & 0xff].input ? \
+        cpu->port[(port) & 0xff].input(cpu, (port) & 0xff, \
+            cpu->port[(port) & 0xff].input_data) : \
+        i8080_hal_io_input(cpu, port))
+#else
+#define DEVICE_INPUT(port) i8080_hal_io_input(cpu, port)
+#endif
+
+#ifdef I8080_REPLAY
+
+// The inputs come from the log while playing it, and go into it while
+// recording. See also `i8080_replay_attach()`.
+
+static void i8080_replay_put(struct i8080 *cpu, struct i8080_replay *r,
+    int kind, int a, int b) {
+    uns64 number = (cpu->cycles - r->last) << 1 | (uns64)kind;
+    if (r->size - r->length < I8080_REPLAY_ITEM && r->flush)
+        r->flush(cpu, r);
+    if (r->size - r->length < I8080_REPLAY_ITEM) {
+        r->mode = I8080_REPLAY_OFF;
+        return;
+    }
+    for (; number >= 0x80; number >>= 7)
+        r->log[r->length++] = (uns8)(number | 0x80);
+    r->log[r->length++] = (uns8)number;
+    r->log[r->length++] = (uns8)a;
+    if (kind == 0)
+        r->log[r->length++] = (uns8)b;
+    r->last = cpu->cycles;
+}
+
+// Decodes the next item at `pos` without taking it. Returns its kind, or
+// -1 at the end of the log.
+static int i8080_replay_peek(struct i8080_replay *r, uns64 *when,
+    long *next) {
+    uns64 number = 0;
+    long pos = r->pos;
+    int shift = 0;
+    do {
+        if (pos >= r->length || shift > 63)
+            return -1;
+        number |= (uns64)(r->log[pos] & 0x7f) << shift;
+        shift += 7;
+    } while (r->log[pos++] & 0x80);
+    if (pos + (number & 1 ? 1 : 2) > r->length)
+        return -1;
+    *when = r->last + (number >> 1);
+    *next = pos;
+    return (int)(number & 1);
+}
+
+static void i8080_replay_next(struct i8080 *cpu, struct i8080_replay *r);
+
+static void i8080_replay_irq(struct i8080 *cpu, void *data) {
+    struct i8080_replay* const r = (struct i8080_replay *)data;
+    uns64 when;
+    long next;
+    if (r != cpu->replay || r->mode != I8080_REPLAY_PLAY ||
+        i8080_replay_peek(r, &when, &next) != 1)
+        return;
+    i8080_irq(cpu, r->log[next]);
+    r->pos = next + 1;
+    r->last = when;
+    i8080_replay_next(cpu, r);
+}
+
+// Requests the next item if it is an interrupt, at its cycles.
+static void i8080_replay_next(struct i8080 *cpu, struct i8080_replay *r) {
+    uns64 when;
+    long next;
+    int const kind = i8080_replay_peek(r, &when, &next);
+    if (kind < 0) {
+        r->mode = I8080_REPLAY_OFF;
+    } else if (kind == 1) {
+        if (when <= cpu->cycles)
+            i8080_replay_irq(cpu, r);
+        else if (i8080_schedule(cpu, when, i8080_replay_irq, r) != 0)
+            r->mode = I8080_REPLAY_OFF;
+    }
+}
+
+static int i8080_replay_input(struct i8080 *cpu, int port) {
+    struct i8080_replay* const r = cpu->replay;
+    int value;
+    if (r && r->mode == I8080_REPLAY_PLAY) {
+        uns64 when;
+        long next;
+        if (i8080_replay_peek(r, &when, &next) == 0 &&
+            when == cpu->cycles && r->log[next] == (port & 0xff)) {
+            value = r->log[next + 1];
+            r->pos = next + 2;
+            r->last = when;
+            i8080_replay_next(cpu, r);
+            return value;
+        }
+        r->diverged = 1;
+        r->mode = I8080_REPLAY_OFF;
+        i8080_cancel(cpu, i8080_replay_irq, r);
+    }
+    value = DEVICE_INPUT(port);
+    if (r && r->mode == I8080_REPLAY_RECORD)
+        i8080_replay_put(cpu, r, 0, port, value);
+    return value;
+}
+
+#define INPUT(port) i8080_replay_input(cpu, port)
+
+#else
+
+#define INPUT(port) DEVICE_INPUT(port)
+
+#endif
+
+#ifdef I8080_IO_TABLE
+
+// The ports with handlers go straight to them, the constant ones return
+// their value, and the others go to the HAL.
+
+static int i8080_port_read(struct i8080 *cpu, int port) {
+    struct i8080_port* const p = &cpu->port[port & 0xff];
+    if (p->value >= 0)
+        return p->value;
+    return INPUT(port);
+}
+
+static void i8080_port_write(struct i8080 *cpu, int port, int value) {
+    struct i8080_port* const p = &cpu->port[port & 0xff];
+    if (p->echo)
+        p->value = value & 0xff;
+    if (p->output)
+        p->output(cpu, port & 0xff, value, p->output_data);
+    else
+        i8080_hal_io_output(cpu, port, value);
+}
+
+#define IO_OUT(port, value) i8080_port_write(cpu, port, value)
+#define IO_IN(reg, port)    ((reg) = (uns8)i8080_port_read(cpu, port))
+
+#else
+
+#define IO_OUT(port, value) i8080_hal_io_output(cpu, port, value)
+#define IO_IN(reg, port)    ((reg) = (uns8)INPUT(port))
+
+#endif
+
+#ifdef I8080_BUS
+
+static int i8080_bus_input(struct i8080 *cpu, int port) {
+    uns8 value;
+    BUS_CYCLE(I8080_BUS_INPUT, port);
+    IO_IN(value, port);
+    return value;
+}
+
+static void i8080_bus_output(struct i8080 *cpu, int port, int value) {
+    BUS_CYCLE(I8080_BUS_OUTPUT, port);
+    IO_OUT(port, value);
+}
+
+#undef IO_OUT
+#undef IO_IN
+
+#define IO_OUT(port, value) i8080_bus_output(cpu, port, value)
+#define IO_IN(reg, port)    ((reg) = (uns8)i8080_bus_input(cpu, port))
+
+#endif
+
+#if defined(I8080_FLAT_DISPATCH) || defined(I8080_BLOCK_CACHE) || \
+    I8080_LANES > 0
+
+// The entry points of the instructions in i8080_opcodes.inc.
+#ifdef __GNUC__
+#define OP(code)        op_##code:
+#define OP_ROW(h) \
+    &&op_0x##h##0, &&op_0x##h##1, &&op_0x##h##2, &&op_0x##h##3, \
+    &&op_0x##h##4, &&op_0x##h##5, &&op_0x##h##6, &&op_0x##h##7, \
+    &&op_0x##h##8, &&op_0x##h##9, &&op_0x##h##A, &&op_0x##h##B, \
+    &&op_0x##h##C, &&op_0x##h##D, &&op_0x##h##E, &&op_0x##h##F
+#define OP_TABLE \
+    OP_ROW(0), OP_ROW(1), OP_ROW(2), OP_ROW(3), \
+    OP_ROW(4), OP_ROW(5), OP_ROW(6), OP_ROW(7), \
+    OP_ROW(8), OP_ROW(9), OP_ROW(A), OP_ROW(B), \
+    OP_ROW(C), OP_ROW(D), OP_ROW(E), OP_ROW(F)
+#else
+#define OP(code)        case code:
+#endif
+
+#endif
+
+#ifdef I8080_FLAT_DISPATCH
+
+// The flat decoder: every opcode has its own entry, so any instruction costs
+// one indirect jump. GNU C (GCC, Clang) jumps through a table of label
+// addresses, other compilers get a dense switch. The instruction bodies are
+// in i8080_opcodes.inc.
+
+#define DONE(cycles)    return cycles
+#define IMM8()          RD_BYTE(PC++)
+#define IMM16()         i8080_fetch_word(cpu)
+
+static int i8080_fetch_word(struct i8080 *cpu) {
+    int const word = RD_WORD(PC);
+    PC += 2;
+    return word;
+}
+
+static int i8080_execute(struct i8080 *cpu, int opcode) {
+    uns32 work32;
+    uns16 work16;
+    uns8 work8;
+#ifndef I8080_LAZY_FLAGS
+    int index;
+#endif
+    uns8 carry, add;
+
+#ifdef __GNUC__
+    static const void* const dispatch[256] = { OP_TABLE };
+
+    goto *dispatch[opcode & 0xff];
+#else
+    switch (opcode & 0xff) {
+#endif
+
+#include "i8080_opcodes.inc"
+
+#ifndef __GNUC__
+    }
+#endif
+    return -1;  // Not reached: all 256 opcodes are decoded above.
+}
+
+#undef DONE
+#undef IMM8
+#undef IMM16
+
+#else
+
+// The compact decoder (the default). The irregular instructions are decoded
+// one by one, and the regular groups (ALU, MOV, INR/DCR, MVI, conditional
+// branches, register pairs) by masking their operand fields. This keeps the
+// code small enough for microcontrollers such as Arduino.
+
+// Register operands are decoded into offsets inside `struct i8080` rather
+// than pointers, so the tables are shared by all CPU instances. The slot 6
+// (M) is never used: memory operands are decoded explicitly.
+static const uns8 REG_OFFSET[] = {
+    offsetof(struct i8080, bc.b.h), offsetof(struct i8080, bc.b.l),
+    offsetof(struct i8080, de.b.h), offsetof(struct i8080, de.b.l),
+    offsetof(struct i8080, hl.b.h), offsetof(struct i8080, hl.b.l),
+    offsetof(struct i8080, af.b.l), offsetof(struct i8080, af.b.h)
+};
+
+static const uns8 PAIR_OFFSET[] = {
+    offsetof(struct i8080, bc.w), offsetof(struct i8080, de.w),
+    offsetof(struct i8080, hl.w), offsetof(struct i8080, sp.w)
+};
+
+#define REG(n)          (*((uns8 *)cpu + REG_OFFSET[n]))
+#define PAIR(n)         (*(uns16 *)((uns8 *)cpu + PAIR_OFFSET[n]))
+
+static int i8080_execute(struct i8080 *cpu, int opcode) {
+    int cpu_cycles = 0;
+    uns32 work32;
+    uns16 work16;
+    uns8 work8;
+#ifndef I8080_LAZY_FLAGS
+    int index;
+#endif
+    uns8 carry, add;
+
+    switch (opcode) {
+        case 0x00:            /* nop */
+        // Undocumented NOP.
+        case 0x08:            /* nop */
+        case 0x10:            /* nop */
+        case 0x18:            /* nop */
+        case 0x20:            /* nop */
+        case 0x28:            /* nop */
+        case 0x30:            /* nop */
+        case 0x38:            /* nop */
+            cpu_cycles = 4;
+            break;
+
+        case 0x07:            /* rlc */
+            cpu_cycles = 4;
+            PUT(C_FLAG, ((A & 0x80) != 0));
+            A = (A << 1) | TST(C_FLAG);
+            break;
+
+        case 0x0F:            /* rrc */
+            cpu_cycles = 4;
+            PUT(C_FLAG, A & 0x01);
+            A = (A >> 1) | (TST(C_FLAG) << 7);
             break;
 
         case 0x17:            /* ral */
             cpu_cycles = 4;
-            work8 = (uns8)C_FLAG;
-            C_FLAG = ((A & 0x80) != 0);
+            work8 = (uns8)TST(C_FLAG);
+            PUT(C_FLAG, ((A & 0x80) != 0));
             A = (A << 1) | work8;
             break;
 
         case 0x1F:             /* rar */
             cpu_cycles = 4;
-            work8 = (uns8)C_FLAG;
-            C_FLAG = A & 0x01;
+            work8 = (uns8)TST(C_FLAG);
+            PUT(C_FLAG, A & 0x01);
             A = (A >> 1) | (work8 << 7);
             break;
 
@@ -386,18 +1471,7 @@ static int i8080_execute(int opcode) {
 
         case 0x27:            /* daa */
             cpu_cycles = 4;
-            carry = (uns8)C_FLAG;
-            add = 0;
-            if (H_FLAG || (A & 0x0f) > 9) {
-                add = 0x06;
-            }
-            if (C_FLAG || (A >> 4) > 9 || ((A >> 4) >= 9 && (A & 0x0f) > 9)) {
-                add |= 0x60;
-                carry = 1;
-            }
-            ADD(add);
-            P_FLAG = PARITY(A);
-            C_FLAG = carry;
+            DAA();
             break;
 
         case 0x2A:            /* ldhl addr */
@@ -453,8 +1527,8 @@ static int i8080_execute(int opcode) {
             break;
 
         case 0x76:            /* hlt */
-            cpu_cycles = 4;
-            PC--;
+            cpu_cycles = 7;
+            HLT();
             break;
 
         case 0x86:            /* add m */
@@ -539,7 +1613,7 @@ static int i8080_execute(int opcode) {
 
         case 0xD3:            /* out port8 */
             cpu_cycles = 10;
-            i8080_hal_io_output(RD_BYTE(PC++), A);
+            IO_OUT(RD_BYTE(PC++), A);
             break;
 
         case 0xD6:            /* sui data8 */
@@ -550,7 +1624,7 @@ static int i8080_execute(int opcode) {
 
         case 0xDB:            /* in port8 */
             cpu_cycles = 10;
-            A = i8080_hal_io_input(RD_BYTE(PC++));
+            IO_IN(A, RD_BYTE(PC++));
             break;
 
         case 0xDE:            /* sbi data8 */
@@ -562,7 +1636,7 @@ static int i8080_execute(int opcode) {
         case 0xE3:            /* xthl */
             cpu_cycles = 18;
             work16 = RD_WORD(SP);
-            WR_WORD(SP, HL);
+            WR_STACK(SP, HL);
             HL = work16;
             break;
 
@@ -593,18 +1667,17 @@ static int i8080_execute(int opcode) {
         case 0xF1:            /* pop psw */
             cpu_cycles = 10;
             POP(AF);
-            i8080_retrieve_flags();
+            i8080_retrieve_flags(cpu);
             break;
 
         case 0xF3:            /* di */
             cpu_cycles = 4;
-            IFF = 0;
-            i8080_hal_iff(IFF);
+            DI();
             break;
 
         case 0xF5:            /* push psw */
             cpu_cycles = 11;
-            i8080_store_flags();
+            i8080_store_flags(cpu);
             PUSH(AF);
             break;
 
@@ -621,8 +1694,7 @@ static int i8080_execute(int opcode) {
 
         case 0xFB:            /* ei */
             cpu_cycles = 4;
-            IFF = 1;
-            i8080_hal_iff(IFF);
+            EI();
             break;
 
         case 0xFE:            /* cpi data8 */
@@ -639,102 +1711,2616 @@ static int i8080_execute(int opcode) {
 
     // cmp,ora,xra,ana,sbb,sub,adc,add
     switch (opcode & 0b11111000) {
-        case 0b10111000: CMP(*REG[SOURCE(opcode)]); return 4; // cmp s  ZSPCA   Compare register with A
-        case 0b10110000: ORA(*REG[SOURCE(opcode)]); return 4; // ora s  ZSPCA   OR  register with A
-        case 0b10101000: XRA(*REG[SOURCE(opcode)]); return 4; // xra s  ZSPCA   ExclusiveOR register with A
-        case 0b10100000: ANA(*REG[SOURCE(opcode)]); return 4; // ana s  ZSCPA   AND register with A
-        case 0b10011000: SBB(*REG[SOURCE(opcode)]); return 4; // sbb s  ZSCPA   Subtract register from A with borrow
-        case 0b10010000: SUB(*REG[SOURCE(opcode)]); return 4; // sub s  ZSCPA   Subtract register from A
-        case 0b10001000: ADC(*REG[SOURCE(opcode)]); return 4; // adc s  ZSCPA   Add register to A with carry
-        case 0b10000000: ADD(*REG[SOURCE(opcode)]); return 4; // add s  ZSPCA   Add register to A
+        case 0b10111000: CMP(REG(SOURCE(opcode))); return 4; // cmp s  ZSPCA   Compare register with A
+        case 0b10110000: ORA(REG(SOURCE(opcode))); return 4; // ora s  ZSPCA   OR  register with A
+        case 0b10101000: XRA(REG(SOURCE(opcode))); return 4; // xra s  ZSPCA   ExclusiveOR register with A
+        case 0b10100000: ANA(REG(SOURCE(opcode))); return 4; // ana s  ZSCPA   AND register with A
+        case 0b10011000: SBB(REG(SOURCE(opcode))); return 4; // sbb s  ZSCPA   Subtract register from A with borrow
+        case 0b10010000: SUB(REG(SOURCE(opcode))); return 4; // sub s  ZSCPA   Subtract register from A
+        case 0b10001000: ADC(REG(SOURCE(opcode))); return 4; // adc s  ZSCPA   Add register to A with carry
+        case 0b10000000: ADD(REG(SOURCE(opcode))); return 4; // add s  ZSPCA   Add register to A
     }
 
     // rst,cccc,jccc,rccc,mvi,dcr,inr
     switch (opcode & 0b11000111) {
         case 0b11000111: RST(DEST(opcode)*8); return 11; // rst n - Restart (n*8)
-        case 0b11000100: if (i8080_checkCondition(CONDITION(opcode))) { CALL return 17; } else { PC+=2; return 11; } // cccc a    lb hb    -       Conditional subroutine call
-        case 0b11000010: if (i8080_checkCondition(CONDITION(opcode))) PC = RD_WORD(PC); else PC+=2; return 10; // jccc a    lb hb    -       Conditional jump
-        case 0b11000000: if (i8080_checkCondition(CONDITION(opcode))) { POP(PC); return 11; } else return 5; // rccc -       Conditional return 0 from subroutine
-        case 0b00000110: *REG[DEST(opcode)] = RD_BYTE(PC++); return 7; // mvi d,#   db - Move immediate to register
-        case 0b00000101: DCR(*REG[DEST(opcode)]); return 5; // dcr d   ZSPA    Decrement register
-        case 0b00000100: INR(*REG[DEST(opcode)]); return 5; // inr d   ZSPA    Increment register
+        case 0b11000100: if (i8080_checkCondition(cpu, CONDITION(opcode))) { CALL return 17; } else { PC+=2; return 11; } // cccc a    lb hb    -       Conditional subroutine call
+        case 0b11000010: if (i8080_checkCondition(cpu, CONDITION(opcode))) PC = RD_WORD(PC); else PC+=2; return 10; // jccc a    lb hb    -       Conditional jump
+        case 0b11000000: if (i8080_checkCondition(cpu, CONDITION(opcode))) { POP(PC); return 11; } else return 5; // rccc -       Conditional return 0 from subroutine
+        case 0b00000110: REG(DEST(opcode)) = RD_BYTE(PC++); return 7; // mvi d,#   db - Move immediate to register
+        case 0b00000101: DCR(REG(DEST(opcode))); return 5; // dcr d   ZSPA    Decrement register
+        case 0b00000100: INR(REG(DEST(opcode))); return 5; // inr d   ZSPA    Increment register
     }
 
     // push,pop,dcx,ldax,dad,inx,stax,lxi
     switch (opcode & 0b11001111) {
-        case 0b11000101: PUSH(*PAIR[RP(opcode)]); return 11; // push rp   *2       -       Push register pair on the stack
-        case 0b11000001: POP(*PAIR[RP(opcode)]); return 11; // pop rp    *2       *2      Pop  register pair from the stack
-        case 0b00001011: (*PAIR[RP(opcode)])--; return 5; // dcx rp -       Decrement register pair
-        case 0b00001010: A = RD_BYTE(*PAIR[RP(opcode)]); return 7; // ldax rp   *1       -       Load indirect through BC or DE
-        case 0b00001001: DAD(*PAIR[RP(opcode)]); return 10; // dad rp             C       Add register pair to HL (16 bit add)
-        case 0b00000011: (*PAIR[RP(opcode)])++; return 5; // inx rp             -       Increment register pair
-        case 0b00000010: WR_BYTE(*PAIR[RP(opcode)],A); return 7; // stax rp   *1       -       Store indirect through BC or DE
-        case 0b00000001: *PAIR[RP(opcode)] = RD_WORD(PC); PC+=2; return 10; // lxi rp,#  lb hb    -       Load register pair immediate
+        case 0b11000101: PUSH(PAIR(RP(opcode))); return 11; // push rp   *2       -       Push register pair on the stack
+        case 0b11000001: POP(PAIR(RP(opcode))); return 10; // pop rp    *2       *2      Pop  register pair from the stack
+        case 0b00001011: PAIR(RP(opcode))--; return 5; // dcx rp -       Decrement register pair
+        case 0b00001010: A = RD_BYTE(PAIR(RP(opcode))); return 7; // ldax rp   *1       -       Load indirect through BC or DE
+        case 0b00001001: DAD(PAIR(RP(opcode))); return 10; // dad rp             C       Add register pair to HL (16 bit add)
+        case 0b00000011: PAIR(RP(opcode))++; return 5; // inx rp             -       Increment register pair
+        case 0b00000010: WR_BYTE(PAIR(RP(opcode)),A); return 7; // stax rp   *1       -       Store indirect through BC or DE
+        case 0b00000001: PAIR(RP(opcode)) = RD_WORD(PC); PC+=2; return 10; // lxi rp,#  lb hb    -       Load register pair immediate
     }
 
     // mov d,s - Move register to register
     if ((opcode & 0b11000000) == 0b01000000) { 
-        if (DEST(opcode)==6) WR_BYTE(HL,*REG[SOURCE(opcode)]);
-        else if (SOURCE(opcode)==6) *REG[DEST(opcode)] = RD_BYTE(HL);
-        else *REG[DEST(opcode)] = *REG[SOURCE(opcode)]; 
+        if (DEST(opcode)==6) { WR_BYTE(HL,REG(SOURCE(opcode))); return 7; }
+        if (SOURCE(opcode)==6) { REG(DEST(opcode)) = RD_BYTE(HL); return 7; }
+        REG(DEST(opcode)) = REG(SOURCE(opcode));
         return 5;
     }
 
+    return -1;  // Not reached: all 256 opcodes are decoded above.
+}
+
+#endif
+
+// The opcode metadata. The cycles come from the instruction bodies, and
+// the mnemonics of the undocumented 8080 opcodes are marked by `*`.
+
+#define FL_S            I8080_FLAG_S
+#define FL_Z            I8080_FLAG_Z
+#define FL_P            I8080_FLAG_P
+#define FL_C            I8080_FLAG_C
+#define FL_HC           (I8080_FLAG_H | I8080_FLAG_C)
+#define FL_SZHP         (I8080_FLAG_S | I8080_FLAG_Z | I8080_FLAG_H | I8080_FLAG_P)
+#define FL_ALL          (FL_SZHP | I8080_FLAG_C)
+
+#define OP_READ         I8080_OP_READ
+#define OP_WRITE        I8080_OP_WRITE
+#define OP_IO           I8080_OP_IO
+#define OP_JUMP         I8080_OP_JUMP
+#define OP_CALL         (I8080_OP_CALL | I8080_OP_JUMP | I8080_OP_WRITE)
+#define OP_RET          (I8080_OP_RET | I8080_OP_JUMP | I8080_OP_READ)
+#define OP_COND         I8080_OP_COND
+#define OP_SYSTEM       I8080_OP_SYSTEM
+
+const struct i8080_opcode_info i8080_opcodes[256] = {
+    { "nop",     1, 4, 4, 0, 0, 0 }, // 00
+    { "lxi b,#", 3, 10, 10, 0, 0, 0 }, // 01
+    { "stax b",  1, 7, 7, 0, 0, OP_WRITE }, // 02
+    { "inx b",   1, T85(5, 6), T85(5, 6), 0, 0, 0 }, // 03
+    { "inr b",   1, T85(5, 4), T85(5, 4), 0, FL_SZHP, 0 }, // 04
+    { "dcr b",   1, T85(5, 4), T85(5, 4), 0, FL_SZHP, 0 }, // 05
+    { "mvi b,$", 2, 7, 7, 0, 0, 0 }, // 06
+    { "rlc",     1, 4, 4, 0, FL_C, 0 }, // 07
+#ifdef I8080_8085
+    { "dsub",    1, 10, 10, 0, FL_ALL, 0 }, // 08
+#else
+    { "*nop",    1, 4, 4, 0, 0, 0 }, // 08
+#endif
+    { "dad b",   1, 10, 10, 0, FL_C, 0 }, // 09
+    { "ldax b",  1, 7, 7, 0, 0, OP_READ }, // 0A
+    { "dcx b",   1, T85(5, 6), T85(5, 6), 0, 0, 0 }, // 0B
+    { "inr c",   1, T85(5, 4), T85(5, 4), 0, FL_SZHP, 0 }, // 0C
+    { "dcr c",   1, T85(5, 4), T85(5, 4), 0, FL_SZHP, 0 }, // 0D
+    { "mvi c,$", 2, 7, 7, 0, 0, 0 }, // 0E
+    { "rrc",     1, 4, 4, 0, FL_C, 0 }, // 0F
+#ifdef I8080_8085
+    { "arhl",    1, 7, 7, 0, FL_C, 0 }, // 10
+#else
+    { "*nop",    1, 4, 4, 0, 0, 0 }, // 10
+#endif
+    { "lxi d,#", 3, 10, 10, 0, 0, 0 }, // 11
+    { "stax d",  1, 7, 7, 0, 0, OP_WRITE }, // 12
+    { "inx d",   1, T85(5, 6), T85(5, 6), 0, 0, 0 }, // 13
+    { "inr d",   1, T85(5, 4), T85(5, 4), 0, FL_SZHP, 0 }, // 14
+    { "dcr d",   1, T85(5, 4), T85(5, 4), 0, FL_SZHP, 0 }, // 15
+    { "mvi d,$", 2, 7, 7, 0, 0, 0 }, // 16
+    { "ral",     1, 4, 4, FL_C, FL_C, 0 }, // 17
+#ifdef I8080_8085
+    { "rdel",    1, 10, 10, FL_C, FL_C, 0 }, // 18
+#else
+    { "*nop",    1, 4, 4, 0, 0, 0 }, // 18
+#endif
+    { "dad d",   1, 10, 10, 0, FL_C, 0 }, // 19
+    { "ldax d",  1, 7, 7, 0, 0, OP_READ }, // 1A
+    { "dcx d",   1, T85(5, 6), T85(5, 6), 0, 0, 0 }, // 1B
+    { "inr e",   1, T85(5, 4), T85(5, 4), 0, FL_SZHP, 0 }, // 1C
+    { "dcr e",   1, T85(5, 4), T85(5, 4), 0, FL_SZHP, 0 }, // 1D
+    { "mvi e,$", 2, 7, 7, 0, 0, 0 }, // 1E
+    { "rar",     1, 4, 4, FL_C, FL_C, 0 }, // 1F
+#ifdef I8080_8085
+    { "rim",     1, 4, 4, 0, 0, 0 }, // 20
+#else
+    { "*nop",    1, 4, 4, 0, 0, 0 }, // 20
+#endif
+    { "lxi h,#", 3, 10, 10, 0, 0, 0 }, // 21
+    { "shld #",  3, 16, 16, 0, 0, OP_WRITE }, // 22
+    { "inx h",   1, T85(5, 6), T85(5, 6), 0, 0, 0 }, // 23
+    { "inr h",   1, T85(5, 4), T85(5, 4), 0, FL_SZHP, 0 }, // 24
+    { "dcr h",   1, T85(5, 4), T85(5, 4), 0, FL_SZHP, 0 }, // 25
+    { "mvi h,$", 2, 7, 7, 0, 0, 0 }, // 26
+    { "daa",     1, 4, 4, FL_HC, FL_ALL, 0 }, // 27
+#ifdef I8080_8085
+    { "ldhi $",  2, 10, 10, 0, 0, 0 }, // 28
+#else
+    { "*nop",    1, 4, 4, 0, 0, 0 }, // 28
+#endif
+    { "dad h",   1, 10, 10, 0, FL_C, 0 }, // 29
+    { "lhld #",  3, 16, 16, 0, 0, OP_READ }, // 2A
+    { "dcx h",   1, T85(5, 6), T85(5, 6), 0, 0, 0 }, // 2B
+    { "inr l",   1, T85(5, 4), T85(5, 4), 0, FL_SZHP, 0 }, // 2C
+    { "dcr l",   1, T85(5, 4), T85(5, 4), 0, FL_SZHP, 0 }, // 2D
+    { "mvi l,$", 2, 7, 7, 0, 0, 0 }, // 2E
+    { "cma",     1, 4, 4, 0, 0, 0 }, // 2F
+#ifdef I8080_8085
+    { "sim",     1, 4, 4, 0, 0, 0 }, // 30
+#else
+    { "*nop",    1, 4, 4, 0, 0, 0 }, // 30
+#endif
+    { "lxi sp,#", 3, 10, 10, 0, 0, 0 }, // 31
+    { "sta #",   3, 13, 13, 0, 0, OP_WRITE }, // 32
+    { "inx sp",  1, T85(5, 6), T85(5, 6), 0, 0, 0 }, // 33
+    { "inr m",   1, 10, 10, 0, FL_SZHP, OP_READ | OP_WRITE }, // 34
+    { "dcr m",   1, 10, 10, 0, FL_SZHP, OP_READ | OP_WRITE }, // 35
+    { "mvi m,$", 2, 10, 10, 0, 0, OP_WRITE }, // 36
+    { "stc",     1, 4, 4, 0, FL_C, 0 }, // 37
+#ifdef I8080_8085
+    { "ldsi $",  2, 10, 10, 0, 0, 0 }, // 38
+#else
+    { "*nop",    1, 4, 4, 0, 0, 0 }, // 38
+#endif
+    { "dad sp",  1, 10, 10, 0, FL_C, 0 }, // 39
+    { "lda #",   3, 13, 13, 0, 0, OP_READ }, // 3A
+    { "dcx sp",  1, T85(5, 6), T85(5, 6), 0, 0, 0 }, // 3B
+    { "inr a",   1, T85(5, 4), T85(5, 4), 0, FL_SZHP, 0 }, // 3C
+    { "dcr a",   1, T85(5, 4), T85(5, 4), 0, FL_SZHP, 0 }, // 3D
+    { "mvi a,$", 2, 7, 7, 0, 0, 0 }, // 3E
+    { "cmc",     1, 4, 4, FL_C, FL_C, 0 }, // 3F
+    { "mov b,b", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 40
+    { "mov b,c", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 41
+    { "mov b,d", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 42
+    { "mov b,e", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 43
+    { "mov b,h", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 44
+    { "mov b,l", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 45
+    { "mov b,m", 1, 7, 7, 0, 0, OP_READ }, // 46
+    { "mov b,a", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 47
+    { "mov c,b", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 48
+    { "mov c,c", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 49
+    { "mov c,d", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 4A
+    { "mov c,e", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 4B
+    { "mov c,h", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 4C
+    { "mov c,l", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 4D
+    { "mov c,m", 1, 7, 7, 0, 0, OP_READ }, // 4E
+    { "mov c,a", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 4F
+    { "mov d,b", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 50
+    { "mov d,c", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 51
+    { "mov d,d", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 52
+    { "mov d,e", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 53
+    { "mov d,h", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 54
+    { "mov d,l", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 55
+    { "mov d,m", 1, 7, 7, 0, 0, OP_READ }, // 56
+    { "mov d,a", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 57
+    { "mov e,b", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 58
+    { "mov e,c", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 59
+    { "mov e,d", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 5A
+    { "mov e,e", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 5B
+    { "mov e,h", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 5C
+    { "mov e,l", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 5D
+    { "mov e,m", 1, 7, 7, 0, 0, OP_READ }, // 5E
+    { "mov e,a", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 5F
+    { "mov h,b", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 60
+    { "mov h,c", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 61
+    { "mov h,d", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 62
+    { "mov h,e", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 63
+    { "mov h,h", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 64
+    { "mov h,l", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 65
+    { "mov h,m", 1, 7, 7, 0, 0, OP_READ }, // 66
+    { "mov h,a", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 67
+    { "mov l,b", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 68
+    { "mov l,c", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 69
+    { "mov l,d", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 6A
+    { "mov l,e", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 6B
+    { "mov l,h", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 6C
+    { "mov l,l", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 6D
+    { "mov l,m", 1, 7, 7, 0, 0, OP_READ }, // 6E
+    { "mov l,a", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 6F
+    { "mov m,b", 1, 7, 7, 0, 0, OP_WRITE }, // 70
+    { "mov m,c", 1, 7, 7, 0, 0, OP_WRITE }, // 71
+    { "mov m,d", 1, 7, 7, 0, 0, OP_WRITE }, // 72
+    { "mov m,e", 1, 7, 7, 0, 0, OP_WRITE }, // 73
+    { "mov m,h", 1, 7, 7, 0, 0, OP_WRITE }, // 74
+    { "mov m,l", 1, 7, 7, 0, 0, OP_WRITE }, // 75
+    { "hlt",     1, T85(7, 5), T85(7, 5), 0, 0, OP_SYSTEM }, // 76
+    { "mov m,a", 1, 7, 7, 0, 0, OP_WRITE }, // 77
+    { "mov a,b", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 78
+    { "mov a,c", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 79
+    { "mov a,d", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 7A
+    { "mov a,e", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 7B
+    { "mov a,h", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 7C
+    { "mov a,l", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 7D
+    { "mov a,m", 1, 7, 7, 0, 0, OP_READ }, // 7E
+    { "mov a,a", 1, T85(5, 4), T85(5, 4), 0, 0, 0 }, // 7F
+    { "add b",   1, 4, 4, 0, FL_ALL, 0 }, // 80
+    { "add c",   1, 4, 4, 0, FL_ALL, 0 }, // 81
+    { "add d",   1, 4, 4, 0, FL_ALL, 0 }, // 82
+    { "add e",   1, 4, 4, 0, FL_ALL, 0 }, // 83
+    { "add h",   1, 4, 4, 0, FL_ALL, 0 }, // 84
+    { "add l",   1, 4, 4, 0, FL_ALL, 0 }, // 85
+    { "add m",   1, 7, 7, 0, FL_ALL, OP_READ }, // 86
+    { "add a",   1, 4, 4, 0, FL_ALL, 0 }, // 87
+    { "adc b",   1, 4, 4, FL_C, FL_ALL, 0 }, // 88
+    { "adc c",   1, 4, 4, FL_C, FL_ALL, 0 }, // 89
+    { "adc d",   1, 4, 4, FL_C, FL_ALL, 0 }, // 8A
+    { "adc e",   1, 4, 4, FL_C, FL_ALL, 0 }, // 8B
+    { "adc h",   1, 4, 4, FL_C, FL_ALL, 0 }, // 8C
+    { "adc l",   1, 4, 4, FL_C, FL_ALL, 0 }, // 8D
+    { "adc m",   1, 7, 7, FL_C, FL_ALL, OP_READ }, // 8E
+    { "adc a",   1, 4, 4, FL_C, FL_ALL, 0 }, // 8F
+    { "sub b",   1, 4, 4, 0, FL_ALL, 0 }, // 90
+    { "sub c",   1, 4, 4, 0, FL_ALL, 0 }, // 91
+    { "sub d",   1, 4, 4, 0, FL_ALL, 0 }, // 92
+    { "sub e",   1, 4, 4, 0, FL_ALL, 0 }, // 93
+    { "sub h",   1, 4, 4, 0, FL_ALL, 0 }, // 94
+    { "sub l",   1, 4, 4, 0, FL_ALL, 0 }, // 95
+    { "sub m",   1, 7, 7, 0, FL_ALL, OP_READ }, // 96
+    { "sub a",   1, 4, 4, 0, FL_ALL, 0 }, // 97
+    { "sbb b",   1, 4, 4, FL_C, FL_ALL, 0 }, // 98
+    { "sbb c",   1, 4, 4, FL_C, FL_ALL, 0 }, // 99
+    { "sbb d",   1, 4, 4, FL_C, FL_ALL, 0 }, // 9A
+    { "sbb e",   1, 4, 4, FL_C, FL_ALL, 0 }, // 9B
+    { "sbb h",   1, 4, 4, FL_C, FL_ALL, 0 }, // 9C
+    { "sbb l",   1, 4, 4, FL_C, FL_ALL, 0 }, // 9D
+    { "sbb m",   1, 7, 7, FL_C, FL_ALL, OP_READ }, // 9E
+    { "sbb a",   1, 4, 4, FL_C, FL_ALL, 0 }, // 9F
+    { "ana b",   1, 4, 4, 0, FL_ALL, 0 }, // A0
+    { "ana c",   1, 4, 4, 0, FL_ALL, 0 }, // A1
+    { "ana d",   1, 4, 4, 0, FL_ALL, 0 }, // A2
+    { "ana e",   1, 4, 4, 0, FL_ALL, 0 }, // A3
+    { "ana h",   1, 4, 4, 0, FL_ALL, 0 }, // A4
+    { "ana l",   1, 4, 4, 0, FL_ALL, 0 }, // A5
+    { "ana m",   1, 7, 7, 0, FL_ALL, OP_READ }, // A6
+    { "ana a",   1, 4, 4, 0, FL_ALL, 0 }, // A7
+    { "xra b",   1, 4, 4, 0, FL_ALL, 0 }, // A8
+    { "xra c",   1, 4, 4, 0, FL_ALL, 0 }, // A9
+    { "xra d",   1, 4, 4, 0, FL_ALL, 0 }, // AA
+    { "xra e",   1, 4, 4, 0, FL_ALL, 0 }, // AB
+    { "xra h",   1, 4, 4, 0, FL_ALL, 0 }, // AC
+    { "xra l",   1, 4, 4, 0, FL_ALL, 0 }, // AD
+    { "xra m",   1, 7, 7, 0, FL_ALL, OP_READ }, // AE
+    { "xra a",   1, 4, 4, 0, FL_ALL, 0 }, // AF
+    { "ora b",   1, 4, 4, 0, FL_ALL, 0 }, // B0
+    { "ora c",   1, 4, 4, 0, FL_ALL, 0 }, // B1
+    { "ora d",   1, 4, 4, 0, FL_ALL, 0 }, // B2
+    { "ora e",   1, 4, 4, 0, FL_ALL, 0 }, // B3
+    { "ora h",   1, 4, 4, 0, FL_ALL, 0 }, // B4
+    { "ora l",   1, 4, 4, 0, FL_ALL, 0 }, // B5
+    { "ora m",   1, 7, 7, 0, FL_ALL, OP_READ }, // B6
+    { "ora a",   1, 4, 4, 0, FL_ALL, 0 }, // B7
+    { "cmp b",   1, 4, 4, 0, FL_ALL, 0 }, // B8
+    { "cmp c",   1, 4, 4, 0, FL_ALL, 0 }, // B9
+    { "cmp d",   1, 4, 4, 0, FL_ALL, 0 }, // BA
+    { "cmp e",   1, 4, 4, 0, FL_ALL, 0 }, // BB
+    { "cmp h",   1, 4, 4, 0, FL_ALL, 0 }, // BC
+    { "cmp l",   1, 4, 4, 0, FL_ALL, 0 }, // BD
+    { "cmp m",   1, 7, 7, 0, FL_ALL, OP_READ }, // BE
+    { "cmp a",   1, 4, 4, 0, FL_ALL, 0 }, // BF
+    { "rnz",     1, T85(5, 6), T85(11, 12), FL_Z, 0, OP_RET | OP_COND }, // C0
+    { "pop b",   1, 10, 10, 0, 0, OP_READ }, // C1
+    { "jnz #",   3, T85(10, 7), 10, FL_Z, 0, OP_JUMP | OP_COND }, // C2
+    { "jmp #",   3, 10, 10, 0, 0, OP_JUMP }, // C3
+    { "cnz #",   3, T85(11, 9), T85(17, 18), FL_Z, 0, OP_CALL | OP_COND }, // C4
+    { "push b",  1, T85(11, 12), T85(11, 12), 0, 0, OP_WRITE }, // C5
+    { "adi $",   2, 7, 7, 0, FL_ALL, 0 }, // C6
+    { "rst 0",   1, T85(11, 12), T85(11, 12), 0, 0, OP_CALL }, // C7
+    { "rz",      1, T85(5, 6), T85(11, 12), FL_Z, 0, OP_RET | OP_COND }, // C8
+    { "ret",     1, 10, 10, 0, 0, OP_RET }, // C9
+    { "jz #",    3, T85(10, 7), 10, FL_Z, 0, OP_JUMP | OP_COND }, // CA
+#ifdef I8080_8085
+    { "rstv",    1, 6, 12, 0, 0, OP_CALL | OP_COND }, // CB
+#else
+    { "*jmp #",  3, 10, 10, 0, 0, OP_JUMP }, // CB
+#endif
+    { "cz #",    3, T85(11, 9), T85(17, 18), FL_Z, 0, OP_CALL | OP_COND }, // CC
+    { "call #",  3, T85(17, 18), T85(17, 18), 0, 0, OP_CALL }, // CD
+    { "aci $",   2, 7, 7, FL_C, FL_ALL, 0 }, // CE
+    { "rst 1",   1, T85(11, 12), T85(11, 12), 0, 0, OP_CALL }, // CF
+    { "rnc",     1, T85(5, 6), T85(11, 12), FL_C, 0, OP_RET | OP_COND }, // D0
+    { "pop d",   1, 10, 10, 0, 0, OP_READ }, // D1
+    { "jnc #",   3, T85(10, 7), 10, FL_C, 0, OP_JUMP | OP_COND }, // D2
+    { "out $",   2, 10, 10, 0, 0, OP_IO }, // D3
+    { "cnc #",   3, T85(11, 9), T85(17, 18), FL_C, 0, OP_CALL | OP_COND }, // D4
+    { "push d",  1, T85(11, 12), T85(11, 12), 0, 0, OP_WRITE }, // D5
+    { "sui $",   2, 7, 7, 0, FL_ALL, 0 }, // D6
+    { "rst 2",   1, T85(11, 12), T85(11, 12), 0, 0, OP_CALL }, // D7
+    { "rc",      1, T85(5, 6), T85(11, 12), FL_C, 0, OP_RET | OP_COND }, // D8
+#ifdef I8080_8085
+    { "shlx",    1, 10, 10, 0, 0, OP_WRITE }, // D9
+#else
+    { "*ret",    1, 10, 10, 0, 0, OP_RET }, // D9
+#endif
+    { "jc #",    3, T85(10, 7), 10, FL_C, 0, OP_JUMP | OP_COND }, // DA
+    { "in $",    2, 10, 10, 0, 0, OP_IO }, // DB
+    { "cc #",    3, T85(11, 9), T85(17, 18), FL_C, 0, OP_CALL | OP_COND }, // DC
+#ifdef I8080_8085
+    { "jnk #",   3, 7, 10, 0, 0, OP_JUMP | OP_COND }, // DD
+#else
+    { "*call #", 3, 17, 17, 0, 0, OP_CALL }, // DD
+#endif
+    { "sbi $",   2, 7, 7, FL_C, FL_ALL, 0 }, // DE
+    { "rst 3",   1, T85(11, 12), T85(11, 12), 0, 0, OP_CALL }, // DF
+    { "rpo",     1, T85(5, 6), T85(11, 12), FL_P, 0, OP_RET | OP_COND }, // E0
+    { "pop h",   1, 10, 10, 0, 0, OP_READ }, // E1
+    { "jpo #",   3, T85(10, 7), 10, FL_P, 0, OP_JUMP | OP_COND }, // E2
+    { "xthl",    1, T85(18, 16), T85(18, 16), 0, 0, OP_READ | OP_WRITE }, // E3
+    { "cpo #",   3, T85(11, 9), T85(17, 18), FL_P, 0, OP_CALL | OP_COND }, // E4
+    { "push h",  1, T85(11, 12), T85(11, 12), 0, 0, OP_WRITE }, // E5
+    { "ani $",   2, 7, 7, 0, FL_ALL, 0 }, // E6
+    { "rst 4",   1, T85(11, 12), T85(11, 12), 0, 0, OP_CALL }, // E7
+    { "rpe",     1, T85(5, 6), T85(11, 12), FL_P, 0, OP_RET | OP_COND }, // E8
+    { "pchl",    1, T85(5, 6), T85(5, 6), 0, 0, OP_JUMP }, // E9
+    { "jpe #",   3, T85(10, 7), 10, FL_P, 0, OP_JUMP | OP_COND }, // EA
+    { "xchg",    1, 4, 4, 0, 0, 0 }, // EB
+    { "cpe #",   3, T85(11, 9), T85(17, 18), FL_P, 0, OP_CALL | OP_COND }, // EC
+#ifdef I8080_8085
+    { "lhlx",    1, 10, 10, 0, 0, OP_READ }, // ED
+#else
+    { "*call #", 3, 17, 17, 0, 0, OP_CALL }, // ED
+#endif
+    { "xri $",   2, 7, 7, 0, FL_ALL, 0 }, // EE
+    { "rst 5",   1, T85(11, 12), T85(11, 12), 0, 0, OP_CALL }, // EF
+    { "rp",      1, T85(5, 6), T85(11, 12), FL_S, 0, OP_RET | OP_COND }, // F0
+    { "pop psw", 1, 10, 10, 0, FL_ALL, OP_READ }, // F1
+    { "jp #",    3, T85(10, 7), 10, FL_S, 0, OP_JUMP | OP_COND }, // F2
+    { "di",      1, 4, 4, 0, 0, OP_SYSTEM }, // F3
+    { "cp #",    3, T85(11, 9), T85(17, 18), FL_S, 0, OP_CALL | OP_COND }, // F4
+    { "push psw", 1, T85(11, 12), T85(11, 12), FL_ALL, 0, OP_WRITE }, // F5
+    { "ori $",   2, 7, 7, 0, FL_ALL, 0 }, // F6
+    { "rst 6",   1, T85(11, 12), T85(11, 12), 0, 0, OP_CALL }, // F7
+    { "rm",      1, T85(5, 6), T85(11, 12), FL_S, 0, OP_RET | OP_COND }, // F8
+    { "sphl",    1, T85(5, 6), T85(5, 6), 0, 0, 0 }, // F9
+    { "jm #",    3, T85(10, 7), 10, FL_S, 0, OP_JUMP | OP_COND }, // FA
+    { "ei",      1, 4, 4, 0, 0, OP_SYSTEM }, // FB
+    { "cm #",    3, T85(11, 9), T85(17, 18), FL_S, 0, OP_CALL | OP_COND }, // FC
+#ifdef I8080_8085
+    { "jk #",    3, 7, 10, 0, 0, OP_JUMP | OP_COND }, // FD
+#else
+    { "*call #", 3, 17, 17, 0, 0, OP_CALL }, // FD
+#endif
+    { "cpi $",   2, 7, 7, 0, FL_ALL, 0 }, // FE
+    { "rst 7",   1, T85(11, 12), T85(11, 12), 0, 0, OP_CALL }, // FF
+};
+
+#undef FL_S
+#undef FL_Z
+#undef FL_P
+#undef FL_C
+#undef FL_HC
+#undef FL_SZHP
+#undef FL_ALL
+#undef OP_READ
+#undef OP_WRITE
+#undef OP_IO
+#undef OP_JUMP
+#undef OP_CALL
+#undef OP_RET
+#undef OP_COND
+#undef OP_SYSTEM
+
+int i8080_opcode_length(int opcode) {
+    return i8080_opcodes[opcode & 0xff].length;
+}
+
+static char *i8080_hex(char *p, int value, int digits) {
+    static const char hex[] = "0123456789ABCDEF";
+    while (digits--)
+        *p++ = hex[(value >> (digits * 4)) & 0x0f];
+    return p;
+}
+
+int i8080_disassemble(const uns8 *bytes, char *text) {
+    const struct i8080_opcode_info* const info = &i8080_opcodes[bytes[0]];
+    const char *m;
+    for (m = info->mnemonic; *m; ++m) {
+        if (*m == '$')
+            text = i8080_hex(text, bytes[1], 2);
+        else if (*m == '#')
+            text = i8080_hex(text, bytes[1] | (bytes[2] << 8), 4);
+        else
+            *text++ = *m;
+    }
+    *text = 0;
+    return info->length;
+}
+
+#ifdef I8080_BLOCK_CACHE
+
+// The block cache. A block is a straight run of instructions starting at
+// a given address and ending with the first instruction which may change PC
+// other than by stepping to the next instruction, or which talks to the
+// outside world (IN, OUT, EI, DI, HLT). The instructions are decoded once
+// into the block, together with their operands, and then run by jumping
+// from one instruction body to the next.
+//
+// Every byte of a cached block is marked in the `code` bitmap. A write into
+// such byte bumps the generation of its line of 64 bytes in `gen`, which
+// invalidates the blocks built from the line. The write also terminates the
+// current block, so the code modifying itself works as it should.
+
+static int i8080_ends_block(int opcode) {
+    return (i8080_opcodes[opcode].kind &
+        (I8080_OP_JUMP | I8080_OP_IO | I8080_OP_SYSTEM)) != 0;
+}
+
+// Whether the byte at `addr` can be read ahead for a block.
+static int i8080_cacheable(struct i8080 *cpu, uns16 addr) {
+#ifdef I8080_PAGE_TABLE
+    return (cpu->page_flags[addr >> 8] &
+        (I8080_PAGE_READ | I8080_PAGE_WATCH)) == I8080_PAGE_READ;
+#else
+    return 1;
+#endif
+}
+
+static int i8080_stops_at(struct i8080 *cpu, uns16 addr) {
+    return (cpu->breakpoints && I8080_ADDR_TST(cpu->breakpoints, addr)) ||
+        (cpu->traps && I8080_ADDR_TST(cpu->traps, addr));
+}
+
+// Whether the last instruction of the block reads a constant port, which
+// has no side effects, so the block can go on.
+static int i8080_constant_input(struct i8080 *cpu,
+    const struct i8080_block *block) {
+#ifdef I8080_IO_TABLE
+    const struct i8080_block_op* const op = &block->op[block->count - 1];
+    return op->opcode == 0xDB && cpu->port[op->imm & 0xff].value >= 0;
+#else
+    (void)cpu;
+    (void)block;
+    return 0;
+#endif
+}
+
+static void i8080_build_block(struct i8080 *cpu, struct i8080_block *block) {
+    struct i8080_blocks* const blocks = cpu->blocks;
+    uns16 pc = PC;
+    int const first_line = I8080_BLOCK_LINE(pc);
+    int last_line = first_line;
+    int opcode;
+
+    block->pc = pc;
+    block->count = 0;
+    do {
+        struct i8080_block_op* const op = &block->op[block->count];
+        int const length = i8080_opcode_length(i8080_peek(cpu, pc));
+        uns16 const next_pc = (uns16)(pc + length);
+        int const line = I8080_BLOCK_LINE(next_pc - 1);
+
+        // A block covers at most two lines, and it does not run into
+        // memory which is not plain RAM or ROM.
+        if (line != first_line && line != first_line + 1)
+            break;
+        if (!i8080_cacheable(cpu, (uns16)(next_pc - 1)))
+            break;
+
+        opcode = i8080_peek(cpu, pc);
+        op->opcode = (uns8)opcode;
+        op->pc = pc;
+        op->next_pc = next_pc;
+        op->imm = (uns16)(length == 3 ?
+            i8080_peek(cpu, pc + 1) | i8080_peek(cpu, pc + 2) << 8 :
+            length == 2 ? i8080_peek(cpu, pc + 1) : 0);
+        last_line = line;
+        for (; pc != next_pc; ++pc)
+            I8080_ADDR_SET(blocks->code, pc);
+        block->count += 1;
+    } while (block->count < I8080_BLOCK_OPS &&
+             (!i8080_ends_block(opcode) || i8080_constant_input(cpu, block)) &&
+             !i8080_stops_at(cpu, pc));
+
+    block->last_line = (uns16)last_line;
+    block->gen[0] = blocks->gen[first_line];
+    block->gen[1] = blocks->gen[last_line];
+#ifdef I8080_JIT
+    block->hits = 0;
+    block->native = 0;
+#endif
+}
+
+#if defined(__GNUC__) && !defined(I8080_LAZY_FLAGS)
+
+// The dead flags. When S, Z, H and P set by an arithmetic or logical
+// instruction are all written again later in the block before anything
+// reads them, the instruction runs a lite body which only keeps its
+// operands and result. If the block stops before the flags are written
+// again, `i8080_flags_sync()` computes them from the kept values. The lazy
+// flags already defer all of the work, so they do not need it.
+#define DEAD_FLAGS
+
+#define FLAGS_DEAD(a, val, res) \
+{                                               \
+    cpu->dead_a = (uns8)(a);                    \
+    cpu->dead_val = (uns8)(val);                \
+    cpu->dead_res = (uns8)(res);                \
+}
+
+// The entry points of the lite bodies in i8080_execute_block().
+#define LITE_ROW(h) \
+    &&lite_0x##h##0, &&lite_0x##h##1, &&lite_0x##h##2, &&lite_0x##h##3, \
+    &&lite_0x##h##4, &&lite_0x##h##5, &&lite_0x##h##6, &&lite_0x##h##7, \
+    &&lite_0x##h##8, &&lite_0x##h##9, &&lite_0x##h##A, &&lite_0x##h##B, \
+    &&lite_0x##h##C, &&lite_0x##h##D, &&lite_0x##h##E, &&lite_0x##h##F
+#define LITE_TABLE \
+    LITE_ROW(0), LITE_ROW(1), LITE_ROW(2), LITE_ROW(3), \
+    LITE_ROW(4), LITE_ROW(5), LITE_ROW(6), LITE_ROW(7), \
+    LITE_ROW(8), LITE_ROW(9), LITE_ROW(A), LITE_ROW(B), \
+    LITE_ROW(C), LITE_ROW(D), LITE_ROW(E), LITE_ROW(F)
+
+// The instructions which may run a lite body: the ALU group, the ALU with
+// immediates, INR and DCR.
+static int i8080_may_defer(int opcode) {
+    return (opcode & 0xC0) == 0x80 || (opcode & 0xC7) == 0xC6 ||
+           (opcode & 0xC6) == 0x04;
+}
+
+// Sets `deferred` in the instructions of the block, walking it backwards
+// to find the flags which are live after every one of them. All flags are
+// live at the end of the block.
+static void i8080_defer_flags(struct i8080_block *block) {
+    int const szhp = I8080_FLAG_S | I8080_FLAG_Z | I8080_FLAG_H |
+        I8080_FLAG_P;
+    uns8 dead[I8080_BLOCK_OPS];
+    int live = szhp, deferred = 0;
+    int i;
+
+    for (i = block->count - 1; i >= 0; --i) {
+        int const opcode = block->op[i].opcode;
+        const struct i8080_opcode_info* const info = &i8080_opcodes[opcode];
+        dead[i] = (uns8)(i8080_may_defer(opcode) && (live & szhp) == 0);
+        live = (live & ~info->flags_written) | info->flags_read;
+    }
+    for (i = 0; i < block->count; ++i) {
+        if (dead[i])
+            deferred = i + 1;
+        else if (i8080_opcodes[block->op[i].opcode].flags_written & szhp)
+            deferred = 0;
+        block->op[i].deferred = (uns8)deferred;
+    }
+}
+
+// Computes the flags left by the lite body of `opcode`.
+static void i8080_flags_sync(struct i8080 *cpu, int opcode) {
+    uns8 const a = cpu->dead_a, val = cpu->dead_val, res = cpu->dead_res;
+    int index;
+
+    if ((opcode & 0xC6) == 0x04) {
+        if (opcode & 1) {
+            FLAGS_DCR(res);
+        } else {
+            FLAGS_INR(res);
+        }
+        return;
+    }
+    switch ((opcode >> 3) & 7) {
+    case 0:
+    case 1:
+        FLAGS_ADD(a, val, res);
+        break;
+    case 2:
+    case 3:
+    case 7:
+        FLAGS_SUB(a, val, res);
+        break;
+    case 4:
+        FLAGS_ANA(a, val, res);
+        break;
+    default:
+        FLAGS_LOGIC(res);
+        break;
+    }
+    (void)index;
+}
+
+#endif
+
+#ifdef I8080_JIT
+
+// The JIT. A hot block is translated into a native x86-64 function taking
+// the CPU context and returning the opcode of the last executed instruction,
+// like `i8080_execute_block()`. The guest registers stay in the context.
+// Instructions moving data between registers, and jumps, are emitted
+// inline; all other instructions (notably everything touching the flags or
+// the memory) call their bodies from i8080_opcodes.inc, compiled into
+// functions taking the predecoded operand, so the JIT shares the semantics
+// and the build options of the interpreter.
+// After every instruction the cycle counter is compared with `block_limit`,
+// so events, interrupts and writes into the code stop the block exactly
+// where the interpreter would.
+
+// Every instruction of i8080_opcodes.inc becomes a function of its own,
+// called directly from the native code.
+#undef OP
+#define OP(code) \
+    } static void i8080_op_##code(struct i8080 *cpu, int imm) { \
+        uns32 work32; uns16 work16; uns8 work8; int index; uns8 carry, add; \
+        (void)work32; (void)work16; (void)work8; (void)index; \
+        (void)carry; (void)add;
+#define DONE(n)         { cpu->cycles += (n); return; }
+#define IMM8()          (imm)
+#define IMM16()         (imm)
+
+static void __attribute__((unused)) i8080_op_none(void) {
+#include "i8080_opcodes.inc"
+}
+
+#ifdef DEAD_FLAGS
+// The lite bodies, see DEAD_FLAGS.
+#undef OP
+#define OP(code) \
+    } static void i8080_lite_##code(struct i8080 *cpu, int imm) { \
+        uns32 work32; uns16 work16; uns8 work8; int index; uns8 carry, add; \
+        (void)work32; (void)work16; (void)work8; (void)index; \
+        (void)carry; (void)add;
+#pragma push_macro("FLAGS_ADD")
+#pragma push_macro("FLAGS_SUB")
+#pragma push_macro("FLAGS_ANA")
+#pragma push_macro("FLAGS_LOGIC")
+#pragma push_macro("FLAGS_INR")
+#pragma push_macro("FLAGS_DCR")
+#undef FLAGS_ADD
+#undef FLAGS_SUB
+#undef FLAGS_ANA
+#undef FLAGS_LOGIC
+#undef FLAGS_INR
+#undef FLAGS_DCR
+#define FLAGS_ADD(a, val, res)  FLAGS_DEAD(a, val, res)
+#define FLAGS_SUB(a, val, res)  FLAGS_DEAD(a, val, res)
+#define FLAGS_ANA(a, val, res)  FLAGS_DEAD(a, val, res)
+#define FLAGS_LOGIC(res)        { cpu->dead_res = (uns8)(res); }
+#define FLAGS_INR(res)          { cpu->dead_res = (uns8)(res); }
+#define FLAGS_DCR(res)          { cpu->dead_res = (uns8)(res); }
+
+static void __attribute__((unused)) i8080_lite_none(void) {
+#include "i8080_opcodes.inc"
+}
+
+#pragma pop_macro("FLAGS_ADD")
+#pragma pop_macro("FLAGS_SUB")
+#pragma pop_macro("FLAGS_ANA")
+#pragma pop_macro("FLAGS_LOGIC")
+#pragma pop_macro("FLAGS_INR")
+#pragma pop_macro("FLAGS_DCR")
+#endif
+
+#undef OP
+#undef DONE
+#undef IMM8
+#undef IMM16
+
+// Back to the labels for i8080_execute_block().
+#define OP(code)        op_##code:
+
+#define OP_FN_ROW(h) \
+    i8080_op_0x##h##0, i8080_op_0x##h##1, i8080_op_0x##h##2, \
+    i8080_op_0x##h##3, i8080_op_0x##h##4, i8080_op_0x##h##5, \
+    i8080_op_0x##h##6, i8080_op_0x##h##7, i8080_op_0x##h##8, \
+    i8080_op_0x##h##9, i8080_op_0x##h##A, i8080_op_0x##h##B, \
+    i8080_op_0x##h##C, i8080_op_0x##h##D, i8080_op_0x##h##E, \
+    i8080_op_0x##h##F
+
+static void (* const JIT_OP[256])(struct i8080 *cpu, int imm) = {
+    OP_FN_ROW(0), OP_FN_ROW(1), OP_FN_ROW(2), OP_FN_ROW(3),
+    OP_FN_ROW(4), OP_FN_ROW(5), OP_FN_ROW(6), OP_FN_ROW(7),
+    OP_FN_ROW(8), OP_FN_ROW(9), OP_FN_ROW(A), OP_FN_ROW(B),
+    OP_FN_ROW(C), OP_FN_ROW(D), OP_FN_ROW(E), OP_FN_ROW(F)
+};
+
+#ifdef DEAD_FLAGS
+#define LITE_FN_ROW(h) \
+    i8080_lite_0x##h##0, i8080_lite_0x##h##1, i8080_lite_0x##h##2, \
+    i8080_lite_0x##h##3, i8080_lite_0x##h##4, i8080_lite_0x##h##5, \
+    i8080_lite_0x##h##6, i8080_lite_0x##h##7, i8080_lite_0x##h##8, \
+    i8080_lite_0x##h##9, i8080_lite_0x##h##A, i8080_lite_0x##h##B, \
+    i8080_lite_0x##h##C, i8080_lite_0x##h##D, i8080_lite_0x##h##E, \
+    i8080_lite_0x##h##F
+
+static void (* const JIT_LITE[256])(struct i8080 *cpu, int imm) = {
+    LITE_FN_ROW(0), LITE_FN_ROW(1), LITE_FN_ROW(2), LITE_FN_ROW(3),
+    LITE_FN_ROW(4), LITE_FN_ROW(5), LITE_FN_ROW(6), LITE_FN_ROW(7),
+    LITE_FN_ROW(8), LITE_FN_ROW(9), LITE_FN_ROW(A), LITE_FN_ROW(B),
+    LITE_FN_ROW(C), LITE_FN_ROW(D), LITE_FN_ROW(E), LITE_FN_ROW(F)
+};
+
+#undef LITE_FN_ROW
+#endif
+
+#undef OP_FN_ROW
+
+// The offsets of the registers in the context, in the order of the
+// register fields of the opcodes (6, the memory, has none).
+static const int JIT_REG[8] = {
+    offsetof(struct i8080, bc) + 1, offsetof(struct i8080, bc),
+    offsetof(struct i8080, de) + 1, offsetof(struct i8080, de),
+    offsetof(struct i8080, hl) + 1, offsetof(struct i8080, hl),
+    -1, offsetof(struct i8080, af) + 1
+};
+
+static const int JIT_PAIR[4] = {
+    offsetof(struct i8080, bc), offsetof(struct i8080, de),
+    offsetof(struct i8080, hl), offsetof(struct i8080, sp)
+};
+
+// The worst case of the code emitted for one instruction.
+#define JIT_OP_SIZE 128
+
+#define EMIT(byte)      (*p++ = (uns8)(byte))
+#define EMIT16(value)   (EMIT(value), EMIT((value) >> 8))
+#define EMIT32(value)   (EMIT16(value), EMIT16((value) >> 16))
+#define EMIT64(value)   (EMIT32(value), EMIT32((uns64)(value) >> 32))
+
+// <op> [rbx + offset], with the modrm register field `r`.
+#define EMIT_MEM(r, offset) (EMIT(0x83 | (r) << 3), EMIT32(offset))
+
+// mov word [rbx + offset], imm16
+#define EMIT_STORE16(offset, value) \
+    (EMIT(0x66), EMIT(0xC7), EMIT_MEM(0, offset), EMIT16(value))
+
+#if defined(I8080_PACKED_FLAGS) && !defined(I8080_LAZY_FLAGS)
+
+// With the packed flags, the F register of the 8080 has the same layout as
+// the flags loaded by LAHF, and the x86 arithmetic sets S, Z, P and C like
+// the 8080 does. H is the x86 AF after additions and increments, and the
+// inverted AF after subtractions and decrements. The logical instructions
+// compute H themselves.
+
+#define JIT_A   (offsetof(struct i8080, af) + 1)
+#define JIT_F   (offsetof(struct i8080, af))
+
+// The x86 `<op> al, r/m8` opcodes of the 8080 ALU group, from ADD to CMP.
+// `<op> al, imm8` is the next opcode but one.
+static const uns8 JIT_ALU[8] = {
+    0x02, 0x12, 0x2A, 0x1A, 0x22, 0x32, 0x0A, 0x3A
+};
+
+// Emits the ALU `group` instruction with the register at `offset` or, if
+// `offset` is negative, the immediate `imm`.
+static uns8 *i8080_jit_alu(uns8 *p, int group, int offset, int imm) {
+    if (group == 1 || group == 3) {
+        EMIT(0x8A); EMIT_MEM(4, JIT_F);                 // mov ah, [F]
+        EMIT(0x9E);                                     // sahf
+    }
+    EMIT(0x8A); EMIT_MEM(0, JIT_A);                     // mov al, [A]
+    if (group == 4) {
+        // ana: H is the bit 3 of (A | val).
+        if (offset >= 0) {
+            EMIT(0x8A); EMIT_MEM(1, offset);            // mov cl, [r]
+        } else {
+            EMIT(0xB1); EMIT(imm);                      // mov cl, imm
+        }
+        EMIT(0x8A); EMIT(0xD0);                         // mov dl, al
+        EMIT(0x0A); EMIT(0xD1);                         // or dl, cl
+        EMIT(0x22); EMIT(0xC1);                         // and al, cl
+        EMIT(0x9F);                                     // lahf
+        EMIT(0x80); EMIT(0xE4); EMIT(0xEF);             // and ah, ~H
+        EMIT(0x80); EMIT(0xE2); EMIT(0x08);             // and dl, 8
+        EMIT(0x00); EMIT(0xD2);                         // add dl, dl
+        EMIT(0x0A); EMIT(0xE2);                         // or ah, dl
+    } else {
+        if (offset >= 0) {
+            EMIT(JIT_ALU[group]); EMIT_MEM(0, offset);  // <op> al, [r]
+        } else {
+            EMIT(JIT_ALU[group] + 2); EMIT(imm);        // <op> al, imm
+        }
+        EMIT(0x9F);                                     // lahf
+        if (group == 2 || group == 3 || group == 7) {
+            EMIT(0x80); EMIT(0xF4); EMIT(0x10);         // xor ah, H
+        } else if (group == 5 || group == 6) {
+            EMIT(0x80); EMIT(0xE4); EMIT(0xEF);         // and ah, ~H
+        }
+    }
+    if (group != 7) {
+        EMIT(0x88); EMIT_MEM(0, JIT_A);                 // mov [A], al
+    }
+    EMIT(0x88); EMIT_MEM(4, JIT_F);                     // mov [F], ah
+    return p;
+}
+
+// Emits INR or DCR of the register at `offset`, keeping the carry.
+static uns8 *i8080_jit_inr(uns8 *p, int dcr, int offset) {
+    EMIT(0x8A); EMIT_MEM(4, JIT_F);                     // mov ah, [F]
+    EMIT(0x9E);                                         // sahf
+    EMIT(0xFE); EMIT_MEM(dcr, offset);                  // inc/dec byte [r]
+    EMIT(0x9F);                                         // lahf
+    if (dcr) {
+        EMIT(0x80); EMIT(0xF4); EMIT(0x10);             // xor ah, H
+    }
+    EMIT(0x88); EMIT_MEM(4, JIT_F);                     // mov [F], ah
+    return p;
+}
+
+#undef JIT_A
+#undef JIT_F
+
+#define JIT_HOST_FLAGS
+
+#endif
+
+// Emits the instruction inline, if it is one of the simple ones. Returns
+// its number of cycles, or 0 if the instruction has not been emitted.
+static int i8080_jit_inline(uns8 **code, const struct i8080_block_op *op) {
+    uns8 *p = *code;
+    int const opcode = op->opcode;
+    int const dst = (opcode >> 3) & 7, src = opcode & 7;
+    int const pair = JIT_PAIR[(opcode >> 4) & 3];
+    int cycles;
+
+#ifdef JIT_HOST_FLAGS
+    if ((opcode & 0xC0) == 0x80 && src != 6) {
+        // add, adc, sub, sbb, ana, xra, ora, cmp r
+        p = i8080_jit_alu(p, dst, JIT_REG[src], 0);
+        cycles = 4;
+    } else if ((opcode & 0xC7) == 0xC6) {
+        // adi, aci, sui, sbi, ani, xri, ori, cpi data8
+        p = i8080_jit_alu(p, dst, -1, op->imm);
+        cycles = 7;
+    } else if ((opcode & 0xC6) == 0x04 && dst != 6) {
+        // inr, dcr r
+        p = i8080_jit_inr(p, opcode & 1, JIT_REG[dst]);
+        cycles = 5;
+    } else
+#endif
+    if ((opcode & 0xC0) == 0x40 && dst != 6 && src != 6) {
+        // mov r, r: mov al, [src] / mov [dst], al
+        EMIT(0x8A); EMIT_MEM(0, JIT_REG[src]);
+        EMIT(0x88); EMIT_MEM(0, JIT_REG[dst]);
+        cycles = 5;
+    } else if ((opcode & 0xC7) == 0x06 && dst != 6) {
+        // mvi r, data8: mov byte [r], imm8
+        EMIT(0xC6); EMIT_MEM(0, JIT_REG[dst]); EMIT(op->imm);
+        cycles = 7;
+    } else if ((opcode & 0xCF) == 0x01) {
+        // lxi rp, data16
+        EMIT_STORE16(pair, op->imm);
+        cycles = 10;
+    } else if ((opcode & 0xC7) == 0x03) {
+        // inx rp / dcx rp: inc / dec word [rp]
+        EMIT(0x66); EMIT(0xFF); EMIT_MEM(opcode & 0x08 ? 1 : 0, pair);
+        cycles = 5;
+    } else if (opcode == 0xEB) {
+        // xchg: mov ax, [de] / mov cx, [hl] / mov [de], cx / mov [hl], ax
+        int const de = offsetof(struct i8080, de);
+        int const hl = offsetof(struct i8080, hl);
+        EMIT(0x66); EMIT(0x8B); EMIT_MEM(0, de);
+        EMIT(0x66); EMIT(0x8B); EMIT_MEM(1, hl);
+        EMIT(0x66); EMIT(0x89); EMIT_MEM(1, de);
+        EMIT(0x66); EMIT(0x89); EMIT_MEM(0, hl);
+        cycles = 4;
+    } else if (opcode == 0x00) {
+        cycles = 4;
+    } else if (opcode == 0xC3) {
+        // jmp addr
+        EMIT_STORE16(offsetof(struct i8080, pc), op->imm);
+        cycles = 10;
+    } else {
+        return 0;
+    }
+    // add qword [rbx + cycles], n
+    EMIT(0x48); EMIT(0x83); EMIT_MEM(0, offsetof(struct i8080, cycles));
+    EMIT(cycles);
+    *code = p;
+    return cycles;
+}
+
+// Emits the call of the instruction function. Only the instruction ending
+// the block gets PC up to date, as the other ones do not use it, and so
+// `last_pc`, but for the writes to memory the statistics see.
+static uns8 *i8080_jit_call(uns8 *p, const struct i8080_block_op *op,
+                            int last, int lite) {
+#ifdef DEAD_FLAGS
+    void (* const fn)(struct i8080 *, int) =
+        lite ? JIT_LITE[op->opcode] : JIT_OP[op->opcode];
+#else
+    void (* const fn)(struct i8080 *, int) = JIT_OP[op->opcode];
+    (void)lite;
+#endif
+
+#ifdef I8080_MEMSTATS
+    if (!last &&
+        (i8080_opcodes[op->opcode].kind & (I8080_OP_WRITE | I8080_OP_CALL)))
+        EMIT_STORE16(offsetof(struct i8080, last_pc), op->pc);
+#endif
+    if (last) {
+        EMIT_STORE16(offsetof(struct i8080, last_pc), op->pc);
+        EMIT_STORE16(offsetof(struct i8080, pc), op->next_pc);
+    }
+    EMIT(0x48); EMIT(0x89); EMIT(0xDF);                 // mov rdi, rbx
+    EMIT(0xBE); EMIT32(op->imm);                        // mov esi, imm
+    EMIT(0x48); EMIT(0xB8); EMIT64((size_t)fn);         // mov rax, fn
+    EMIT(0xFF); EMIT(0xD0);                             // call rax
+    return p;
+}
+
+// Emits the return from the native block after `op`, storing PC and
+// `last_pc` unless they are already stored, and computing the flags left
+// by the lite body of `deferred`, if any.
+static uns8 *i8080_jit_exit(uns8 *p, const struct i8080_block_op *op,
+    int stored, const struct i8080_block_op *deferred) {
+#ifdef DEAD_FLAGS
+    if (deferred) {
+        EMIT(0x48); EMIT(0x89); EMIT(0xDF);             // mov rdi, rbx
+        EMIT(0xBE); EMIT32(deferred->opcode);           // mov esi, opcode
+        EMIT(0x48); EMIT(0xB8);                         // mov rax, sync
+        EMIT64((size_t)i8080_flags_sync);
+        EMIT(0xFF); EMIT(0xD0);                         // call rax
+    }
+#else
+    (void)deferred;
+#endif
+    if (!stored) {
+        EMIT_STORE16(offsetof(struct i8080, last_pc), op->pc);
+        if (op->opcode != 0xC3)
+            EMIT_STORE16(offsetof(struct i8080, pc), op->next_pc);
+    }
+    EMIT(0xB8); EMIT32(op->opcode);                     // mov eax, opcode
+    EMIT(0x5B);                                         // pop rbx
+    EMIT(0xC3);                                         // ret
+    return p;
+}
+
+// Drops the native code of all blocks.
+static void i8080_jit_flush(struct i8080_blocks *blocks) {
+    int i;
+    for (i = 0; i < I8080_BLOCKS; ++i) {
+        blocks->block[i].native = 0;
+        blocks->block[i].hits = 0;
+    }
+    blocks->jit_used = 0;
+}
+
+// The native code is never writable and executable at once (W^X): the
+// pages of the buffer are made writable for the compiler and executable
+// again after it. If the system refuses, the JIT is turned off and the
+// blocks are interpreted.
+static int i8080_jit_protect(struct i8080_blocks *blocks, uns32 offset,
+                             uns32 size, int prot) {
+    uns32 const page = (uns32)sysconf(_SC_PAGESIZE);
+    uns32 const from = offset / page * page;
+    uns32 to = (offset + size + page - 1) / page * page;
+    if (to > I8080_JIT_SIZE)
+        to = I8080_JIT_SIZE;
+    if (mprotect(blocks->jit + from, to - from, prot) == 0)
+        return 0;
+    i8080_jit_flush(blocks);
+    munmap(blocks->jit, I8080_JIT_SIZE);
+    blocks->jit = 0;
     return -1;
 }
 
-int i8080_instruction(void) {
-    return i8080_execute(RD_BYTE(PC++));
+static int (*i8080_jit_compile(struct i8080_blocks *blocks,
+                               struct i8080_block *block))(struct i8080 *) {
+    uns8 *p, *start;
+    uns32 const size = (block->count + 1) * JIT_OP_SIZE;
+    int inlined = 0;
+    int i;
+
+    // Out of space: drop all native code and start over.
+    if (blocks->jit_used + size > I8080_JIT_SIZE)
+        i8080_jit_flush(blocks);
+    if (i8080_jit_protect(blocks, blocks->jit_used, size,
+                          PROT_READ | PROT_WRITE) != 0)
+        return 0;
+
+    start = p = blocks->jit + blocks->jit_used;
+    EMIT(0x53);                                         // push rbx
+    EMIT(0x48); EMIT(0x89); EMIT(0xFB);                 // mov rbx, rdi
+    for (i = 0; i < block->count; ++i) {
+        const struct i8080_block_op* const op = &block->op[i];
+        int const last = i + 1 == block->count;
+        int const called = !i8080_jit_inline(&p, op);
+        const struct i8080_block_op *deferred = 0;
+        if (called)
+            p = i8080_jit_call(p, op, last, op->deferred == i + 1);
+        else if (op->deferred == i + 1)
+            inlined = i + 1;
+        // The inline instructions compute all of their flags.
+        if (op->deferred && op->deferred != inlined)
+            deferred = &block->op[op->deferred - 1];
+        if (!last) {
+            // mov rax, [rbx + cycles] / cmp rax, [rbx + block_limit] / jb
+            uns8 *skip;
+            EMIT(0x48); EMIT(0x8B);
+            EMIT_MEM(0, offsetof(struct i8080, cycles));
+            EMIT(0x48); EMIT(0x3B);
+            EMIT_MEM(0, offsetof(struct i8080, block_limit));
+            EMIT(0x72); skip = p; EMIT(0);
+            p = i8080_jit_exit(p, op, 0, deferred);
+            *skip = (uns8)(p - skip - 1);
+        } else {
+            p = i8080_jit_exit(p, op, called, deferred);
+        }
+    }
+    if (i8080_jit_protect(blocks, blocks->jit_used, size,
+                          PROT_READ | PROT_EXEC) != 0)
+        return 0;
+    blocks->jit_used += (uns32)(p - start);
+    return (int (*)(struct i8080 *))(void *)start;
+}
+
+#undef EMIT
+#undef EMIT16
+#undef EMIT32
+#undef EMIT64
+#undef EMIT_MEM
+#undef EMIT_STORE16
+#undef JIT_HOST_FLAGS
+
+#endif
+
+#ifdef I8080_MEMSTATS
+
+// Counts the fetches and the operand reads of the instructions from `op`
+// to `end` of a block `n` times. The whole block is counted before it
+// runs, so its writes into itself are seen as self-modifying code.
+static void i8080_stats_ops(struct i8080_memstats *stats,
+    const struct i8080_block_op *op, const struct i8080_block_op *end,
+    int n) {
+    for (; op != end; ++op) {
+        uns16 addr;
+        stats->fetches[op->pc >> 8] += n;
+        for (addr = (uns16)(op->pc + 1); addr != op->next_pc; ++addr)
+            stats->reads[addr >> 8] += n;
+    }
+}
+
+#ifdef I8080_JIT
+// Takes back the instructions after `last_pc` if the native block stopped
+// early.
+static void i8080_stats_exit(struct i8080_memstats *stats,
+    const struct i8080_block *block, uns16 last_pc) {
+    const struct i8080_block_op *op = block->op;
+    const struct i8080_block_op* const end = op + block->count;
+    while (op != end && op->pc != last_pc)
+        ++op;
+    if (op != end)
+        i8080_stats_ops(stats, op + 1, end, -1);
+}
+#endif
+
+#endif
+
+#define DONE(n)         { cpu->cycles += (n); goto done; }
+#define IMM8()          (op->imm)
+#define IMM16()         (op->imm)
+
+// Runs the block at PC, or a single instruction if the block cannot be
+// built, until its end or until the cycle counter reaches `limit`. Returns
+// the opcode of the last executed instruction.
+static int i8080_execute_block(struct i8080 *cpu, uns64 limit) {
+    struct i8080_blocks* const blocks = cpu->blocks;
+    struct i8080_block* const block = &blocks->block[PC & (I8080_BLOCKS - 1)];
+    const struct i8080_block_op *op, *end;
+#ifdef I8080_MEMSTATS
+    struct i8080_memstats* const stats = cpu->memstats;
+#endif
+    uns32 work32;
+    uns16 work16;
+    uns8 work8;
+#ifndef I8080_LAZY_FLAGS
+    int index;
+#endif
+    uns8 carry, add;
+#ifdef __GNUC__
+    static const void* const dispatch[256] = { OP_TABLE };
+#endif
+#ifdef DEAD_FLAGS
+    static const void* const lite[256] = { LITE_TABLE };
+#endif
+
+    if (block->count == 0 || block->pc != PC ||
+        block->gen[0] != blocks->gen[I8080_BLOCK_LINE(block->pc)] ||
+        block->gen[1] != blocks->gen[block->last_line]) {
+        int i;
+        if (!i8080_cacheable(cpu, PC)) {
+            int const opcode = FETCH(PC);
+            cpu->last_pc = PC++;
+            cpu->cycles += i8080_execute(cpu, opcode);
+            return opcode;
+        }
+        i8080_build_block(cpu, block);
+        if (block->count == 0) {
+            int const opcode = FETCH(PC);
+            cpu->last_pc = PC++;
+            cpu->cycles += i8080_execute(cpu, opcode);
+            return opcode;
+        }
+#ifdef DEAD_FLAGS
+        i8080_defer_flags(block);
+        for (i = 0; i < block->count; ++i)
+            block->op[i].handler = block->op[i].deferred == i + 1 ?
+                lite[block->op[i].opcode] : dispatch[block->op[i].opcode];
+#elif defined(__GNUC__)
+        for (i = 0; i < block->count; ++i)
+            block->op[i].handler = dispatch[block->op[i].opcode];
+#else
+        (void)i;
+#endif
+    }
+
+#ifdef I8080_MEMSTATS
+    if (stats)
+        i8080_stats_ops(stats, block->op, block->op + block->count, 1);
+#endif
+
+#ifdef I8080_JIT
+    if (!block->native && blocks->jit && ++block->hits >= I8080_JIT_THRESHOLD)
+        block->native = i8080_jit_compile(blocks, block);
+    if (block->native) {
+        int opcode;
+        cpu->block_limit = limit;
+        opcode = block->native(cpu);
+#ifdef I8080_MEMSTATS
+        if (stats)
+            i8080_stats_exit(stats, block, cpu->last_pc);
+#endif
+        return opcode;
+    }
+#endif
+
+    cpu->block_limit = limit;
+    op = block->op;
+    end = op + block->count;
+    for (;;) {
+        cpu->last_pc = op->pc;
+        PC = op->next_pc;
+#ifdef __GNUC__
+        goto *op->handler;
+#else
+        switch (op->opcode) {
+#endif
+
+#include "i8080_opcodes.inc"
+
+#ifdef DEAD_FLAGS
+#undef OP
+#define OP(code)        lite_##code:
+#pragma push_macro("FLAGS_ADD")
+#pragma push_macro("FLAGS_SUB")
+#pragma push_macro("FLAGS_ANA")
+#pragma push_macro("FLAGS_LOGIC")
+#pragma push_macro("FLAGS_INR")
+#pragma push_macro("FLAGS_DCR")
+#undef FLAGS_ADD
+#undef FLAGS_SUB
+#undef FLAGS_ANA
+#undef FLAGS_LOGIC
+#undef FLAGS_INR
+#undef FLAGS_DCR
+#define FLAGS_ADD(a, val, res)  FLAGS_DEAD(a, val, res)
+#define FLAGS_SUB(a, val, res)  FLAGS_DEAD(a, val, res)
+#define FLAGS_ANA(a, val, res)  FLAGS_DEAD(a, val, res)
+#define FLAGS_LOGIC(res)        { cpu->dead_res = (uns8)(res); }
+#define FLAGS_INR(res)          { cpu->dead_res = (uns8)(res); }
+#define FLAGS_DCR(res)          { cpu->dead_res = (uns8)(res); }
+
+#include "i8080_opcodes.inc"
+
+#pragma pop_macro("FLAGS_ADD")
+#pragma pop_macro("FLAGS_SUB")
+#pragma pop_macro("FLAGS_ANA")
+#pragma pop_macro("FLAGS_LOGIC")
+#pragma pop_macro("FLAGS_INR")
+#pragma pop_macro("FLAGS_DCR")
+#undef OP
+#define OP(code)        op_##code:
+#endif
+
+#ifndef __GNUC__
+        }
+#endif
+    done:
+        if (++op == end || cpu->cycles >= cpu->block_limit) {
+#ifdef DEAD_FLAGS
+            if (op[-1].deferred)
+                i8080_flags_sync(cpu, block->op[op[-1].deferred - 1].opcode);
+#endif
+#ifdef I8080_MEMSTATS
+            if (stats)
+                i8080_stats_ops(stats, op, end, -1);
+#endif
+            return op[-1].opcode;
+        }
+    }
+}
+
+#undef DONE
+#undef IMM8
+#undef IMM16
+#undef LITE_ROW
+#undef LITE_TABLE
+#undef DEAD_FLAGS
+
+static void i8080_code_written(struct i8080 *cpu, int addr) {
+    int const line = I8080_BLOCK_LINE(addr);
+    int i;
+    for (i = 0; i < I8080_BLOCK_LINE_SIZE / 8; ++i)
+        cpu->blocks->code[line * (I8080_BLOCK_LINE_SIZE / 8) + i] = 0;
+    cpu->blocks->gen[line] += 1;
+    cpu->block_limit = 0;
+}
+
+void i8080_blocks_attach(struct i8080 *cpu, struct i8080_blocks *blocks) {
+#ifdef I8080_JIT
+    if (cpu->blocks && cpu->blocks->jit) {
+        munmap(cpu->blocks->jit, I8080_JIT_SIZE);
+        cpu->blocks->jit = 0;
+    }
+    if (blocks) {
+        void* const jit = mmap(0, I8080_JIT_SIZE, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        blocks->jit = jit == MAP_FAILED ? 0 : (uns8 *)jit;
+        blocks->jit_used = 0;
+        // Executable from the start, see i8080_jit_protect().
+        if (blocks->jit)
+            i8080_jit_protect(blocks, 0, I8080_JIT_SIZE,
+                              PROT_READ | PROT_EXEC);
+    }
+#endif
+    cpu->blocks = blocks;
+    if (blocks) {
+        int i;
+        for (i = 0; i < I8080_ADDR_MAP_SIZE; ++i)
+            blocks->code[i] = 0;
+        for (i = 0; i < I8080_BLOCK_LINES; ++i)
+            blocks->gen[i] = 0;
+        for (i = 0; i < I8080_BLOCKS; ++i)
+            blocks->block[i].count = 0;
+    }
+}
+
+void i8080_blocks_invalidate(struct i8080 *cpu, int addr, int size) {
+    if (!cpu->blocks)
+        return;
+    if (size > 0x10000)
+        size = 0x10000;
+    for (; size > 0; --size, ++addr) {
+        if (I8080_ADDR_TST(cpu->blocks->code, addr & 0xffff))
+            i8080_code_written(cpu, addr);
+    }
+}
+
+#endif
+
+#ifdef I8080_PAGE_TABLE
+
+#ifdef I8080_SNAPSHOT
+static void i8080_page_release(struct i8080_page *page) {
+    if (page && --page->refs == 0)
+        free(page);
+}
+#endif
+
+void i8080_map(struct i8080 *cpu, int addr, int size, uns8 *host, int flags) {
+    int page = (addr >> 8) & 0xff;
+    int pages = (size + 0xff) >> 8;
+    for (; pages > 0; --pages, page = (page + 1) & 0xff) {
+#ifdef I8080_SNAPSHOT
+        i8080_page_release(cpu->cow[page]);
+        cpu->cow[page] = 0;
+#endif
+        cpu->page[page] = host;
+        cpu->page_flags[page] = (uns8)((host ? flags : 0) |
+            (cpu->page_flags[page] & I8080_PAGE_WATCH));
+        if (host) host += 0x100;
+    }
+#ifdef I8080_BLOCK_CACHE
+    i8080_blocks_invalidate(cpu, addr, size);
+#endif
+}
+
+static void i8080_watch_hit(struct i8080 *cpu, int addr, int access) {
+    uns8* const map =
+        access == I8080_WATCH_READ ? cpu->watch_read : cpu->watch_write;
+    if (map && I8080_ADDR_TST(map, addr)) {
+        cpu->watch_addr = (uns16)addr;
+        cpu->watch_access = (uns8)access;
+        cpu->pending |= PENDING_WATCH;
+#ifdef I8080_BLOCK_CACHE
+        cpu->block_limit = 0;   // Leave the block after this instruction.
+#endif
+    }
+}
+
+void i8080_watch(struct i8080 *cpu, uns8 *read, uns8 *write) {
+    int page, i;
+    cpu->watch_read = read;
+    cpu->watch_write = write;
+    for (page = 0; page < 256; ++page) {
+        int watched = 0;
+        // The 256 bits of a page are 32 bytes of a bitmap.
+        for (i = page * 32; i < page * 32 + 32 && !watched; ++i)
+            watched = (read && read[i]) || (write && write[i]);
+        if (watched)
+            cpu->page_flags[page] |= I8080_PAGE_WATCH;
+        else
+            cpu->page_flags[page] &= (uns8)~I8080_PAGE_WATCH;
+    }
+#ifdef I8080_BLOCK_CACHE
+    i8080_blocks_invalidate(cpu, 0, 0x10000);
+#endif
+}
+
+#endif
+
+#if I8080_EVENTS > 0
+
+int i8080_schedule(struct i8080 *cpu, uns64 when,
+    i8080_event_handler handler, void *data) {
+    int i;
+    if (cpu->events == I8080_EVENTS)
+        return -1;
+    // The events are kept sorted by their time, the earliest one first.
+    for (i = cpu->events; i > 0 && cpu->event[i - 1].when > when; --i)
+        cpu->event[i] = cpu->event[i - 1];
+    cpu->event[i].when = when;
+    cpu->event[i].handler = handler;
+    cpu->event[i].data = data;
+    cpu->events += 1;
+    cpu->next_event = cpu->event[0].when;
+#ifdef I8080_BLOCK_CACHE
+    if (when < cpu->block_limit)
+        cpu->block_limit = when;
+#endif
+    return 0;
+}
+
+void i8080_cancel(struct i8080 *cpu, i8080_event_handler handler,
+    void *data) {
+    int i, j;
+    for (i = 0, j = 0; i < cpu->events; ++i) {
+        if (cpu->event[i].handler != handler || cpu->event[i].data != data)
+            cpu->event[j++] = cpu->event[i];
+    }
+    cpu->events = j;
+    cpu->next_event = j ? cpu->event[0].when : I8080_NEVER;
+}
+
+static void i8080_fire_events(struct i8080 *cpu) {
+    while (cpu->events && cpu->event[0].when <= cpu->cycles) {
+        struct i8080_event const event = cpu->event[0];
+        int i;
+        cpu->events -= 1;
+        for (i = 0; i < cpu->events; ++i)
+            cpu->event[i] = cpu->event[i + 1];
+        cpu->next_event = cpu->events ? cpu->event[0].when : I8080_NEVER;
+        // The handler may schedule new events, including this one again.
+        event.handler(cpu, event.data);
+    }
+}
+
+#define FIRE_EVENTS() \
+{                                               \
+    if (cpu->cycles >= cpu->next_event)         \
+        i8080_fire_events(cpu);                 \
+}
+
+#else
+
+#define FIRE_EVENTS()
+
+#endif
+
+void i8080_irq(struct i8080 *cpu, int opcode) {
+    if (opcode < 0) {
+        cpu->pending &= ~PENDING_IRQ;
+        return;
+    }
+    cpu->irq = opcode & 0xff;
+    cpu->pending |= PENDING_IRQ;
+#ifdef I8080_BLOCK_CACHE
+    cpu->block_limit = 0;
+#endif
+}
+
+int i8080_halted(struct i8080 *cpu) {
+    return cpu->halted;
+}
+
+#ifdef I8080_BUS
+
+void i8080_bus_attach(struct i8080 *cpu, i8080_bus_handler handler,
+    void *data) {
+    cpu->bus_handler = handler;
+    cpu->bus_data = data;
+    cpu->bus_offset = 0;
+    cpu->bus_waits = 0;
+#ifdef I8080_BLOCK_CACHE
+    cpu->block_limit = 0;   // Leave the block being executed, if any.
+#endif
+}
+
+// The T-states of the M1 cycle of an opcode: 4, or longer when the
+// instruction works internally before its next machine cycle.
+static int i8080_m1_cycles(int opcode) {
+    if ((opcode & 0xC7) == 0xC0 || (opcode & 0xC7) == 0xC4 ||
+        (opcode & 0xC7) == 0xC7 || (opcode & 0xCF) == 0xC5 ||
+        (opcode & 0xC7) == 0x03 || opcode == 0xCD ||
+        opcode == 0xE9 || opcode == 0xF9)   // rccc, cccc, rst, push, inx,
+        return T85(5, 6);                   // dcx, call, pchl, sphl
+#ifdef I8080_8085
+    if (opcode == 0xCB)                     // rstv
+        return 6;
+#else
+    if ((opcode & 0xCF) == 0xCD)            // call, undocumented
+        return 5;
+    if (((opcode & 0xC0) == 0x40 && opcode != 0x76 &&
+         (opcode & 0x07) != 0x06 && (opcode & 0x38) != 0x30) ||
+        ((opcode & 0xC6) == 0x04 && (opcode & 0x38) != 0x30))
+        return 5;                           // mov r,r, inr r, dcr r
+#endif
+    return 4;
+}
+
+// Starts the instruction `opcode` with its M1 cycle at `addr`.
+static void i8080_bus_start(struct i8080 *cpu, int kind, int addr,
+    int opcode) {
+    cpu->bus_offset = 0;
+    cpu->bus_waits = 0;
+    BUS_CYCLE(kind, addr);
+    cpu->bus_offset += i8080_m1_cycles(opcode) - 3;
+}
+
+static int i8080_bus_fetch(struct i8080 *cpu, int addr) {
+    int const opcode = i8080_bus_peek(cpu, addr);
+    STATS_PAGE(fetches, addr);
+    i8080_bus_start(cpu, I8080_BUS_FETCH, addr, opcode);
+    return opcode;
+}
+
+#define BUS_START(kind, addr, opcode) i8080_bus_start(cpu, kind, addr, opcode)
+#define BUS_ATTACHED        (cpu->bus_handler != 0)
+
+#else
+
+#define BUS_START(kind, addr, opcode)
+#define BUS_ATTACHED        0
+
+#endif
+
+#ifdef I8080_PROFILE
+
+// Enters the routine at `addr` called from the current one.
+static void i8080_profile_call(struct i8080_profile *profile, uns16 addr) {
+    struct i8080_profile_node *node;
+    int n;
+    if (profile->lost) {
+        profile->lost++;
+        return;
+    }
+    for (n = profile->node[profile->current].child; n;
+         n = profile->node[n].sibling)
+        if (profile->node[n].addr == addr)
+            break;
+    if (!n) {
+        if (profile->nodes == I8080_PROFILE_NODES) {
+            profile->lost = 1;      // Out of nodes: stay in the caller.
+            return;
+        }
+        n = profile->nodes++;
+        node = &profile->node[n];
+        node->addr = addr;
+        node->parent = profile->current;
+        node->child = 0;
+        node->sibling = profile->node[profile->current].child;
+        node->calls = 0;
+        node->cycles = 0;
+        profile->node[profile->current].child = n;
+    }
+    profile->node[n].calls++;
+    profile->current = n;
+}
+
+// Counts an executed instruction. The calls and returns are recognized by
+// the stack pointer moving by one word, so the not taken conditional ones
+// and the stack games keep the current routine.
+static void i8080_profile_count(struct i8080 *cpu, int opcode, int irq,
+    uns16 pc, uns16 sp, int cycles) {
+    struct i8080_profile* const profile = cpu->profile;
+    if (!irq)
+        profile->pc_count[pc]++;
+    profile->opcode_count[opcode]++;
+    profile->opcode_cycles[opcode] += cycles;
+    profile->node[profile->current].cycles += cycles;
+    if (i8080_opcodes[opcode].kind & I8080_OP_CALL) {
+        if (SP == (uns16)(sp - 2))
+            i8080_profile_call(profile, PC);
+    } else if (i8080_opcodes[opcode].kind & I8080_OP_RET) {
+        if (SP == (uns16)(sp + 2)) {
+            if (profile->lost)
+                profile->lost--;
+            else if (profile->current)
+                profile->current = profile->node[profile->current].parent;
+        }
+    }
+}
+
+#endif
+
+#if defined(I8080_TRACE) || defined(I8080_PROFILE)
+
+// Executes `opcode` fetched from PC, or taken from the bus when `irq` is
+// set, and appends its record to the trace and counts it in the profile.
+static void i8080_observe(struct i8080 *cpu, int opcode, int irq) {
+    uns64 const start = cpu->cycles;
+    uns16 const pc = PC;
+    uns16 const sp = SP;
+#ifdef I8080_TRACE
+    struct i8080_trace* const trace = cpu->trace;
+    struct i8080_trace_record *record = 0;
+
+    if (trace) {
+        int const length = irq ? 1 : i8080_opcode_length(opcode);
+        record = &trace->record[trace->count];
+        i8080_store_flags(cpu);
+        record->pc = PC;
+        record->opcode = (uns8)opcode;
+        record->operand[0] = length > 1 ? (uns8)i8080_peek(cpu, PC + 1) : 0;
+        record->operand[1] = length > 2 ? (uns8)i8080_peek(cpu, PC + 2) : 0;
+        record->a = A;
+        record->f = F;
+    }
+#endif
+    cpu->last_pc = PC;
+    if (!irq)
+        PC++;
+    cpu->cycles += i8080_execute(cpu, opcode);
+    cpu->cycles += BUS_WAITS;
+#ifdef I8080_TRACE
+    if (record) {
+        record->cycles =
+            (uns8)((cpu->cycles - start) | (irq ? I8080_TRACE_IRQ : 0));
+        if (++trace->count == trace->size)
+            trace->flush(cpu, trace);
+    }
+#endif
+#ifdef I8080_PROFILE
+    if (cpu->profile)
+        i8080_profile_count(cpu, opcode, irq, pc, sp,
+            (int)(cpu->cycles - start));
+#endif
+    (void)pc;
+    (void)sp;
+}
+
+#endif
+
+#if defined(I8080_TRACE) && defined(I8080_PROFILE)
+#define OBSERVED (cpu->trace || cpu->profile)
+#elif defined(I8080_TRACE)
+#define OBSERVED (cpu->trace != 0)
+#elif defined(I8080_PROFILE)
+#define OBSERVED (cpu->profile != 0)
+#else
+#define OBSERVED 0
+#endif
+
+// Executes the instruction at PC and returns its opcode.
+static int i8080_step(struct i8080 *cpu) {
+    int const opcode = FETCH(PC);
+#if defined(I8080_TRACE) || defined(I8080_PROFILE)
+    if (OBSERVED) {
+        i8080_observe(cpu, opcode, 0);
+        return opcode;
+    }
+#endif
+    cpu->last_pc = PC++;
+    cpu->cycles += i8080_execute(cpu, opcode);
+    cpu->cycles += BUS_WAITS;
+    return opcode;
+}
+
+#ifdef I8080_8085
+
+// Accepts the interrupt of the 8085 lines with the highest priority, if
+// any, and returns whether it did. They are not recorded by the replay.
+static int i8080_line_interrupt(struct i8080 *cpu) {
+    int const enabled =
+        ((cpu->lines & (I8080_LINE_RST55 | I8080_LINE_RST65)) |
+         (cpu->latched & I8080_LINE_RST75)) & ~(cpu->masks << 4);
+    uns16 vector;
+
+    if (cpu->latched & I8080_LINE_TRAP) {
+        cpu->latched &= ~I8080_LINE_TRAP;
+        cpu->trap_ie = (uns8)(IFF + 1);
+        vector = 0x24;
+    } else if (!IFF) {
+        return 0;
+    } else if (enabled & I8080_LINE_RST75) {
+        cpu->latched &= ~I8080_LINE_RST75;
+        vector = 0x3C;
+    } else if (enabled & I8080_LINE_RST65) {
+        vector = 0x34;
+    } else if (enabled & I8080_LINE_RST55) {
+        vector = 0x2C;
+    } else {
+        return 0;
+    }
+    DI();
+    if (cpu->halted) {
+        cpu->halted = 0;
+        PC++;
+    }
+    cpu->last_pc = PC;
+    BUS_START(I8080_BUS_INTA, PC, 0xFF);
+    RST(vector);
+    cpu->cycles += 12;
+    cpu->cycles += BUS_WAITS;
+    i8080_lines_changed(cpu);
+    return 1;
+}
+
+#endif
+
+// Called at an instruction boundary when something is pending. Accepts the
+// interrupt request if possible, and returns whether it did.
+static int i8080_interrupt(struct i8080 *cpu) {
+    if (cpu->pending & PENDING_EI) {
+        cpu->pending &= ~PENDING_EI;
+        return 0;
+    }
+#ifdef I8080_8085
+    if ((cpu->pending & PENDING_LINES) && i8080_line_interrupt(cpu))
+        return 1;
+#endif
+    if (!(cpu->pending & PENDING_IRQ) || !IFF)
+        return 0;
+    cpu->pending &= ~PENDING_IRQ;
+    DI();
+#ifdef I8080_REPLAY
+    if (cpu->replay && cpu->replay->mode == I8080_REPLAY_RECORD)
+        i8080_replay_put(cpu, cpu->replay, 1, cpu->irq, 0);
+#endif
+    if (cpu->halted) {
+        cpu->halted = 0;
+        PC++;
+    }
+    // The instruction comes from the bus, so PC is not advanced.
+    BUS_START(I8080_BUS_INTA, PC, cpu->irq);
+#if defined(I8080_TRACE) || defined(I8080_PROFILE)
+    if (OBSERVED) {
+        i8080_observe(cpu, cpu->irq, 1);
+        return 1;
+    }
+#endif
+    cpu->last_pc = PC;
+    cpu->cycles += i8080_execute(cpu, cpu->irq);
+    cpu->cycles += BUS_WAITS;
+    return 1;
+}
+
+int i8080_instruction(struct i8080 *cpu) {
+    uns64 const start = cpu->cycles;
+    if (!cpu->pending || !i8080_interrupt(cpu))
+        i8080_step(cpu);
+    FIRE_EVENTS();
+    return (int)(cpu->cycles - start);
+}
+
+#ifdef I8080_IDLE
+
+// The idle loops. A short loop whose instructions touch nothing but the
+// registers, and jumps and IN of the constant ports (see
+// `i8080_io_constant()`), does the same every time around once its
+// registers come back unchanged at the top. Then nothing changes until an
+// event or the end of the budget, so `i8080_run()` adds the cycles of the
+// rounds up to there instead of running them.
+
+static int i8080_idle_page(struct i8080 *cpu, int addr) {
+#ifdef I8080_PAGE_TABLE
+    return (cpu->page_flags[(addr >> 8) & 0xff] &
+        (I8080_PAGE_READ | I8080_PAGE_WATCH)) == I8080_PAGE_READ;
+#else
+    (void)cpu;
+    (void)addr;
+    return 1;
+#endif
+}
+
+static int i8080_idle_input(struct i8080 *cpu, int port) {
+#ifdef I8080_IO_TABLE
+    return cpu->port[port & 0xff].value >= 0;
+#else
+    (void)cpu;
+    (void)port;
+    return 0;
+#endif
+}
+
+// Returns the offsets from PC of the instructions of the loop ending with
+// the jump back at `last_pc`, one bit each, or 0 if it cannot be skipped.
+static unsigned i8080_idle_loop(struct i8080 *cpu, uns8 *breakpoints,
+    uns8 *traps) {
+    int const top = PC, bottom = cpu->last_pc;
+    unsigned starts = 0;
+    int addr;
+
+    for (addr = top; addr <= bottom; ) {
+        const struct i8080_opcode_info *info;
+        int opcode, kind;
+
+        if (!i8080_idle_page(cpu, addr) ||
+            (breakpoints && I8080_ADDR_TST(breakpoints, addr)) ||
+            (traps && I8080_ADDR_TST(traps, addr)))
+            return 0;
+        opcode = i8080_peek(cpu, addr);
+        info = &i8080_opcodes[opcode];
+        kind = info->kind & ~I8080_OP_COND;
+        if (!i8080_idle_page(cpu, addr + info->length - 1))
+            return 0;
+        starts |= 1u << (addr - top);
+        if (kind == I8080_OP_JUMP && info->length == 3) {
+            if (addr == bottom)
+                return (i8080_peek(cpu, addr + 1) |
+                        i8080_peek(cpu, addr + 2) << 8) == top ? starts : 0;
+        } else if (opcode == 0xDB) {
+            if (!i8080_idle_input(cpu, i8080_peek(cpu, addr + 1)))
+                return 0;
+#ifdef I8080_8085
+        } else if (opcode == 0x30) {
+            return 0;   // SIM
+#endif
+        } else if (kind != 0) {
+            return 0;
+        }
+        addr += info->length;
+    }
+    return 0;
+}
+
+// Called after a jump back from `last_pc` to PC. Runs the loop around once
+// and, if the registers are the same at its top again, adds the cycles of
+// all of its rounds which end by `until`.
+static void i8080_idle(struct i8080 *cpu, uns64 until, uns8 *breakpoints,
+    uns8 *traps) {
+    uns16 const top = PC;
+    uns64 const start = cpu->cycles;
+    uns16 af, bc, de, hl, sp;
+    unsigned starts;
+
+    cpu->idle_retry = cpu->cycles + I8080_IDLE_RETRY;
+    starts = i8080_idle_loop(cpu, breakpoints, traps);
+    if (!starts)
+        return;
+    i8080_store_flags(cpu);
+    af = AF;
+    bc = BC;
+    de = DE;
+    hl = HL;
+    sp = SP;
+    do {
+        int const offset = (uns16)(PC - top);
+        if (cpu->cycles >= until || offset >= I8080_IDLE_SIZE ||
+            !(starts & (1u << offset)))
+            return;
+        i8080_step(cpu);
+    } while (PC != top);
+    i8080_store_flags(cpu);
+    if (cpu->pending || AF != af || BC != bc || DE != de || HL != hl ||
+        SP != sp)
+        return;
+    if (cpu->cycles < until)
+        cpu->cycles += (until - cpu->cycles) / (cpu->cycles - start) *
+            (cpu->cycles - start);
+    cpu->idle_retry = 0;
+}
+
+#endif
+
+int i8080_run(struct i8080 *cpu, int cycles, int stop_mask) {
+    uns8* const breakpoints =
+        stop_mask & I8080_STOP_BREAKPOINT ? cpu->breakpoints : 0;
+    uns8* const traps = stop_mask & I8080_STOP_TRAP ? cpu->traps : 0;
+    uns64 const start = cpu->cycles;
+    uns64 const end = start + cycles;
+    int opcode, accepted;
+
+    cpu->stop_reason = I8080_STOP_BUDGET;
+    while (cpu->cycles < end) {
+        accepted = 0;
+        if (cpu->pending) {
+#ifdef I8080_PAGE_TABLE
+            if (cpu->pending & PENDING_WATCH) {
+                cpu->pending &= ~PENDING_WATCH;
+                if (stop_mask & I8080_STOP_WATCHPOINT) {
+                    cpu->stop_reason = I8080_STOP_WATCHPOINT;
+                    break;
+                }
+            }
+#endif
+            accepted = i8080_interrupt(cpu);
+        }
+        if (accepted) {
+            // The CPU is at the vector, which may be a breakpoint or a trap
+            // (RST 0 at 0000) as well.
+            FIRE_EVENTS();
+            opcode = 0;
+        } else if (cpu->halted) {
+            // Nothing but an interrupt can change the state of a halted
+            // CPU, so skip to the next event, which may request one.
+            uns64 until = end;
+#if I8080_EVENTS > 0
+            if (cpu->next_event < until)
+                until = cpu->next_event;
+#endif
+            if (until > cpu->cycles)
+                cpu->cycles = until;
+            FIRE_EVENTS();
+            continue;
+        } else {
+#ifdef I8080_BLOCK_CACHE
+            if (cpu->blocks && !OBSERVED && !BUS_ATTACHED) {
+                uns64 limit = end;
+#if I8080_EVENTS > 0
+                if (cpu->next_event < limit)
+                    limit = cpu->next_event;
+#endif
+                opcode = i8080_execute_block(cpu, limit);
+            } else
+#endif
+                opcode = i8080_step(cpu);
+            FIRE_EVENTS();
+            if (opcode == 0x76 && (stop_mask & I8080_STOP_HLT)) {
+                cpu->stop_reason = I8080_STOP_HLT;
+                break;
+            }
+        }
+        if (breakpoints && I8080_ADDR_TST(breakpoints, PC)) {
+            cpu->stop_reason = I8080_STOP_BREAKPOINT;
+            break;
+        }
+        if (traps && I8080_ADDR_TST(traps, PC)) {
+            if (cpu->trap_handler && !cpu->trap_handler(cpu, cpu->trap_data))
+                continue;
+            cpu->stop_reason = I8080_STOP_TRAP;
+            break;
+        }
+#ifdef I8080_IDLE
+        if ((i8080_opcodes[opcode].kind & I8080_OP_JUMP) &&
+            PC < cpu->last_pc && cpu->last_pc - PC < I8080_IDLE_SIZE &&
+            cpu->cycles >= cpu->idle_retry && !cpu->pending &&
+            !OBSERVED && !BUS_ATTACHED) {
+            uns64 until = end;
+#if I8080_EVENTS > 0
+            if (cpu->next_event < until)
+                until = cpu->next_event;
+#endif
+            i8080_idle(cpu, until, breakpoints, traps);
+            FIRE_EVENTS();
+        }
+#endif
+    }
+#ifdef I8080_PAGE_TABLE
+    // A hit by the last instruction of the budget.
+    if (cpu->stop_reason == I8080_STOP_BUDGET &&
+        (cpu->pending & PENDING_WATCH) && (stop_mask & I8080_STOP_WATCHPOINT)) {
+        cpu->pending &= ~PENDING_WATCH;
+        cpu->stop_reason = I8080_STOP_WATCHPOINT;
+    }
+#endif
+    return (int)(cpu->cycles - start);
 }
 
-void i8080_jump(int addr) {
+void i8080_save(struct i8080 *cpu, struct i8080_state *state) {
+    i8080_store_flags(cpu);
+    state->af = AF;
+    state->bc = BC;
+    state->de = DE;
+    state->hl = HL;
+    state->sp = SP;
+    state->pc = PC;
+    state->iff = IFF;
+    state->last_pc = cpu->last_pc;
+    state->irq = cpu->irq;
+    state->pending = cpu->pending;
+    state->halted = cpu->halted;
+    state->cycles = cpu->cycles;
+#ifdef I8080_8085
+    state->lines = cpu->lines;
+    state->latched = cpu->latched;
+    state->masks = cpu->masks;
+    state->sod = cpu->sod;
+    state->trap_ie = cpu->trap_ie;
+#endif
+}
+
+void i8080_restore(struct i8080 *cpu, const struct i8080_state *state) {
+    AF = state->af;
+    i8080_retrieve_flags(cpu);
+    BC = state->bc;
+    DE = state->de;
+    HL = state->hl;
+    SP = state->sp;
+    PC = state->pc;
+    IFF = state->iff;
+    cpu->last_pc = state->last_pc;
+    cpu->irq = state->irq;
+    cpu->pending = state->pending;
+    cpu->halted = state->halted;
+    cpu->cycles = state->cycles;
+#ifdef I8080_8085
+    cpu->lines = state->lines;
+    cpu->latched = state->latched;
+    cpu->masks = state->masks;
+    cpu->sod = state->sod;
+    cpu->trap_ie = state->trap_ie;
+#endif
+#ifdef I8080_BLOCK_CACHE
+    cpu->block_limit = 0;   // Leave the block being executed, if any.
+#endif
+}
+
+#ifdef I8080_SNAPSHOT
+
+// A page is writable while the CPU is its only holder. Otherwise it is
+// mapped with I8080_PAGE_COW, and the first write copies it.
+static void i8080_cow_protect(struct i8080 *cpu, int page) {
+    cpu->page_flags[page] = (uns8)((cpu->page_flags[page] & I8080_PAGE_WATCH) |
+        (cpu->cow[page]->refs > 1 ?
+            I8080_PAGE_READ | I8080_PAGE_COW :
+            I8080_PAGE_READ | I8080_PAGE_WRITE));
+}
+
+static int i8080_cow_fault(struct i8080 *cpu, int page) {
+    struct i8080_page* const shared = cpu->cow[page];
+    if (shared->refs > 1) {
+        struct i8080_page* const copy =
+            (struct i8080_page *)malloc(sizeof(struct i8080_page));
+        if (!copy)
+            return 0;
+        copy->refs = 1;
+        memcpy(copy->data, shared->data, sizeof(copy->data));
+        shared->refs -= 1;
+        cpu->cow[page] = copy;
+        cpu->page[page] = copy->data;
+    }
+    cpu->page_flags[page] = (uns8)((cpu->page_flags[page] & I8080_PAGE_WATCH) |
+        I8080_PAGE_READ | I8080_PAGE_WRITE);
+    return 1;
+}
+
+int i8080_snapshot_map(struct i8080 *cpu, int addr, int size,
+                       const uns8 *data) {
+    int page = (addr >> 8) & 0xff;
+    int pages = (size + 0xff) >> 8;
+    for (; pages > 0; --pages, page = (page + 1) & 0xff) {
+        struct i8080_page* const p =
+            (struct i8080_page *)malloc(sizeof(struct i8080_page));
+        if (!p)
+            return -1;
+        p->refs = 1;
+        if (data) {
+            memcpy(p->data, data, sizeof(p->data));
+            data += 0x100;
+        } else {
+            memset(p->data, 0, sizeof(p->data));
+        }
+        i8080_map(cpu, page << 8, 0x100, p->data, I8080_PAGE_READ);
+        cpu->cow[page] = p;
+        i8080_cow_protect(cpu, page);
+    }
+    return 0;
+}
+
+void i8080_snapshot_unmap(struct i8080 *cpu) {
+    int page;
+    for (page = 0; page < 256; ++page) {
+        if (cpu->cow[page])
+            i8080_map(cpu, page << 8, 0x100, 0, 0);
+    }
+}
+
+void i8080_snapshot_take(struct i8080 *cpu, struct i8080_snapshot *snapshot) {
+    int page;
+    i8080_save(cpu, &snapshot->state);
+    for (page = 0; page < 256; ++page) {
+        snapshot->page[page] = cpu->cow[page];
+        if (cpu->cow[page]) {
+            cpu->cow[page]->refs += 1;
+            i8080_cow_protect(cpu, page);
+        }
+    }
+}
+
+void i8080_snapshot_restore(struct i8080 *cpu,
+                            const struct i8080_snapshot *snapshot) {
+    int page;
+    i8080_restore(cpu, &snapshot->state);
+    for (page = 0; page < 256; ++page) {
+        struct i8080_page* const p = snapshot->page[page];
+        // A page still shared with the snapshot has not been written.
+        if (p == cpu->cow[page])
+            continue;
+        if (p) {
+            p->refs += 1;
+            i8080_map(cpu, page << 8, 0x100, p->data, I8080_PAGE_READ);
+            cpu->cow[page] = p;
+            i8080_cow_protect(cpu, page);
+        } else {
+            i8080_map(cpu, page << 8, 0x100, 0, 0);
+        }
+    }
+}
+
+void i8080_snapshot_release(struct i8080_snapshot *snapshot) {
+    int page;
+    for (page = 0; page < 256; ++page) {
+        i8080_page_release(snapshot->page[page]);
+        snapshot->page[page] = 0;
+    }
+}
+
+#endif
+
+#ifdef I8080_IO_TABLE
+
+void i8080_io_input(struct i8080 *cpu, int port, i8080_input_handler handler,
+    void *data) {
+    cpu->port[port & 0xff].input = handler;
+    cpu->port[port & 0xff].input_data = data;
+}
+
+void i8080_io_output(struct i8080 *cpu, int port,
+    i8080_output_handler handler, void *data) {
+    cpu->port[port & 0xff].output = handler;
+    cpu->port[port & 0xff].output_data = data;
+}
+
+void i8080_io_constant(struct i8080 *cpu, int port, int value) {
+    struct i8080_port* const p = &cpu->port[port & 0xff];
+    p->value = value < 0 ? -1 : value & 0xff;
+    p->echo = value >= 0 && (value & I8080_PORT_ECHO) != 0;
+}
+
+#endif
+
+#ifdef I8080_REPLAY
+
+void i8080_replay_attach(struct i8080 *cpu, struct i8080_replay *replay) {
+    if (cpu->replay)
+        i8080_cancel(cpu, i8080_replay_irq, cpu->replay);
+    cpu->replay = replay;
+    if (!replay)
+        return;
+    replay->last = cpu->cycles;
+    replay->diverged = 0;
+    if (replay->mode == I8080_REPLAY_PLAY)
+        i8080_replay_next(cpu, replay);
+}
+
+#endif
+
+#ifdef I8080_MEMSTATS
+
+void i8080_memstats_attach(struct i8080 *cpu, struct i8080_memstats *stats) {
+    cpu->memstats = stats;
+    if (stats)
+        memset(stats, 0, sizeof(*stats));
+}
+
+#endif
+
+#ifdef I8080_PROFILE
+
+void i8080_profile_attach(struct i8080 *cpu, struct i8080_profile *profile) {
+    cpu->profile = profile;
+    if (!profile)
+        return;
+    memset(profile, 0, sizeof(*profile));
+    profile->node[0].addr = PC;
+    profile->nodes = 1;
+}
+
+#endif
+
+int i8080_peek(struct i8080 *cpu, int addr) {
+#ifdef I8080_PAGE_TABLE
+    return i8080_read_page(cpu, addr & 0xffff);
+#elif defined(I8080_BUS)
+    return i8080_bus_peek(cpu, addr & 0xffff);
+#elif defined(I8080_MEMSTATS)
+    return i8080_stats_peek(cpu, addr & 0xffff);
+#else
+    return RD_BYTE(addr & 0xffff);
+#endif
+}
+
+void i8080_poke(struct i8080 *cpu, int addr, int byte) {
+#ifdef I8080_PAGE_TABLE
+    i8080_write_page(cpu, addr & 0xffff, byte & 0xff);
+#elif defined(I8080_BUS)
+    i8080_bus_poke(cpu, addr & 0xffff, byte & 0xff);
+#elif defined(I8080_MEMSTATS)
+    i8080_stats_poke(cpu, addr & 0xffff, byte & 0xff);
+#else
+    WR_BYTE(addr & 0xffff, byte & 0xff);
+#endif
+}
+
+void i8080_jump(struct i8080 *cpu, int addr) {
     PC = addr & 0xffff;
 }
 
-int i8080_pc(void) {
+int i8080_pc(struct i8080 *cpu) {
     return PC;
 }
 
-int i8080_regs_bc(void) {
+uns64 i8080_cycles(struct i8080 *cpu) {
+    return cpu->cycles;
+}
+
+int i8080_regs_bc(struct i8080 *cpu) {
     return BC;
 }
 
-int i8080_regs_de(void) {
+int i8080_regs_de(struct i8080 *cpu) {
     return DE;
 }
 
-int i8080_regs_hl(void) {
+int i8080_regs_hl(struct i8080 *cpu) {
     return HL;
 }
 
-int i8080_regs_sp(void) {
+int i8080_regs_sp(struct i8080 *cpu) {
     return SP;
 }
 
-int i8080_regs_a(void) {
+int i8080_regs_a(struct i8080 *cpu) {
     return A;
 }
 
-int i8080_regs_b(void) {
+int i8080_regs_b(struct i8080 *cpu) {
     return B;
 }
 
-int i8080_regs_c(void) {
+int i8080_regs_c(struct i8080 *cpu) {
     return C;
 }
 
-int i8080_regs_d(void) {
+int i8080_regs_d(struct i8080 *cpu) {
     return D;
 }
 
-int i8080_regs_e(void) {
+int i8080_regs_e(struct i8080 *cpu) {
     return E;
 }
 
-int i8080_regs_h(void) {
+int i8080_regs_h(struct i8080 *cpu) {
     return H;
 }
 
-int i8080_regs_l(void) {
+int i8080_regs_l(struct i8080 *cpu) {
     return L;
 }
+
+#if I8080_LANES > 0
+
+// The lockstep lanes. The instruction bodies of i8080_opcodes.inc are
+// compiled once more, with the register and memory macros pointing into the
+// arrays of `struct i8080_lanes` at lane `i`, and with every body wrapped
+// in a loop over the lanes executing it.
+
+void i8080_lanes_init(struct i8080_lanes *lanes, int count) {
+    int i;
+    if (count > I8080_LANES)
+        count = I8080_LANES;
+    lanes->count = count;
+    lanes->traps = 0;
+    for (i = 0; i < count; ++i) {
+        lanes->af[i].w = F_UN1;
+        lanes->bc[i].w = lanes->de[i].w = lanes->hl[i].w = 0;
+        lanes->sp[i].w = 0;
+        lanes->pc[i].w = 0xF800;
+        lanes->iff[i] = 0;
+        lanes->cycles[i] = 0;
+        lanes->stop_reason[i] = 0;
+    }
+}
+
+void i8080_lanes_get(struct i8080_lanes *lanes, int lane,
+                     struct i8080 *cpu) {
+    AF = lanes->af[lane].w;
+    BC = lanes->bc[lane].w;
+    DE = lanes->de[lane].w;
+    HL = lanes->hl[lane].w;
+    SP = lanes->sp[lane].w;
+    PC = lanes->pc[lane].w;
+    IFF = lanes->iff[lane];
+    cpu->cycles = lanes->cycles[lane];
+}
+
+void i8080_lanes_put(struct i8080_lanes *lanes, int lane,
+                     const struct i8080 *cpu) {
+    lanes->af[lane].w = AF;
+    lanes->bc[lane].w = BC;
+    lanes->de[lane].w = DE;
+    lanes->hl[lane].w = HL;
+    lanes->sp[lane].w = SP;
+    lanes->pc[lane].w = PC;
+    lanes->iff[lane] = (uns8)IFF;
+    lanes->cycles[lane] = cpu->cycles;
+    lanes->stop_reason[lane] = 0;
+}
+
+static int i8080_lane_read_word(const uns8 *memory, int addr) {
+    return memory[addr & 0xffff] | (memory[(addr + 1) & 0xffff] << 8);
+}
+
+static void i8080_lane_write_word(uns8 *memory, int addr, int word) {
+    memory[addr & 0xffff] = (uns8)word;
+    memory[(addr + 1) & 0xffff] = (uns8)(word >> 8);
+}
+
+#undef AF
+#undef BC
+#undef DE
+#undef HL
+#undef SP
+#undef PC
+#undef A
+#undef F
+#undef B
+#undef C
+#undef D
+#undef E
+#undef H
+#undef L
+#undef IFF
+#undef RD_BYTE
+#undef RD_WORD
+#undef WR_BYTE
+#undef WR_WORD
+#undef COND
+#undef STORE_FLAGS
+#undef RETRIEVE_FLAGS
+#undef IO_OUT
+#undef IO_IN
+#undef HLT
+#undef EI
+#undef DI
+#undef OP
+
+#define AF              lanes->af[i].w
+#define BC              lanes->bc[i].w
+#define DE              lanes->de[i].w
+#define HL              lanes->hl[i].w
+#define SP              lanes->sp[i].w
+#define PC              lanes->pc[i].w
+#define A               lanes->af[i].b.h
+#define F               lanes->af[i].b.l
+#define B               lanes->bc[i].b.h
+#define C               lanes->bc[i].b.l
+#define D               lanes->de[i].b.h
+#define E               lanes->de[i].b.l
+#define H               lanes->hl[i].b.h
+#define L               lanes->hl[i].b.l
+#define IFF             lanes->iff[i]
+
+#define RD_BYTE(addr)   lanes->memory[i][(addr) & 0xffff]
+#define RD_WORD(addr)   i8080_lane_read_word(lanes->memory[i], addr)
+#define WR_BYTE(addr, value) (RD_BYTE(addr) = (uns8)(value))
+#define WR_WORD(addr, value) \
+    i8080_lane_write_word(lanes->memory[i], addr, value)
+#ifdef I8080_BUS
+#undef WR_STACK
+#define WR_STACK(addr, value) WR_WORD(addr, value)
+#endif
+
+#define IMM8()          RD_BYTE(PC++)
+#define IMM16()         (PC += 2, RD_WORD(PC - 2))
+
+#define COND(c) \
+    (((c) & 1) ? LANE_COND_FLAG(c) : !LANE_COND_FLAG(c))
+#define LANE_COND_FLAG(c) \
+    TST((c) < 2 ? Z_FLAG : (c) < 4 ? C_FLAG : (c) < 6 ? P_FLAG : S_FLAG)
+
+#define STORE_FLAGS()
+#define RETRIEVE_FLAGS()    (F = (F | F_UN1) & ~(F_UN3 | F_UN5))
+
+// Never reached: the lanes stop before these instructions.
+#define IO_OUT(port, value)
+#define IO_IN(reg, port)
+#define HLT()
+#define EI()
+#define DI()
+
+#ifdef __GNUC__
+#define OP(code) \
+    } goto done; op_##code: \
+    for (i = 0; i < lanes->count; ++i) if (active[i]) {
+#else
+#define OP(code) \
+    } break; case code: \
+    for (i = 0; i < lanes->count; ++i) if (active[i]) {
+#endif
+
+#define DONE(n)         { lanes->cycles[i] += (n); continue; }
+
+// Executes `opcode` in the lanes marked in `active`.
+static void i8080_lanes_execute(struct i8080_lanes *lanes, int opcode,
+                                const uns8 *active) {
+    uns32 work32;
+    uns16 work16;
+    uns8 work8;
+#ifndef I8080_LAZY_FLAGS
+    int index;
+#endif
+    uns8 carry, add;
+    int i;
+#ifdef __GNUC__
+    static const void* const dispatch[256] = { OP_TABLE };
+
+    goto *dispatch[opcode];
+    {
+#include "i8080_opcodes.inc"
+    }
+done:
+    return;
+#else
+    switch (opcode) {
+    {
+#include "i8080_opcodes.inc"
+    }
+    }
+#endif
+}
+
+#undef OP
+#undef DONE
+#undef IMM8
+#undef IMM16
+#undef LANE_COND_FLAG
+
+#ifndef I8080_LANES_SCALAR
+#if defined(__AVX2__) && I8080_LANES >= 16
+#define LANES_VEC           16
+#elif defined(__SSE2__) && I8080_LANES >= 8
+#define LANES_VEC           8
+#endif
+#endif
+
+#ifdef LANES_VEC
+
+// The SIMD kernels of the register moves and the arithmetic and logical
+// instructions on registers, the bulk of most programs. A vector holds the
+// same register pair of LANES_VEC lanes, the result is blended into the
+// active lanes, and the flags are computed by arithmetic instead of the
+// tables: H is bit 4 of a ^ val ^ res (inverted for a subtraction), and P
+// the inverted parity folded down to bit 0. The lanes left over at the end
+// go through the loop above, as well as all of them in the builds without
+// SSE2 or with I8080_LANES_SCALAR.
+
+#if LANES_VEC == 16
+typedef __m256i lanes_vec;
+#define VLOAD(p)            _mm256_loadu_si256((const __m256i *)(p))
+#define VSTORE(p, v)        _mm256_storeu_si256((__m256i *)(p), v)
+#define VSET(n)             _mm256_set1_epi16(n)
+#define VAND(a, b)          _mm256_and_si256(a, b)
+#define VANDNOT(a, b)       _mm256_andnot_si256(a, b)
+#define VOR(a, b)           _mm256_or_si256(a, b)
+#define VXOR(a, b)          _mm256_xor_si256(a, b)
+#define VADD(a, b)          _mm256_add_epi16(a, b)
+#define VSUB(a, b)          _mm256_sub_epi16(a, b)
+#define VSRL(a, n)          _mm256_srli_epi16(a, n)
+#define VSLL(a, n)          _mm256_slli_epi16(a, n)
+#define VEQ(a, b)           _mm256_cmpeq_epi16(a, b)
+#define VMASK(p) _mm256_cmpgt_epi16( \
+    _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(p))), VSET(0))
+#else
+typedef __m128i lanes_vec;
+#define VLOAD(p)            _mm_loadu_si128((const __m128i *)(p))
+#define VSTORE(p, v)        _mm_storeu_si128((__m128i *)(p), v)
+#define VSET(n)             _mm_set1_epi16(n)
+#define VAND(a, b)          _mm_and_si128(a, b)
+#define VANDNOT(a, b)       _mm_andnot_si128(a, b)
+#define VOR(a, b)           _mm_or_si128(a, b)
+#define VXOR(a, b)          _mm_xor_si128(a, b)
+#define VADD(a, b)          _mm_add_epi16(a, b)
+#define VSUB(a, b)          _mm_sub_epi16(a, b)
+#define VSRL(a, n)          _mm_srli_epi16(a, n)
+#define VSLL(a, n)          _mm_slli_epi16(a, n)
+#define VEQ(a, b)           _mm_cmpeq_epi16(a, b)
+#define VMASK(p) _mm_cmpgt_epi16(_mm_unpacklo_epi8( \
+    _mm_loadl_epi64((const __m128i *)(p)), VSET(0)), VSET(0))
+#endif
+
+// The register pair holding register `r` (as in the opcodes, 6 is M).
+static reg_pair *i8080_lanes_pair(struct i8080_lanes *lanes, int r) {
+    switch (r >> 1) {
+    case 0:
+        return lanes->bc;
+    case 1:
+        return lanes->de;
+    case 2:
+        return lanes->hl;
+    default:
+        return lanes->af;
+    }
+}
+
+// Executes `opcode` in the lanes marked in `active` if it has a kernel.
+// Returns 0 if it has not.
+static int i8080_lanes_simd(struct i8080_lanes *lanes, int opcode,
+                            const uns8 *active) {
+    int const dst = (opcode >> 3) & 7, src = opcode & 7;
+    int const alu = opcode >= 0x80;
+    int const src_high = src == 7 || !(src & 1);
+    int const dst_high = dst == 7 || !(dst & 1);
+    reg_pair* const sp = i8080_lanes_pair(lanes, src);
+    reg_pair* const dp = i8080_lanes_pair(lanes, dst);
+    uns8 rest[I8080_LANES];
+    int i, done;
+
+    if (opcode < 0x40 || opcode >= 0xC0 || src == 6 || (!alu && dst == 6))
+        return 0;
+
+    for (i = 0; i + LANES_VEC <= lanes->count; i += LANES_VEC) {
+        lanes_vec const mask = VMASK(active + i);
+        lanes_vec const byte = VSET(0xff);
+        lanes_vec const pair = VLOAD(&sp[i].w);
+        lanes_vec const val = src_high ? VSRL(pair, 8) : VAND(pair, byte);
+        lanes_vec old, now;
+        if (alu) {
+            lanes_vec a, carry, res, h, c, r, x, f;
+            old = VLOAD(&lanes->af[i].w);
+            a = VSRL(old, 8);
+            carry = VAND(old, VSET(F_CARRY));
+            switch (dst) {
+            case 0:     // add
+                res = VADD(a, val);
+                break;
+            case 1:     // adc
+                res = VADD(VADD(a, val), carry);
+                break;
+            case 2:     // sub
+            case 7:     // cmp
+                res = VSUB(a, val);
+                break;
+            case 3:     // sbb
+                res = VSUB(VSUB(a, val), carry);
+                break;
+            case 4:     // ana
+                res = VAND(a, val);
+                break;
+            case 5:     // xra
+                res = VXOR(a, val);
+                break;
+            default:    // ora
+                res = VOR(a, val);
+                break;
+            }
+            if (dst < 2) {
+                h = VAND(VXOR(VXOR(a, val), res), VSET(F_HCARRY));
+                c = VAND(VSRL(res, 8), VSET(F_CARRY));
+            } else if (dst < 4 || dst == 7) {
+                h = VANDNOT(VXOR(VXOR(a, val), res), VSET(F_HCARRY));
+                c = VAND(VSRL(res, 8), VSET(F_CARRY));
+            } else {
+                h = dst == 4 ? VAND(VSLL(VOR(a, val), 1), VSET(F_HCARRY)) :
+                    VSET(0);
+                c = VSET(0);
+            }
+            r = VAND(res, byte);
+            x = VXOR(r, VSRL(r, 4));
+            x = VXOR(x, VSRL(x, 2));
+            x = VXOR(x, VSRL(x, 1));
+            f = VOR(VOR(VSET(F_UN1), VAND(r, VSET(F_NEG))),
+                VOR(VAND(VEQ(r, VSET(0)), VSET(F_ZERO)),
+                    VSLL(VANDNOT(x, VSET(1)), 2)));
+            f = VOR(f, VOR(h, c));
+            now = VOR(VSLL(dst == 7 ? a : r, 8), f);
+            VSTORE(&lanes->af[i].w,
+                VOR(VAND(mask, now), VANDNOT(mask, old)));
+        } else {
+            old = VLOAD(&dp[i].w);
+            now = dst_high ? VOR(VAND(old, byte), VSLL(val, 8)) :
+                VOR(VANDNOT(byte, old), val);
+            VSTORE(&dp[i].w, VOR(VAND(mask, now), VANDNOT(mask, old)));
+        }
+    }
+
+    done = i;
+    for (i = 0; i < done; ++i)
+        lanes->cycles[i] += active[i] ? (alu ? 4 : 5) : 0;
+    if (done < lanes->count) {
+        memset(rest, 0, done);
+        memcpy(rest + done, active + done, lanes->count - done);
+        i8080_lanes_execute(lanes, opcode, rest);
+    }
+    return 1;
+}
+
+#undef LANES_VEC
+#undef VLOAD
+#undef VSTORE
+#undef VSET
+#undef VAND
+#undef VANDNOT
+#undef VOR
+#undef VXOR
+#undef VADD
+#undef VSUB
+#undef VSRL
+#undef VSLL
+#undef VEQ
+#undef VMASK
+
+#else
+
+static int i8080_lanes_simd(struct i8080_lanes *lanes, int opcode,
+                            const uns8 *active) {
+    (void)lanes;
+    (void)opcode;
+    (void)active;
+    return 0;
+}
+
+#endif
+
+int i8080_lanes_run(struct i8080_lanes *lanes, int cycles) {
+    uns64 end[I8080_LANES];
+    uns8 active[I8080_LANES];
+    int i, stopped;
+
+    for (i = 0; i < lanes->count; ++i)
+        end[i] = lanes->cycles[i] + cycles;
+
+    for (;;) {
+        int lead = -1, opcode, reason;
+        uns16 pc = 0;
+
+        // The lowest PC among the running lanes leads.
+        for (i = 0; i < lanes->count; ++i) {
+            if (lanes->stop_reason[i] || lanes->cycles[i] >= end[i])
+                continue;
+            if (lead < 0 || PC < pc) {
+                lead = i;
+                pc = PC;
+            }
+        }
+        if (lead < 0)
+            break;
+
+        opcode = lanes->memory[lead][pc];
+        for (i = 0; i < lanes->count; ++i) {
+            active[i] = !lanes->stop_reason[i] && lanes->cycles[i] < end[i] &&
+                PC == pc && RD_BYTE(pc) == opcode;
+        }
+
+        switch (opcode) {
+            case 0x76:
+                reason = I8080_STOP_HLT;
+                break;
+            case 0xD3: case 0xDB: case 0xF3: case 0xFB:
+                reason = I8080_STOP_IO;
+                break;
+            default:
+                reason = 0;
+        }
+        if (reason) {
+            for (i = 0; i < lanes->count; ++i)
+                if (active[i])
+                    lanes->stop_reason[i] = reason;
+            continue;
+        }
+
+        for (i = 0; i < lanes->count; ++i)
+            PC += active[i];
+        if (!i8080_lanes_simd(lanes, opcode, active))
+            i8080_lanes_execute(lanes, opcode, active);
+
+        if (lanes->traps) {
+            for (i = 0; i < lanes->count; ++i)
+                if (active[i] && I8080_ADDR_TST(lanes->traps, PC))
+                    lanes->stop_reason[i] = I8080_STOP_TRAP;
+        }
+    }
+
+    stopped = 0;
+    for (i = 0; i < lanes->count; ++i)
+        stopped += lanes->stop_reason[i] != 0;
+    return stopped;
+}
+
+#endif
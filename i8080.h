@@ -34,23 +34,794 @@
 #ifndef I8080_H
 #define I8080_H
 
-extern void i8080_init(void);
-extern int i8080_instruction(void);
-
-extern void i8080_jump(int addr);
-extern int i8080_pc(void);
-
-extern int i8080_regs_bc(void);
-extern int i8080_regs_de(void);
-extern int i8080_regs_hl(void);
-extern int i8080_regs_sp(void);
-
-extern int i8080_regs_a(void);
-extern int i8080_regs_b(void);
-extern int i8080_regs_c(void);
-extern int i8080_regs_d(void);
-extern int i8080_regs_e(void);
-extern int i8080_regs_h(void);
-extern int i8080_regs_l(void);
+typedef unsigned char           uns8;
+typedef unsigned short          uns16;
+typedef unsigned long int       uns32;
+typedef signed char             sgn8;
+typedef signed short            sgn16;
+typedef signed long int         sgn32;
+#ifdef _MSC_VER
+typedef unsigned __int64        uns64;
+#else
+typedef unsigned long long      uns64;
+#endif
+
+typedef union {
+    struct {
+        uns8 l, h;
+    } b;
+    uns16 w;
+} reg_pair;
+
+typedef struct {
+    uns8 carry_flag;
+    uns8 unused1;
+    uns8 parity_flag;
+    uns8 unused3;
+    uns8 half_carry_flag;
+    uns8 unused5;
+    uns8 zero_flag;
+    uns8 sign_flag;
+} flag_reg;
+
+// The number of slots for events scheduled by `i8080_schedule()`. Zero
+// compiles the scheduler out.
+#ifndef I8080_EVENTS
+#define I8080_EVENTS 4
+#endif
+
+#define I8080_NEVER             (~(uns64)0)
+
+#ifdef I8080_IDLE
+// The longest loop in bytes which `i8080_run()` skips ahead in time, and
+// the cycles it runs before looking for a loop again after one it could not
+// skip.
+#define I8080_IDLE_SIZE         16
+#ifndef I8080_IDLE_RETRY
+#define I8080_IDLE_RETRY        4096
+#endif
+#endif
+
+// The number of lanes of the lockstep engine (see `i8080_lanes_run()`).
+// Zero compiles it out. The lanes keep the flags packed in F.
+#ifndef I8080_LANES
+#define I8080_LANES 0
+#endif
+
+#if I8080_LANES > 0
+#ifdef I8080_LAZY_FLAGS
+#error "I8080_LANES cannot be combined with I8080_LAZY_FLAGS"
+#endif
+#ifndef I8080_PACKED_FLAGS
+#define I8080_PACKED_FLAGS
+#endif
+#endif
+
+// The Intel 8085: its timings, RIM and SIM, the undocumented instructions
+// and the V and K flags, the interrupt lines TRAP and RST 5.5-7.5 (see
+// `i8080_line()`) and the serial lines. The instruction bodies are
+// specialised at compile time, so the 8080 build is not affected. Only the
+// flat decoder and the block cache (without the JIT) have them, with the
+// plain (not packed, not lazy) flags.
+#ifdef I8080_8085
+#if defined(I8080_JIT) || I8080_LANES > 0 || \
+    defined(I8080_PACKED_FLAGS) || defined(I8080_LAZY_FLAGS)
+#error "I8080_8085 cannot be combined with I8080_JIT, I8080_LANES, I8080_PACKED_FLAGS or I8080_LAZY_FLAGS"
+#endif
+#ifndef I8080_FLAT_DISPATCH
+#define I8080_FLAT_DISPATCH
+#endif
+#endif
+
+// The snapshots share the memory pages by copy-on-write through the page
+// table.
+#if defined(I8080_SNAPSHOT) && !defined(I8080_PAGE_TABLE)
+#define I8080_PAGE_TABLE
+#endif
+
+#ifdef I8080_SNAPSHOT
+// A page of memory shared by the CPUs and snapshots holding a reference.
+struct i8080_page {
+    int refs;
+    uns8 data[256];
+};
+#endif
+
+struct i8080;
+
+typedef void (*i8080_event_handler)(struct i8080 *cpu, void *data);
+typedef int (*i8080_trap_handler)(struct i8080 *cpu, void *data);
+
+struct i8080_event {
+    uns64 when;
+    i8080_event_handler handler;
+    void *data;
+};
+
+// The JIT compiles the hot blocks of the block cache into x86-64 code;
+// there is no backend for other hosts.
+#ifdef I8080_JIT
+#if !defined(__GNUC__) || !defined(__x86_64__)
+#error "I8080_JIT needs GNU C on x86-64"
+#endif
+#ifndef I8080_BLOCK_CACHE
+#define I8080_BLOCK_CACHE
+#endif
+#endif
+
+#ifdef I8080_BLOCK_CACHE
+
+// The number of blocks in the block cache (a power of two), and the maximum
+// number of instructions in a block.
+#ifndef I8080_BLOCKS
+#define I8080_BLOCKS 256
+#endif
+#define I8080_BLOCK_OPS 16
+
+// The granularity of the invalidation of the cache on writes. A block never
+// spans more than two lines.
+#define I8080_BLOCK_LINE_SIZE   64
+#define I8080_BLOCK_LINES       (0x10000 / I8080_BLOCK_LINE_SIZE)
+#define I8080_BLOCK_LINE(addr)  (((addr) & 0xffff) / I8080_BLOCK_LINE_SIZE)
+
+struct i8080_block_op {
+#ifdef __GNUC__
+    const void *handler;
+#endif
+    uns16 pc, next_pc;
+    uns16 imm;
+    uns8 opcode;
+    // The number, counted from 1, of the instruction of the block up to
+    // this one whose S, Z, H and P flags are yet to be computed, or 0.
+    uns8 deferred;
+};
+
+struct i8080_block {
+    uns16 pc;
+    uns16 last_line;
+    uns8 count;
+    uns32 gen[2];
+#ifdef I8080_JIT
+    uns32 hits;
+    int (*native)(struct i8080 *cpu);
+#endif
+    struct i8080_block_op op[I8080_BLOCK_OPS];
+};
+
+#ifdef I8080_JIT
+// A block is compiled after this many executions. The native code of all
+// blocks of a CPU lives in a buffer of I8080_JIT_SIZE bytes, which is
+// flushed when it fills up.
+#ifndef I8080_JIT_THRESHOLD
+#define I8080_JIT_THRESHOLD 16
+#endif
+#ifndef I8080_JIT_SIZE
+#define I8080_JIT_SIZE 0x100000
+#endif
+#endif
+
+struct i8080_blocks {
+    uns8 code[0x10000 / 8];     // One bit per address, see I8080_ADDR_SET()
+    uns32 gen[I8080_BLOCK_LINES];
+    struct i8080_block block[I8080_BLOCKS];
+#ifdef I8080_JIT
+    uns8 *jit;
+    uns32 jit_used;
+#endif
+};
+
+#endif
+
+#ifdef I8080_TRACE
+// One executed instruction: its address, opcode and operand bytes (zero if
+// the instruction is shorter), A and F before it, and its clock cycles.
+// The instructions from the bus in an interrupt acknowledge have
+// I8080_TRACE_IRQ set in `cycles`.
+struct i8080_trace_record {
+    uns16 pc;
+    uns8 opcode;
+    uns8 operand[2];
+    uns8 a, f;
+    uns8 cycles;
+};
+
+#define I8080_TRACE_IRQ 0x80
+
+// The trace buffer of a CPU. The core appends a record per instruction
+// and calls `flush` when all `size` records are taken. The callback must
+// leave the buffer with free space, either by consuming the records or by
+// handing them over and setting `record` to another buffer.
+struct i8080_trace {
+    struct i8080_trace_record *record;
+    int size;
+    int count;
+    void (*flush)(struct i8080 *cpu, struct i8080_trace *trace);
+    void *data;
+};
+#endif
+
+#ifdef I8080_MEMSTATS
+// The accesses to every 256-byte page since `i8080_memstats_attach()`.
+// The fetches count the instructions, and the reads include the bytes of
+// their operands. A write into a page which instructions have been fetched
+// from is counted as self-modifying code, and the last one is kept with
+// the address of its instruction.
+struct i8080_memstats {
+    uns32 reads[256];
+    uns32 writes[256];
+    uns32 fetches[256];
+    uns32 code_writes[256];
+    uns16 code_write_addr, code_write_pc;
+};
+#endif
+
+#ifdef I8080_PROFILE
+// The number of nodes of the call tree of the profile.
+#ifndef I8080_PROFILE_NODES
+#define I8080_PROFILE_NODES 4096
+#endif
+
+// A routine in the call tree: its entry address, the caller, the first
+// callee and the next callee of the caller, how many times it was entered
+// from the caller, and the cycles spent in it, not counting the callees.
+struct i8080_profile_node {
+    uns16 addr;
+    int parent, child, sibling;
+    uns32 calls;
+    uns64 cycles;
+};
+
+// What the profiler has counted since `i8080_profile_attach()`. The call
+// tree is rebuilt from the calls and returns, starting at the routine
+// running at the attach; the calls deeper than its nodes can hold are
+// counted in their callers.
+struct i8080_profile {
+    uns32 pc_count[0x10000];    // Executions per instruction address.
+    uns32 opcode_count[256];
+    uns64 opcode_cycles[256];
+    uns32 reads[256];           // Memory accesses per 256-byte page.
+    uns32 writes[256];
+    struct i8080_profile_node node[I8080_PROFILE_NODES];
+    int nodes;
+    int current;                // The node of the running routine.
+    int lost;                   // The depth of the calls without a node.
+};
+#endif
+
+#ifdef I8080_BUS
+// The machine cycles reported to the bus handler.
+#define I8080_BUS_FETCH         0   // The opcode fetch (M1) at PC.
+#define I8080_BUS_INTA          1   // M1 of an interrupt, at PC.
+#define I8080_BUS_READ          2
+#define I8080_BUS_WRITE         3
+#define I8080_BUS_INPUT         4   // At the port number.
+#define I8080_BUS_OUTPUT        5
+
+// Called for every machine cycle of the instruction being executed, with
+// the address on the bus and the T-state at which the cycle starts,
+// counted from the start of the instruction at `i8080_cycles()`. Returns
+// the number of wait states to insert, which delay the later cycles and
+// add to the cycles of the instruction.
+typedef int (*i8080_bus_handler)(struct i8080 *cpu, int cycle, int addr,
+    int offset, void *data);
+#endif
+
+#ifdef I8080_IO_TABLE
+// The handlers of the I/O ports registered by `i8080_io_input()` and
+// `i8080_io_output()`, called by IN and OUT instead of the HAL.
+typedef int (*i8080_input_handler)(struct i8080 *cpu, int port, void *data);
+typedef void (*i8080_output_handler)(struct i8080 *cpu, int port, int value,
+    void *data);
+
+struct i8080_port {
+    i8080_input_handler input;
+    void *input_data;
+    i8080_output_handler output;
+    void *output_data;
+    int value;                  // See `i8080_io_constant()`, or -1.
+    uns8 echo;                  // OUT replaces `value`.
+};
+#endif
+
+#ifdef I8080_REPLAY
+#if I8080_EVENTS == 0
+#error "I8080_REPLAY needs the event scheduler (I8080_EVENTS > 0)"
+#endif
+
+#define I8080_REPLAY_OFF        0
+#define I8080_REPLAY_RECORD     1
+#define I8080_REPLAY_PLAY       2
+
+// The longest item of the log: the cycle delta and kind, port and value.
+#define I8080_REPLAY_ITEM       12
+
+// The log of the inputs and the accepted interrupts of a CPU. An item
+// holds the cycles since the previous item (at the start of the IN, or at
+// the boundary taking the interrupt) and the kind as a variable-length
+// number, then the port and the value of an input, or the opcode of an
+// interrupt. The constant ports are not logged.
+//
+// While recording, the core appends to `log` at `length`, and calls
+// `flush` when less than I8080_REPLAY_ITEM bytes of the `size` are free;
+// it must make room or the recording stops. While playing, the core reads
+// at `pos` up to `length`. When the log ends, or the guest does not
+// do what is logged (`diverged` is then set), the replay stops and the
+// devices are live again.
+struct i8080_replay {
+    uns8 *log;
+    long size;
+    long length;
+    long pos;
+    int mode;
+    int diverged;
+    uns64 last;                 // The cycles at the previous item.
+    void (*flush)(struct i8080 *cpu, struct i8080_replay *replay);
+    void *data;
+};
+#endif
+
+// The complete state of one CPU. The core keeps no other state, so any
+// number of instances can run side by side. The `hal` pointer is not
+// touched by the core: it is the HAL's own binding (memory, I/O devices)
+// for this instance, and it is set by the user before `i8080_init()`.
+// Everything else is reset by `i8080_init()`.
+struct i8080 {
+#ifndef I8080_PACKED_FLAGS
+    flag_reg f;
+#endif
+#ifdef I8080_LAZY_FLAGS
+    uns8 lazy_kind, lazy_a, lazy_val, lazy_res;
+#endif
+    reg_pair af, bc, de, hl;
+    reg_pair sp, pc;
+    uns16 iff;
+    uns16 last_pc;
+    void *hal;
+
+    // Address bitmaps (I8080_ADDR_MAP_SIZE bytes, one bit per address)
+    // checked by `i8080_run()`, or 0 if not used.
+    uns8 *breakpoints;
+    uns8 *traps;
+    int stop_reason;
+
+    // Called by `i8080_run()` when PC reaches a trap, or 0. The handler
+    // returns non-zero to stop there, or zero to go on from PC, which it
+    // may have changed.
+    i8080_trap_handler trap_handler;
+    void *trap_data;
+
+    // The number of clock cycles (T-states) executed since `i8080_init()`.
+    uns64 cycles;
+
+    // The requested interrupt (see `i8080_irq()`), the internal bits of
+    // what is pending at the next instruction boundary, and whether the CPU
+    // is halted by HLT.
+    int irq;
+    uns8 pending;
+    uns8 halted;
+
+#ifdef I8080_8085
+    // The levels of the I8080_LINE_xxx inputs, the RST 7.5 and TRAP
+    // requests latched on their rising edges, the RST 5.5-7.5 masks (the
+    // low bits of SIM), the SOD output, and IE before the last TRAP plus
+    // one, or 0.
+    uns8 lines;
+    uns8 latched;
+    uns8 masks;
+    uns8 sod;
+    uns8 trap_ie;
+#endif
+
+#ifdef I8080_BLOCK_CACHE
+    // The block cache used by `i8080_run()`, or 0, and the cycle count at
+    // which the current block must stop.
+    struct i8080_blocks *blocks;
+    uns64 block_limit;
+    // The operands and the result of the instruction whose flags are
+    // yet to be computed, see `struct i8080_block_op`.
+    uns8 dead_a, dead_val, dead_res;
+#endif
+
+#if I8080_EVENTS > 0
+    // The pending events sorted by time, and the time of the first one.
+    struct i8080_event event[I8080_EVENTS];
+    int events;
+    uns64 next_event;
+#endif
+
+#ifdef I8080_PAGE_TABLE
+    // The host memory of every 256-byte page and its I8080_PAGE_xxx flags.
+    uns8 *page[256];
+    uns8 page_flags[256];
+
+    // The watchpoint bitmaps, see `i8080_watch()`, and the last hit: its
+    // address and I8080_WATCH_READ or I8080_WATCH_WRITE.
+    uns8 *watch_read;
+    uns8 *watch_write;
+    uns16 watch_addr;
+    uns8 watch_access;
+#endif
+
+#ifdef I8080_SNAPSHOT
+    // The copy-on-write pages mapped by `i8080_snapshot_map()`, or 0.
+    struct i8080_page *cow[256];
+#endif
+#ifdef I8080_IO_TABLE
+    // The I/O ports, see `i8080_io_input()`.
+    struct i8080_port port[256];
+#endif
+
+#ifdef I8080_BUS
+    // The bus handler, or 0, see `i8080_bus_attach()`, and the T-state of
+    // the next machine cycle and the wait states of the instruction.
+    i8080_bus_handler bus_handler;
+    void *bus_data;
+    int bus_offset;
+    int bus_waits;
+#endif
+
+#ifdef I8080_MEMSTATS
+    // The statistics being counted, or 0.
+    struct i8080_memstats *memstats;
+#endif
+
+#ifdef I8080_PROFILE
+    // The profile being counted, or 0. `i8080_run()` does not use the
+    // block cache while profiling.
+    struct i8080_profile *profile;
+#endif
+
+#ifdef I8080_REPLAY
+    // The log being recorded or played, or 0.
+    struct i8080_replay *replay;
+#endif
+
+#ifdef I8080_TRACE
+    // The trace buffer, or 0 if the CPU is not traced. `i8080_run()` does
+    // not use the block cache while tracing.
+    struct i8080_trace *trace;
+#endif
+
+#ifdef I8080_IDLE
+    // The cycle count before which `i8080_run()` does not look for an idle
+    // loop.
+    uns64 idle_retry;
+#endif
+};
+
+// Why `i8080_run()` returned. The non-zero values are also the bits of
+// its `stop_mask` argument.
+#define I8080_STOP_BUDGET       0x00
+#define I8080_STOP_HLT          0x01
+#define I8080_STOP_BREAKPOINT   0x02
+#define I8080_STOP_TRAP         0x04
+#define I8080_STOP_IO           0x08    // Lanes only, see below.
+#define I8080_STOP_WATCHPOINT   0x10    // I8080_PAGE_TABLE only.
+
+#define I8080_ADDR_MAP_SIZE     0x2000
+#define I8080_ADDR_SET(map, addr) \
+    ((map)[((addr) & 0xffff) >> 3] |= (uns8)(1 << ((addr) & 7)))
+#define I8080_ADDR_CLR(map, addr) \
+    ((map)[((addr) & 0xffff) >> 3] &= (uns8)~(1 << ((addr) & 7)))
+#define I8080_ADDR_TST(map, addr) \
+    ((map)[((addr) & 0xffff) >> 3] & (1 << ((addr) & 7)))
+
+extern void i8080_init(struct i8080 *cpu);
+// Executes one instruction and returns the number of its cycles.
+extern int i8080_instruction(struct i8080 *cpu);
+#ifdef I8080_IO_TABLE
+// Makes IN (OUT) of `port` call `handler` with `data` instead of the HAL,
+// or go to the HAL again if `handler` is 0.
+extern void i8080_io_input(struct i8080 *cpu, int port,
+    i8080_input_handler handler, void *data);
+extern void i8080_io_output(struct i8080 *cpu, int port,
+    i8080_output_handler handler, void *data);
+
+// Makes `port` constant: IN reads `value` without calling anything. OUT
+// goes to the handler or the HAL as usual and leaves the value alone, as
+// the status register read and the command register written at one port
+// are different registers; with I8080_PORT_ECHO in `value`, OUT replaces
+// the value (a latch reading back what was written). A negative `value`
+// makes the port normal again. Reading a constant port does not end a
+// block of the block cache.
+#define I8080_PORT_ECHO         0x100
+extern void i8080_io_constant(struct i8080 *cpu, int port, int value);
+#endif
+
+#ifdef I8080_BUS
+// Reports the machine cycles of the CPU to `handler` with `data`, so the
+// fetches and accesses to memory and I/O contended by video DMA and the
+// wait states can be timed, or stops if `handler` is 0. `i8080_run()`
+// interprets the instructions one by one while it is set, not using the
+// block cache or the JIT. The lanes do not report.
+extern void i8080_bus_attach(struct i8080 *cpu, i8080_bus_handler handler,
+    void *data);
+#endif
+
+#ifdef I8080_REPLAY
+// Starts recording or playing `replay` in its `mode` from the current
+// cycle count, or stops if it is 0. While playing, IN of a non-constant
+// port returns the logged value without calling the handler or the HAL,
+// and the logged interrupts are requested at their cycles, so the device
+// models need not run at all; OUT still goes to them. The accesses to
+// memory-mapped devices are not logged. A recording started right after
+// `i8080_snapshot_take()` replays after `i8080_snapshot_restore()`.
+extern void i8080_replay_attach(struct i8080 *cpu,
+    struct i8080_replay *replay);
+#endif
+
+#ifdef I8080_MEMSTATS
+// Resets `stats` and starts counting the accesses of the CPU into it, or
+// stops counting if it is 0. The accesses of the host are not counted.
+extern void i8080_memstats_attach(struct i8080 *cpu,
+    struct i8080_memstats *stats);
+#endif
+
+#ifdef I8080_PROFILE
+// Resets `profile` and starts counting into it, or stops profiling if it
+// is 0.
+extern void i8080_profile_attach(struct i8080 *cpu,
+    struct i8080_profile *profile);
+#endif
+
+// The flags of F read or written by an instruction.
+#define I8080_FLAG_S            0x80
+#define I8080_FLAG_Z            0x40
+#define I8080_FLAG_H            0x10
+#define I8080_FLAG_P            0x04
+#define I8080_FLAG_C            0x01
+
+// What an instruction does beyond the registers.
+#define I8080_OP_READ           0x01    // Reads memory (not its operands).
+#define I8080_OP_WRITE          0x02    // Writes memory.
+#define I8080_OP_IO             0x04    // IN or OUT.
+#define I8080_OP_JUMP           0x08    // May change PC.
+#define I8080_OP_CALL           0x10    // Pushes the return address.
+#define I8080_OP_RET            0x20    // Pops PC.
+#define I8080_OP_COND           0x40    // Jumps on a condition.
+#define I8080_OP_SYSTEM         0x80    // HLT, EI or DI.
+
+// The metadata of an opcode. The mnemonic has `$` for a byte operand and
+// `#` for a word one. The cycles are those of the CPU built for (8080 or
+// 8085), `cycles_taken` when the condition holds and `cycles` otherwise,
+// and the same for the unconditional instructions. The flags are the
+// I8080_FLAG_xxx, and `kind` the I8080_OP_xxx.
+struct i8080_opcode_info {
+    const char *mnemonic;
+    uns8 length;
+    uns8 cycles;
+    uns8 cycles_taken;
+    uns8 flags_read;
+    uns8 flags_written;
+    uns8 kind;
+};
+
+extern const struct i8080_opcode_info i8080_opcodes[256];
+
+// Returns the length of the instruction `opcode` in bytes.
+extern int i8080_opcode_length(int opcode);
+
+// Writes the mnemonic of the instruction in `bytes` (the opcode and as
+// many operand bytes as its length) with the operands in hex into `text`,
+// of at least I8080_DISASM_SIZE characters, and returns its length.
+#define I8080_DISASM_SIZE       16
+extern int i8080_disassemble(const uns8 *bytes, char *text);
+
+// Requests an interrupt: the single-byte instruction `opcode`, normally
+// RST n (see I8080_RST()), is executed at the first instruction boundary
+// when the interrupts are enabled, and the interrupts get disabled. The
+// request is latched until it is accepted or withdrawn by a negative
+// `opcode`. A halted CPU resumes after the HLT.
+extern void i8080_irq(struct i8080 *cpu, int opcode);
+extern int i8080_halted(struct i8080 *cpu);
+
+#define I8080_RST(n)            (0xC7 | (((n) & 7) << 3))
+
+#ifdef I8080_8085
+// The input lines of the 8085 in the bits of RIM.
+#define I8080_LINE_RST55        0x10
+#define I8080_LINE_RST65        0x20
+#define I8080_LINE_RST75        0x40
+#define I8080_LINE_SID          0x80
+#define I8080_LINE_TRAP         0x08
+
+// Sets the level of an input line. TRAP (to 0024, not maskable) and RST
+// 7.5 (to 003C) are latched on the rising edge, RST 6.5 (to 0034) and 5.5
+// (to 002C) are requested while high. They are taken at an instruction
+// boundary in this order and before the request of `i8080_irq()`, the
+// maskable ones when the interrupts are enabled and their masks set by SIM
+// are clear.
+extern void i8080_line(struct i8080 *cpu, int line, int level);
+
+// The serial output, set by SIM.
+extern int i8080_sod(struct i8080 *cpu);
+#endif
+
+#ifdef I8080_BLOCK_CACHE
+
+// Attaches a block cache to the CPU (0 detaches it), after which
+// `i8080_run()` executes cached blocks of predecoded instructions. The
+// cache is big, so it is allocated by the user, one per CPU. The writes
+// made by the CPU keep the cache coherent, but the memory changed from
+// outside (loaders, DMA), as well as changed breakpoints or traps, must be
+// reported by `i8080_blocks_invalidate()`.
+//
+// With I8080_JIT the attach also allocates memory for the native code, and
+// detaching releases it. The memory is writable or executable, never both
+// (W^X). If the allocation or a switch between the two fails, the cache
+// still works without the JIT.
+extern void i8080_blocks_attach(struct i8080 *cpu, struct i8080_blocks *blocks);
+extern void i8080_blocks_invalidate(struct i8080 *cpu, int addr, int size);
+
+#endif
+
+// Executes instructions until at least `cycles` cycles are spent, or until
+// one of the conditions in `stop_mask` is met: HLT has been executed (PC is
+// left at the HLT), or PC has reached an address marked in `breakpoints` or
+// `traps` (the instruction there is not executed yet). The address of the
+// first instruction is not checked, so calling it again resumes from a
+// breakpoint or trap. Returns the number of spent cycles, and the reason is
+// left in `stop_reason`. A halted CPU does not execute instructions: the
+// cycle counter jumps to the next scheduled event or the end of the budget.
+extern int i8080_run(struct i8080 *cpu, int cycles, int stop_mask);
+
+#if I8080_EVENTS > 0
+
+// Schedules a call of `handler` at the first instruction boundary when the
+// cycle counter reaches `when`. The handler may schedule further events.
+// Returns -1 if all I8080_EVENTS slots are taken.
+extern int i8080_schedule(struct i8080 *cpu, uns64 when,
+    i8080_event_handler handler, void *data);
+
+// Removes all pending events with the given handler and data.
+extern void i8080_cancel(struct i8080 *cpu, i8080_event_handler handler,
+    void *data);
+
+#endif
+
+#ifdef I8080_PAGE_TABLE
+
+#define I8080_PAGE_READ         0x01
+#define I8080_PAGE_WRITE        0x02
+#define I8080_PAGE_COW          0x04    // Set by the core, see below.
+#define I8080_PAGE_WATCH        0x08    // Set by the core, see below.
+
+// Maps the guest pages covering `size` bytes from `addr` to the host memory
+// at `host`. The core reads (writes) a page directly if it has
+// I8080_PAGE_READ (I8080_PAGE_WRITE), and goes to the HAL otherwise, so RAM
+// is mapped with both flags, ROM with I8080_PAGE_READ, and memory-mapped
+// devices with none. After `i8080_init()` all memory goes to the HAL.
+extern void i8080_map(struct i8080 *cpu, int addr, int size, uns8 *host,
+    int flags);
+
+#define I8080_WATCH_READ        0x01
+#define I8080_WATCH_WRITE       0x02
+
+// Sets the address bitmaps of the read and write watchpoints (either may be
+// 0), and must be called again after their bits change. Only the pages
+// having a watched byte get I8080_PAGE_WATCH and leave the fast path of
+// the page table, so the other pages cost nothing. An access to a watched
+// byte is recorded in `watch_addr` and `watch_access`, and `i8080_run()`
+// with I8080_STOP_WATCHPOINT stops at the end of the instruction. The
+// instruction fetches are reads as well; the code of watched pages is
+// interpreted, not cached. `i8080_peek()` and `i8080_poke()` do not hit
+// watchpoints.
+extern void i8080_watch(struct i8080 *cpu, uns8 *read, uns8 *write);
+
+#endif
+
+// The state of a CPU apart from its memory and the bindings (HAL, bitmaps,
+// events, caches). F holds the flags as PUSH PSW would store them.
+struct i8080_state {
+    uns16 af, bc, de, hl, sp, pc;
+    uns16 iff, last_pc;
+    int irq;
+    uns8 pending, halted;
+    uns64 cycles;
+#ifdef I8080_8085
+    uns8 lines, latched, masks, sod, trap_ie;
+#endif
+};
+
+extern void i8080_save(struct i8080 *cpu, struct i8080_state *state);
+extern void i8080_restore(struct i8080 *cpu, const struct i8080_state *state);
+
+#ifdef I8080_SNAPSHOT
+
+// A snapshot of the state and of the copy-on-write memory of a CPU.
+struct i8080_snapshot {
+    struct i8080_state state;
+    struct i8080_page *page[256];
+};
+
+// Maps the pages covering `size` bytes from `addr` as copy-on-write RAM,
+// filled from `data` (or zeroed if it is 0). Returns -1 if the pages
+// cannot be allocated. `i8080_snapshot_unmap()` releases all such pages
+// of the CPU, and `i8080_map()` the pages it remaps.
+extern int i8080_snapshot_map(struct i8080 *cpu, int addr, int size,
+    const uns8 *data);
+extern void i8080_snapshot_unmap(struct i8080 *cpu);
+
+// Takes a snapshot of the CPU. The memory is not copied: the snapshot and
+// the CPU share the pages, and the first write into a shared page gives
+// the writer its own copy. So taking a snapshot, restoring it (into the
+// same or another CPU, forking it) costs 256 page table entries, and the
+// execution afterwards copies only the pages it writes. The references
+// are not atomic, so the CPUs sharing pages must run in one thread. If a
+// page cannot be allocated at a write, the write goes to the HAL.
+extern void i8080_snapshot_take(struct i8080 *cpu,
+    struct i8080_snapshot *snapshot);
+extern void i8080_snapshot_restore(struct i8080 *cpu,
+    const struct i8080_snapshot *snapshot);
+extern void i8080_snapshot_release(struct i8080_snapshot *snapshot);
+
+#endif
+
+#if I8080_LANES > 0
+
+// Up to I8080_LANES copies of a machine executed in lockstep. The registers
+// are laid out as arrays (structure of arrays), so one instruction is
+// executed for all lanes at once, by SIMD kernels for the most common
+// register instructions (see I8080_LANES_SCALAR) and a loop otherwise. Each
+// lane has its own flat 64K `memory`, there is no HAL. A lane runs while
+// its `stop_reason` is zero.
+struct i8080_lanes {
+    int count;
+    reg_pair af[I8080_LANES], bc[I8080_LANES], de[I8080_LANES];
+    reg_pair hl[I8080_LANES], sp[I8080_LANES], pc[I8080_LANES];
+    uns8 iff[I8080_LANES];
+    uns64 cycles[I8080_LANES];
+    int stop_reason[I8080_LANES];
+    uns8 *memory[I8080_LANES];
+
+    // An address bitmap shared by all lanes (see `struct i8080`), or 0.
+    uns8 *traps;
+};
+
+// Resets `count` lanes as `i8080_init()` does. The memory pointers are left
+// to the user.
+extern void i8080_lanes_init(struct i8080_lanes *lanes, int count);
+
+// Executes the running lanes until each has spent at least `cycles` more
+// cycles or has stopped. At every step, the lanes with the lowest PC and
+// the same opcode there execute the instruction together, so the lanes
+// which diverge wait for each other, and reconverge when their paths join.
+// A lane stops with I8080_STOP_TRAP after reaching an address in `traps`,
+// and before HLT (I8080_STOP_HLT) or IN, OUT, EI and DI (I8080_STOP_IO),
+// which need the HAL: the user executes them with `i8080_instruction()`
+// after `i8080_lanes_get()` and puts the lane back with `i8080_lanes_put()`.
+// Returns the number of stopped lanes.
+extern int i8080_lanes_run(struct i8080_lanes *lanes, int cycles);
+
+// Copies the registers, IFF and the cycle counter of a lane into an
+// initialized context, and back. `i8080_lanes_put()` resumes the lane.
+extern void i8080_lanes_get(struct i8080_lanes *lanes, int lane,
+    struct i8080 *cpu);
+extern void i8080_lanes_put(struct i8080_lanes *lanes, int lane,
+    const struct i8080 *cpu);
+
+#endif
+
+// Reads and writes the memory as the CPU does: through the page table,
+// the HAL and the block cache.
+extern int i8080_peek(struct i8080 *cpu, int addr);
+extern void i8080_poke(struct i8080 *cpu, int addr, int byte);
+
+extern void i8080_jump(struct i8080 *cpu, int addr);
+extern int i8080_pc(struct i8080 *cpu);
+extern uns64 i8080_cycles(struct i8080 *cpu);
+
+extern int i8080_regs_bc(struct i8080 *cpu);
+extern int i8080_regs_de(struct i8080 *cpu);
+extern int i8080_regs_hl(struct i8080 *cpu);
+extern int i8080_regs_sp(struct i8080 *cpu);
+
+extern int i8080_regs_a(struct i8080 *cpu);
+extern int i8080_regs_b(struct i8080 *cpu);
+extern int i8080_regs_c(struct i8080 *cpu);
+extern int i8080_regs_d(struct i8080 *cpu);
+extern int i8080_regs_e(struct i8080 *cpu);
+extern int i8080_regs_h(struct i8080 *cpu);
+extern int i8080_regs_l(struct i8080 *cpu);
 
 #endif
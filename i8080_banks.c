@@ -0,0 +1,91 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#include "i8080_banks.h"
+
+void i8080_banks_init(struct i8080_banks *banks) {
+    int i;
+    banks->windows = 0;
+    for (i = 0; i < 256; ++i)
+        banks->port[i] = 0;
+}
+
+int i8080_banks_add(struct i8080 *cpu, struct i8080_banks *banks,
+    int addr, int size, uns8 *memory, int count, int flags) {
+    struct i8080_bank_window *window;
+    if (banks->windows == I8080_BANK_WINDOWS || count < 1 ||
+        (addr & 0xff) || (size & 0xff) || size <= 0 ||
+        addr < 0 || addr + size > 0x10000)
+        return -1;
+    window = &banks->window[banks->windows];
+    window->addr = addr;
+    window->size = size;
+    window->memory = memory;
+    window->banks = count;
+    window->flags = flags;
+    i8080_banks_select(cpu, banks, banks->windows, 0);
+    return banks->windows++;
+}
+
+void i8080_banks_select(struct i8080 *cpu, struct i8080_banks *banks,
+    int window, int bank) {
+    struct i8080_bank_window* const w = &banks->window[window];
+    w->current = bank % w->banks;
+    i8080_map(cpu, w->addr, w->size, w->memory + (long)w->current * w->size,
+        w->flags);
+}
+
+void i8080_banks_port(struct i8080_banks *banks, int port, int window) {
+    banks->port[port & 0xff] = (uns8)(window < 0 ? 0 : window + 1);
+}
+
+int i8080_banks_output(struct i8080 *cpu, struct i8080_banks *banks,
+    int port, int value) {
+    int const window = banks->port[port & 0xff];
+    if (!window)
+        return 0;
+    if (banks->window[window - 1].current !=
+        (value & 0xff) % banks->window[window - 1].banks)
+        i8080_banks_select(cpu, banks, window - 1, value & 0xff);
+    return 1;
+}
+
+#ifdef I8080_IO_TABLE
+
+void i8080_banks_handler(struct i8080 *cpu, int port, int value,
+    void *banks) {
+    i8080_banks_output(cpu, (struct i8080_banks *)banks, port, value);
+}
+
+#endif
@@ -0,0 +1,110 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifndef I8080_BANKS_H
+#define I8080_BANKS_H
+
+#include "i8080.h"
+
+#ifndef I8080_PAGE_TABLE
+#error "The bank switching needs the core built with I8080_PAGE_TABLE"
+#endif
+
+// Bank switched memory. A window is a range of whole pages of the address
+// space showing one of several banks of host memory at a time. Switching
+// the bank only points the pages of the window to the other bank in the
+// page table, so nothing is copied. The blocks cached from the window are
+// invalidated by `i8080_map()`.
+//
+// The windows are switched by `i8080_banks_select()`, or by the guest
+// writing the bank number to a port bound by `i8080_banks_port()`. With
+// I8080_IO_TABLE the port gets `i8080_banks_handler()`, otherwise the HAL
+// passes the writes to the I/O ports to `i8080_banks_output()` first:
+//
+//     void i8080_hal_io_output(struct i8080 *cpu, int port, int value) {
+//         if (i8080_banks_output(cpu, &machine->banks, port, value))
+//             return;
+//         ...
+//     }
+
+#ifndef I8080_BANK_WINDOWS
+#define I8080_BANK_WINDOWS 8
+#endif
+
+struct i8080_bank_window {
+    int addr;                   // The window, at a page boundary.
+    int size;                   // A multiple of 256.
+    uns8 *memory;               // The banks, `size` bytes each in a row.
+    int banks;
+    int flags;                  // The I8080_PAGE_xxx flags of the banks.
+    int current;                // The selected bank.
+};
+
+struct i8080_banks {
+    struct i8080_bank_window window[I8080_BANK_WINDOWS];
+    int windows;
+    uns8 port[256];             // The window selected by a port, plus 1.
+};
+
+extern void i8080_banks_init(struct i8080_banks *banks);
+
+// Adds a window of `banks` banks laid out in `memory`, and selects the
+// bank 0 in `cpu`. Returns the number of the window, or -1 if there are
+// I8080_BANK_WINDOWS already or the window is not made of whole pages.
+extern int i8080_banks_add(struct i8080 *cpu, struct i8080_banks *banks,
+    int addr, int size, uns8 *memory, int count, int flags);
+
+// Shows the bank `bank` (modulo the number of banks) in the window.
+extern void i8080_banks_select(struct i8080 *cpu, struct i8080_banks *banks,
+    int window, int bank);
+
+// Makes the writes to `port` select the bank of `window`, or unbinds the
+// port if `window` is negative.
+extern void i8080_banks_port(struct i8080_banks *banks, int port,
+    int window);
+
+// Handles a write to a port bound to a window, and returns 1, or returns 0
+// if the port is not bound.
+extern int i8080_banks_output(struct i8080 *cpu, struct i8080_banks *banks,
+    int port, int value);
+
+#ifdef I8080_IO_TABLE
+// The same as a handler of the port table, with the banks as its data:
+//
+//     i8080_io_output(cpu, port, i8080_banks_handler, &banks);
+extern void i8080_banks_handler(struct i8080 *cpu, int port, int value,
+    void *banks);
+#endif
+
+#endif
@@ -0,0 +1,331 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+// The benchmark: runs the test programs and a few synthetic kernels
+// several times in the core as configured by the build options, and
+// reports the host time per instruction and the emulated speed.
+//
+//     i8080_bench [-j] [-n RUNS] [-c CYCLES]
+//
+// -j prints JSON instead of a table, -n sets the number of timed runs
+// (5 by default, the median is reported), and -c the cycle limit of the
+// kernels and the long tests (500000000 by default).
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 199309L     // clock_gettime()
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "i8080.h"
+#include "i8080_hal.h"
+
+struct workload {
+    const char *name;
+    const char *file;           // The program, or 0 for `code`.
+    const uns8 *code;
+    int size;
+    int limited;                // Stopped by the cycle limit.
+};
+
+// Arithmetic and logic on registers in a loop.
+static const uns8 alu_kernel[] = {
+    0x31, 0x00, 0xF0,           // 0100 lxi sp,F000
+    0x06, 0x00,                 // 0103 mvi b,00
+    0x0E, 0x37,                 // 0105 mvi c,37
+    0x78, 0x81, 0x8F, 0xA9,     // 0107 mov a,b; add c; adc a; xra c
+    0xB0, 0x27, 0x07, 0x1F,     //      ora b; daa; rlc; rar
+    0x91, 0x98, 0xA1, 0xB9,     //      sub c; sbb b; ana c; cmp c
+    0x47, 0x0C, 0x2F, 0x3C,     //      mov b,a; inr c; cma; inr a
+    0xC3, 0x07, 0x01,           // 0117 jmp 0107
+};
+
+// Block copies through HL and DE, and the stack.
+static const uns8 memory_kernel[] = {
+    0x31, 0x00, 0xF0,           // 0100 lxi sp,F000
+    0x21, 0x00, 0x20,           // 0103 lxi h,2000
+    0x11, 0x00, 0x40,           // 0106 lxi d,4000
+    0x01, 0x00, 0x10,           // 0109 lxi b,1000
+    0x7E, 0x12, 0x23, 0x13,     // 010C mov a,m; stax d; inx h; inx d
+    0x0B, 0x78, 0xB1,           // 0110 dcx b; mov a,b; ora c
+    0xC2, 0x0C, 0x01,           // 0113 jnz 010C
+    0x2A, 0x00, 0x30,           // 0116 lhld 3000
+    0x22, 0x02, 0x30,           // 0119 shld 3002
+    0xE5, 0xE1,                 // 011C push h; pop h
+    0xC3, 0x03, 0x01,           // 011E jmp 0103
+};
+
+// Calls, returns and conditional jumps, taken and not.
+static const uns8 branch_kernel[] = {
+    0x31, 0x00, 0xF0,           // 0100 lxi sp,F000
+    0x06, 0x10,                 // 0103 mvi b,10
+    0xCD, 0x20, 0x01,           // 0105 call 0120
+    0x05,                       // 0108 dcr b
+    0xC2, 0x05, 0x01,           // 0109 jnz 0105
+    0x3E, 0x01,                 // 010C mvi a,01
+    0xB7,                       // 010E ora a
+    0xCA, 0x00, 0x01,           // 010F jz 0100
+    0xF2, 0x03, 0x01,           // 0112 jp 0103
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xA7,                       // 0120 ana a
+    0xC4, 0x30, 0x01,           // 0121 cnz 0130
+    0xCC, 0x30, 0x01,           // 0124 cz 0130
+    0xC9,                       // 0127 ret
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x3C,                       // 0130 inr a
+    0xC0,                       // 0131 rnz
+    0xC9,                       // 0132 ret
+};
+
+static const struct workload workloads[] = {
+    { "CPUTEST.COM", "CPUTEST.COM", 0, 0, 0 },
+    { "TEST.COM", "TEST.COM", 0, 0, 0 },
+    { "8080PRE.COM", "8080PRE.COM", 0, 0, 0 },
+    { "8080EX1.COM", "8080EX1.COM", 0, 0, 1 },
+    { "alu", 0, alu_kernel, sizeof(alu_kernel), 1 },
+    { "memory", 0, memory_kernel, sizeof(memory_kernel), 1 },
+    { "branch", 0, branch_kernel, sizeof(branch_kernel), 1 },
+};
+
+#define WORKLOADS ((int)(sizeof(workloads) / sizeof(workloads[0])))
+
+// The build options of the core, to tell the results apart.
+#define CONFIG_STRING(x)    #x
+#define CONFIG_VALUE(x)     CONFIG_STRING(x)
+static const char config[] = ""
+#ifdef I8080_FLAT_DISPATCH
+    " I8080_FLAT_DISPATCH"
+#endif
+#ifdef I8080_LAZY_FLAGS
+    " I8080_LAZY_FLAGS"
+#endif
+#ifdef I8080_PACKED_FLAGS
+    " I8080_PACKED_FLAGS"
+#endif
+#ifdef I8080_PAGE_TABLE
+    " I8080_PAGE_TABLE"
+#endif
+#ifdef I8080_BLOCK_CACHE
+    " I8080_BLOCK_CACHE"
+#endif
+#ifdef I8080_JIT
+    " I8080_JIT"
+#endif
+#ifdef I8080_SNAPSHOT
+    " I8080_SNAPSHOT"
+#endif
+#ifdef I8080_TRACE
+    " I8080_TRACE"
+#endif
+#ifdef I8080_PROFILE
+    " I8080_PROFILE"
+#endif
+#ifdef I8080_LANES_SCALAR
+    " I8080_LANES_SCALAR"
+#endif
+#ifdef I8080_FARM
+    " I8080_FARM"
+#endif
+#ifdef I8080_IO_TABLE
+    " I8080_IO_TABLE"
+#endif
+#ifdef I8080_IDLE
+    " I8080_IDLE"
+#endif
+#ifdef I8080_BUS
+    " I8080_BUS"
+#endif
+#ifdef I8080_8085
+    " I8080_8085"
+#endif
+#ifdef I8080_MEMSTATS
+    " I8080_MEMSTATS"
+#endif
+#ifdef I8080_REPLAY
+    " I8080_REPLAY"
+#endif
+    " I8080_LANES=" CONFIG_VALUE(I8080_LANES)
+    " I8080_EVENTS=" CONFIG_VALUE(I8080_EVENTS)
+    ;
+
+static unsigned char image[0x10000];
+static unsigned char memory[0x10000];
+static unsigned char traps[I8080_ADDR_MAP_SIZE];
+#ifdef I8080_BLOCK_CACHE
+static struct i8080_blocks blocks;
+#endif
+
+static void load(const struct workload *w) {
+    memset(image, 0, sizeof(image));
+    if (w->file) {
+        FILE* const f = fopen(w->file, "rb");
+        if (!f) {
+            fprintf(stderr, "Unable to open file \"%s\"\n", w->file);
+            exit(1);
+        }
+        fread(image + 0x100, 1, 0x10000 - 0x100, f);
+        fclose(f);
+    } else {
+        memcpy(image + 0x100, w->code, w->size);
+    }
+    image[5] = 0xC9;    // RET for the BDOS calls, which are not printed.
+}
+
+static uns64 now_ns(void) {
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uns64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    return (uns64)clock() * (1000000000 / CLOCKS_PER_SEC);
+#endif
+}
+
+// Runs the loaded program from a fresh state until it jumps to 0000 or
+// runs out of `limit` cycles. With `step` set, it is run an instruction
+// at a time to count the instructions. Returns the cycles executed.
+static uns64 run(uns64 limit, int step, uns64 *instructions) {
+    struct i8080 cpu;
+    uns64 count = 0;
+    int const slice = step ? 1 : 0x1000000;
+
+    memcpy(memory, image, sizeof(memory));
+    cpu.hal = memory;
+    i8080_init(&cpu);
+#ifdef I8080_PAGE_TABLE
+    i8080_map(&cpu, 0, 0x10000, memory, I8080_PAGE_READ | I8080_PAGE_WRITE);
+#endif
+#ifdef I8080_BLOCK_CACHE
+    i8080_blocks_attach(&cpu, &blocks);
+#endif
+    i8080_jump(&cpu, 0x100);
+    I8080_ADDR_SET(traps, 0x0000);
+    cpu.traps = traps;
+
+    while (i8080_cycles(&cpu) < limit) {
+        uns64 const left = limit - i8080_cycles(&cpu);
+        i8080_run(&cpu, left < (uns64)slice ? (int)left : slice,
+            I8080_STOP_HLT | I8080_STOP_TRAP);
+        count++;
+        if (cpu.stop_reason == I8080_STOP_HLT ||
+            (cpu.stop_reason == I8080_STOP_TRAP && i8080_pc(&cpu) == 0))
+            break;
+    }
+    if (instructions)
+        *instructions = count;
+    return i8080_cycles(&cpu);
+}
+
+static int compare(const void *a, const void *b) {
+    uns64 const x = *(const uns64 *)a, y = *(const uns64 *)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv) {
+    int json = 0, runs = 5, i, r;
+    uns64 limit = 500000000;
+    uns64* ns;
+
+    for (i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-j")) {
+            json = 1;
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            limit = strtoull(argv[++i], 0, 10);
+        } else {
+            fprintf(stderr, "Usage: %s [-j] [-n RUNS] [-c CYCLES]\n",
+                argv[0]);
+            return 2;
+        }
+    }
+    if (runs < 1)
+        runs = 1;
+    ns = (uns64 *)malloc(runs * sizeof(uns64));
+    if (!ns)
+        return 1;
+
+    if (json)
+        printf("{\n  \"config\": \"%s\",\n  \"runs\": %d,\n"
+            "  \"results\": [\n", config[0] ? config + 1 : "", runs);
+    else
+        printf("Options:%s\n%-12s %12s %12s %8s %9s %8s\n",
+            config[0] ? config : " none", "program", "instructions",
+            "cycles", "ns/inst", "MHz", "MIPS");
+
+    for (i = 0; i < WORKLOADS; ++i) {
+        const struct workload* const w = &workloads[i];
+        uns64 const cap = w->limited ? limit : I8080_NEVER;
+        uns64 instructions, cycles, median;
+
+        load(w);
+        cycles = run(cap, 1, &instructions);
+        for (r = 0; r < runs; ++r) {
+            uns64 const start = now_ns();
+            if (run(cap, 0, 0) != cycles) {
+                fprintf(stderr, "%s: the runs differ\n", w->name);
+                return 1;
+            }
+            ns[r] = now_ns() - start;
+        }
+        qsort(ns, runs, sizeof(uns64), compare);
+        median = ns[runs / 2] ? ns[runs / 2] : 1;
+
+        if (json) {
+            printf("    { \"name\": \"%s\", \"instructions\": %llu, "
+                "\"cycles\": %llu, \"ns_median\": %llu, \"ns_min\": %llu, "
+                "\"ns_per_instruction\": %.3f, \"mhz\": %.3f, "
+                "\"mips\": %.3f }%s\n", w->name,
+                (unsigned long long)instructions,
+                (unsigned long long)cycles, (unsigned long long)median,
+                (unsigned long long)ns[0],
+                (double)median / instructions, cycles * 1000.0 / median,
+                instructions * 1000.0 / median,
+                i + 1 < WORKLOADS ? "," : "");
+        } else {
+            printf("%-12s %12llu %12llu %8.2f %9.2f %8.2f\n", w->name,
+                (unsigned long long)instructions,
+                (unsigned long long)cycles, (double)median / instructions,
+                cycles * 1000.0 / median, instructions * 1000.0 / median);
+        }
+        fflush(stdout);
+    }
+    if (json)
+        printf("  ]\n}\n");
+    free(ns);
+    return 0;
+}
@@ -0,0 +1,706 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <dirent.h>
+#endif
+
+#include "i8080_cpm.h"
+
+#define BDOS_RET            I8080_CPM_BDOS
+#define BIOS_ENTRIES        17
+#define BIOS_DPH            (I8080_CPM_BIOS + 0x40)    // 16 bytes per disk
+#define BIOS_DPB            (I8080_CPM_BIOS + 0xC0)
+#define BIOS_DIRBUF         (I8080_CPM_BIOS - 0x80)
+
+#define CTRL_Z              0x1A
+
+// The bytes of a file control block.
+#define FCB_DRIVE           0
+#define FCB_NAME            1
+#define FCB_EX              12
+#define FCB_S2              14
+#define FCB_HANDLE          16  // The allocation map is ours.
+#define FCB_CR              32
+#define FCB_R0              33
+
+static void cpm_put(struct i8080_cpm *cpm, int c) {
+    if (cpm->buffered == I8080_CPM_OUTPUT)
+        i8080_cpm_flush(cpm);
+    cpm->output[cpm->buffered++] = (char)c;
+    cpm->written++;
+}
+
+static int cpm_get(struct i8080_cpm *cpm) {
+    int c;
+    i8080_cpm_flush(cpm);
+    c = cpm->console_in ? getc(cpm->console_in) : EOF;
+    if (c == '\n')
+        c = '\r';
+    return c == EOF ? CTRL_Z : c;
+}
+
+void i8080_cpm_flush(struct i8080_cpm *cpm) {
+    if (cpm->buffered && cpm->console_out) {
+        fwrite(cpm->output, 1, cpm->buffered, cpm->console_out);
+        fflush(cpm->console_out);
+    }
+    cpm->buffered = 0;
+}
+
+// Returns from a system call with HL = BA = value, and A = L.
+static void cpm_return(struct i8080 *cpu, int value) {
+    struct i8080_state state;
+    i8080_save(cpu, &state);
+    state.af = (uns16)((value & 0xff) << 8 | (state.af & 0xff));
+    state.bc = (uns16)((value & 0xff00) | (state.bc & 0xff));
+    state.hl = (uns16)value;
+    i8080_restore(cpu, &state);
+}
+
+static void cpm_reboot(struct i8080 *cpu) {
+    i8080_jump(cpu, 0x0000);
+}
+
+// Files
+
+// The characters of the CP/M names: printable, and none of the delimiters
+// of the CCP, the wildcards or the separators of the host paths.
+static int cpm_legal(int c) {
+    return c > ' ' && c < 0x7f && !strchr("<>.,;:=?*[]|/\\\"", c);
+}
+
+static int cpm_upper(int c) {
+    return c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c;
+}
+
+// Makes the FCB-style name of a host file, upper-case, or returns 0 if the
+// file has no name of CP/M.
+static int cpm_cpm_name(const char *file, uns8 *name) {
+    int i = 0, n = 0;
+    memset(name, ' ', 11);
+    for (; *file && *file != '.'; ++file, ++n) {
+        if (n == 8 || !cpm_legal(*file))
+            return 0;
+        name[n] = (uns8)cpm_upper(*file);
+    }
+    if (n == 0)
+        return 0;
+    if (*file == '.') {
+        for (++file; *file; ++file, ++i) {
+            if (i == 3 || !cpm_legal(*file))
+                return 0;
+            name[8 + i] = (uns8)cpm_upper(*file);
+        }
+    }
+    return 1;
+}
+
+// Checks an FCB-style name (8 + 3 characters padded with spaces) and makes
+// it upper-case without the attributes, the high bits of f1-f4 and t1-t3.
+// Returns 0 if it is not a name of CP/M.
+static int cpm_fcb_name(const uns8 *name, uns8 *clean) {
+    int i;
+    for (i = 0; i < 11; ++i) {
+        int c = name[i];
+        if (c & 0x80) {
+            if (i >= 4 && i < 8)
+                return 0;
+            c &= 0x7f;
+        }
+        c = cpm_upper(c);
+        if (c == ' ' ? i == 0 :
+            !cpm_legal(c) || (i % 8 != 0 && clean[i - 1] == ' '))
+            return 0;
+        clean[i] = (uns8)c;
+    }
+    return 1;
+}
+
+// Makes the host name of an FCB-style name, or returns 0 if the drive has
+// no directory or the name is not legal. The host files are matched without
+// case, a new file gets a lower-case name.
+static char *cpm_host_name(struct i8080_cpm *cpm, int drive,
+    const uns8 *name, char *path, int size) {
+    uns8 clean[11];
+    char file[13];
+    int i, n = 0;
+#ifndef _WIN32
+    struct dirent *entry;
+    uns8 other[11];
+    DIR *dir;
+#endif
+    if (drive < 0 || drive >= I8080_CPM_DRIVES || !cpm->drive[drive] ||
+        !cpm_fcb_name(name, clean))
+        return 0;
+    for (i = 0; i < 11; ++i) {
+        int const c = clean[i];
+        if (i == 8 && c != ' ')
+            file[n++] = '.';
+        if (c != ' ')
+            file[n++] = (char)(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+    }
+    file[n] = 0;
+#ifndef _WIN32
+    if ((dir = opendir(cpm->drive[drive])) != 0) {
+        while ((entry = readdir(dir)) != 0) {
+            if (cpm_cpm_name(entry->d_name, other) &&
+                memcmp(other, clean, 11) == 0) {
+                strcpy(file, entry->d_name);
+                n = (int)strlen(file);
+                break;
+            }
+        }
+        closedir(dir);
+    }
+#endif
+    if ((int)(strlen(cpm->drive[drive]) + n + 2) > size)
+        return 0;
+    sprintf(path, "%s/%s", cpm->drive[drive], file);
+    return path;
+}
+
+static void cpm_fcb_read(struct i8080 *cpu, int fcb, uns8 *bytes, int n) {
+    int i;
+    for (i = 0; i < n; ++i)
+        bytes[i] = (uns8)i8080_peek(cpu, fcb + i);
+}
+
+static int cpm_fcb_drive(struct i8080_cpm *cpm, struct i8080 *cpu, int fcb) {
+    int const drive = i8080_peek(cpu, fcb + FCB_DRIVE);
+    return drive == 0 || drive == '?' ? cpm->current : drive - 1;
+}
+
+static char *cpm_fcb_path(struct i8080_cpm *cpm, struct i8080 *cpu, int fcb,
+    int offset, char *path, int size) {
+    uns8 name[11];
+    cpm_fcb_read(cpu, fcb + FCB_NAME + offset, name, 11);
+    return cpm_host_name(cpm, cpm_fcb_drive(cpm, cpu, fcb), name, path, size);
+}
+
+static FILE *cpm_fcb_file(struct i8080_cpm *cpm, struct i8080 *cpu,
+    int fcb) {
+    int const handle = i8080_peek(cpu, fcb + FCB_HANDLE) - 1;
+    if (handle < 0 || handle >= I8080_CPM_FILES)
+        return 0;
+    return cpm->file[handle];
+}
+
+static int cpm_fcb_attach(struct i8080_cpm *cpm, struct i8080 *cpu, int fcb,
+    FILE *f) {
+    int i;
+    for (i = 0; i < I8080_CPM_FILES && cpm->file[i]; ++i)
+        ;
+    if (i == I8080_CPM_FILES) {
+        fclose(f);
+        return 0xff;
+    }
+    cpm->file[i] = f;
+    i8080_poke(cpu, fcb + FCB_HANDLE, i + 1);
+    i8080_poke(cpu, fcb + FCB_EX, 0);
+    i8080_poke(cpu, fcb + FCB_S2, 0);
+    i8080_poke(cpu, fcb + FCB_CR, 0);
+    return 0;
+}
+
+// The record number of the sequential access.
+static long cpm_fcb_record(struct i8080 *cpu, int fcb) {
+    return ((long)(i8080_peek(cpu, fcb + FCB_S2) & 0x3f) * 32 +
+        (i8080_peek(cpu, fcb + FCB_EX) & 0x1f)) * 128 +
+        (i8080_peek(cpu, fcb + FCB_CR) & 0x7f);
+}
+
+static void cpm_fcb_seek(struct i8080 *cpu, int fcb, long record) {
+    i8080_poke(cpu, fcb + FCB_CR, (int)(record & 0x7f));
+    i8080_poke(cpu, fcb + FCB_EX, (int)((record >> 7) & 0x1f));
+    i8080_poke(cpu, fcb + FCB_S2, (int)((record >> 12) & 0x3f));
+}
+
+static long cpm_fcb_random(struct i8080 *cpu, int fcb) {
+    return i8080_peek(cpu, fcb + FCB_R0) |
+        (long)i8080_peek(cpu, fcb + FCB_R0 + 1) << 8 |
+        (long)(i8080_peek(cpu, fcb + FCB_R0 + 2) & 0x03) << 16;
+}
+
+static void cpm_fcb_set_random(struct i8080 *cpu, int fcb, long record) {
+    i8080_poke(cpu, fcb + FCB_R0, (int)(record & 0xff));
+    i8080_poke(cpu, fcb + FCB_R0 + 1, (int)((record >> 8) & 0xff));
+    i8080_poke(cpu, fcb + FCB_R0 + 2, (int)((record >> 16) & 0xff));
+}
+
+// Reads (writes) the record between the file and the DMA buffer. Returns
+// the BDOS code: 0, or 1 at the end of the file.
+static int cpm_transfer(struct i8080_cpm *cpm, struct i8080 *cpu, FILE *f,
+    long record, int write) {
+    uns8 buffer[128];
+    int i, n;
+    if (fseek(f, record * 128, SEEK_SET) != 0)
+        return 1;
+    if (write) {
+        for (i = 0; i < 128; ++i)
+            buffer[i] = (uns8)i8080_peek(cpu, cpm->dma + i);
+        return fwrite(buffer, 1, 128, f) == 128 ? 0 : 2;
+    }
+    n = (int)fread(buffer, 1, 128, f);
+    if (n <= 0)
+        return 1;
+    for (i = n; i < 128; ++i)
+        buffer[i] = CTRL_Z;
+    for (i = 0; i < 128; ++i)
+        i8080_poke(cpu, cpm->dma + i, buffer[i]);
+    return 0;
+}
+
+static int cpm_match(const uns8 *pattern, const uns8 *name) {
+    int i;
+    for (i = 0; i < 11; ++i)
+        if (pattern[i] != '?' && (pattern[i] & 0x7f) != name[i])
+            return 0;
+    return 1;
+}
+
+// Finds the next host file matching the search pattern, and puts its
+// directory entry into the DMA buffer.
+static int cpm_search_next(struct i8080_cpm *cpm, struct i8080 *cpu) {
+#ifndef _WIN32
+    struct dirent *entry;
+    uns8 name[11];
+    int i;
+    if (!cpm->search)
+        return 0xff;
+    while ((entry = readdir((DIR *)cpm->search)) != 0) {
+        if (!cpm_cpm_name(entry->d_name, name) ||
+            !cpm_match(cpm->pattern + 1, name))
+            continue;
+        i8080_poke(cpu, cpm->dma, cpm->user);
+        for (i = 0; i < 11; ++i)
+            i8080_poke(cpu, cpm->dma + 1 + i, name[i]);
+        for (i = 12; i < 32; ++i)
+            i8080_poke(cpu, cpm->dma + i, 0);
+        for (i = 32; i < 128; ++i)
+            i8080_poke(cpu, cpm->dma + i, 0xe5);
+        return 0;
+    }
+    closedir((DIR *)cpm->search);
+    cpm->search = 0;
+#else
+    (void)cpm;
+    (void)cpu;
+#endif
+    return 0xff;
+}
+
+static int cpm_search_first(struct i8080_cpm *cpm, struct i8080 *cpu,
+    int fcb) {
+    int const drive = cpm_fcb_drive(cpm, cpu, fcb);
+#ifndef _WIN32
+    if (cpm->search)
+        closedir((DIR *)cpm->search);
+    cpm->search = 0;
+    if (drive < 0 || drive >= I8080_CPM_DRIVES || !cpm->drive[drive])
+        return 0xff;
+    cpm_fcb_read(cpu, fcb, cpm->pattern, 12);
+    cpm->search = opendir(cpm->drive[drive]);
+#else
+    (void)drive;
+#endif
+    return cpm_search_next(cpm, cpu);
+}
+
+// The file functions of the BDOS.
+static int cpm_file(struct i8080_cpm *cpm, struct i8080 *cpu, int function,
+    int fcb) {
+    char path[1024], other[1024];
+    FILE *f;
+    long record;
+    int code;
+
+    switch (function) {
+        case 15:    // open file
+            if (!cpm_fcb_path(cpm, cpu, fcb, 0, path, sizeof(path)))
+                return 0xff;
+            f = fopen(path, "r+b");
+            if (!f)
+                f = fopen(path, "rb");
+            return f ? cpm_fcb_attach(cpm, cpu, fcb, f) : 0xff;
+        case 16:    // close file
+            f = cpm_fcb_file(cpm, cpu, fcb);
+            if (!f)
+                return 0xff;
+            fclose(f);
+            cpm->file[i8080_peek(cpu, fcb + FCB_HANDLE) - 1] = 0;
+            i8080_poke(cpu, fcb + FCB_HANDLE, 0);
+            return 0;
+        case 17:    // search for first
+            return cpm_search_first(cpm, cpu, fcb);
+        case 18:    // search for next
+            return cpm_search_next(cpm, cpu);
+        case 19:    // delete file
+            // The wildcards delete every matching file.
+            for (code = 0xff; cpm_search_first(cpm, cpu, fcb) == 0;
+                 code = 0) {
+                uns8 name[11];
+                cpm_fcb_read(cpu, cpm->dma + 1, name, 11);
+                if (!cpm_host_name(cpm, cpm_fcb_drive(cpm, cpu, fcb), name,
+                    other, sizeof(other)) || remove(other) != 0)
+                    break;
+            }
+            return code;
+        case 20:    // read sequential
+        case 21:    // write sequential
+            f = cpm_fcb_file(cpm, cpu, fcb);
+            if (!f)
+                return 9;
+            record = cpm_fcb_record(cpu, fcb);
+            code = cpm_transfer(cpm, cpu, f, record, function == 21);
+            if (code == 0)
+                cpm_fcb_seek(cpu, fcb, record + 1);
+            return code;
+        case 22:    // make file
+            if (!cpm_fcb_path(cpm, cpu, fcb, 0, path, sizeof(path)))
+                return 0xff;
+            f = fopen(path, "w+b");
+            return f ? cpm_fcb_attach(cpm, cpu, fcb, f) : 0xff;
+        case 23:    // rename file
+            if (!cpm_fcb_path(cpm, cpu, fcb, 0, path, sizeof(path)) ||
+                !cpm_fcb_path(cpm, cpu, fcb, 16, other, sizeof(other)))
+                return 0xff;
+            return rename(path, other) == 0 ? 0 : 0xff;
+        case 33:    // read random
+        case 34:    // write random
+        case 40:    // write random with zero fill
+            f = cpm_fcb_file(cpm, cpu, fcb);
+            if (!f)
+                return 9;
+            record = cpm_fcb_random(cpu, fcb);
+            cpm_fcb_seek(cpu, fcb, record);
+            code = cpm_transfer(cpm, cpu, f, record, function != 33);
+            return function == 33 && code == 1 ? 1 : code;
+        case 35:    // compute file size
+            f = cpm_fcb_file(cpm, cpu, fcb);
+            if (!f && cpm_fcb_path(cpm, cpu, fcb, 0, path, sizeof(path))) {
+                FILE* const g = fopen(path, "rb");
+                if (!g)
+                    return 0xff;
+                fseek(g, 0, SEEK_END);
+                cpm_fcb_set_random(cpu, fcb, (ftell(g) + 127) / 128);
+                fclose(g);
+                return 0;
+            }
+            if (!f)
+                return 0xff;
+            fseek(f, 0, SEEK_END);
+            cpm_fcb_set_random(cpu, fcb, (ftell(f) + 127) / 128);
+            return 0;
+        case 36:    // set random record
+            cpm_fcb_set_random(cpu, fcb, cpm_fcb_record(cpu, fcb));
+            return 0;
+    }
+    return 0xff;
+}
+
+// The BDOS call in C with the parameter in DE. Returns non-zero to stop.
+static int cpm_bdos(struct i8080_cpm *cpm, struct i8080 *cpu) {
+    int const function = i8080_regs_c(cpu);
+    int const de = i8080_regs_de(cpu);
+    int const e = de & 0xff;
+    int result = 0, i, c;
+
+    switch (function) {
+        case 0:     // system reset
+            cpm_reboot(cpu);
+            return 1;
+        case 1:     // console input
+            result = cpm_get(cpm);
+            cpm_put(cpm, result);
+            break;
+        case 2:     // console output
+            cpm_put(cpm, e);
+            break;
+        case 3:     // reader input
+            result = CTRL_Z;
+            break;
+        case 4:     // punch output
+        case 5:     // list output
+            break;
+        case 6:     // direct console I/O
+            if (e == 0xff || e == 0xfd)
+                result = cpm_get(cpm);
+            else if (e != 0xfe)
+                cpm_put(cpm, e);
+            break;
+        case 7:     // get I/O byte
+        case 8:     // set I/O byte
+            break;
+        case 9:     // print string
+            for (i = de; (c = i8080_peek(cpu, i)) != '$'; i = (i + 1) & 0xffff)
+                cpm_put(cpm, c);
+            break;
+        case 10: {  // read console buffer
+            int const max = i8080_peek(cpu, de);
+            int n = 0;
+            while (n < max && (c = cpm_get(cpm)) != '\r' && c != CTRL_Z) {
+                i8080_poke(cpu, de + 2 + n++, c);
+                cpm_put(cpm, c);
+            }
+            i8080_poke(cpu, de + 1, n);
+            cpm_put(cpm, '\r');
+            cpm_put(cpm, '\n');
+            break;
+        }
+        case 11:    // console status
+            break;
+        case 12:    // return version number
+            result = 0x0022;
+            break;
+        case 13:    // reset disk system
+            cpm->current = 0;
+            cpm->dma = 0x80;
+            break;
+        case 14:    // select disk
+            if (e >= I8080_CPM_DRIVES || !cpm->drive[e])
+                result = 0xff;
+            else
+                cpm->current = e;
+            break;
+        case 24:    // return login vector
+            for (i = 0; i < I8080_CPM_DRIVES; ++i)
+                if (cpm->drive[i])
+                    result |= 1 << i;
+            break;
+        case 25:    // return current disk
+            result = cpm->current;
+            break;
+        case 26:    // set DMA address
+            cpm->dma = (uns16)de;
+            break;
+        case 29:    // get read-only vector
+            break;
+        case 32:    // set/get user code
+            if (e == 0xff)
+                result = cpm->user;
+            else
+                cpm->user = e & 0x0f;
+            break;
+        default:
+            result = cpm_file(cpm, cpu, function, de);
+            break;
+    }
+    cpm_return(cpu, result);
+    return 0;
+}
+
+// Disks
+
+static int cpm_sector(struct i8080_cpm *cpm, struct i8080 *cpu, int write) {
+    FILE* const f = cpm->disk[cpm->disk_current];
+    uns8 buffer[128];
+    int i;
+    if (!f || fseek(f, ((long)cpm->track * cpm->spt[cpm->disk_current] +
+        cpm->sector) * 128, SEEK_SET) != 0)
+        return 1;
+    if (write) {
+        for (i = 0; i < 128; ++i)
+            buffer[i] = (uns8)i8080_peek(cpu, cpm->disk_dma + i);
+        return fwrite(buffer, 1, 128, f) == 128 ? 0 : 1;
+    }
+    if (fread(buffer, 1, 128, f) != 128)
+        return 1;
+    for (i = 0; i < 128; ++i)
+        i8080_poke(cpu, cpm->disk_dma + i, buffer[i]);
+    return 0;
+}
+
+static void cpm_poke_word(struct i8080 *cpu, int addr, int word) {
+    i8080_poke(cpu, addr, word & 0xff);
+    i8080_poke(cpu, addr + 1, (word >> 8) & 0xff);
+}
+
+// Builds the disk parameter header of a disk, with the parameter block of
+// the standard 8" disk (2 reserved tracks, 1K blocks, 64 entries) but the
+// sectors per track of the image.
+static int cpm_dph(struct i8080_cpm *cpm, struct i8080 *cpu, int disk) {
+    static const uns8 dpb[15] = {
+        0, 0, 3, 7, 0, 242, 0, 63, 0, 0xc0, 0, 16, 0, 2, 0
+    };
+    int const dph = BIOS_DPH + disk * 16;
+    int i;
+    for (i = 0; i < 15; ++i)
+        i8080_poke(cpu, BIOS_DPB + disk * 16 + i, dpb[i]);
+    cpm_poke_word(cpu, BIOS_DPB + disk * 16, cpm->spt[disk]);
+    for (i = 0; i < 16; ++i)
+        i8080_poke(cpu, dph + i, 0);
+    cpm_poke_word(cpu, dph + 8, BIOS_DIRBUF);
+    cpm_poke_word(cpu, dph + 10, BIOS_DPB + disk * 16);
+    return dph;
+}
+
+// The BIOS call of the entry `n`. Returns non-zero to stop.
+static int cpm_bios(struct i8080_cpm *cpm, struct i8080 *cpu, int n) {
+    int const bc = i8080_regs_bc(cpu);
+    int const c = bc & 0xff;
+    struct i8080_state state;
+
+    switch (n) {
+        case 0:     // cold boot
+        case 1:     // warm boot
+            cpm_reboot(cpu);
+            return 1;
+        case 2:     // console status
+            cpm_return(cpu, 0);
+            return 0;
+        case 3:     // console input
+            cpm_return(cpu, cpm_get(cpm));
+            return 0;
+        case 4:     // console output
+            cpm_put(cpm, c);
+            return 0;
+        case 7:     // reader input
+            cpm_return(cpu, CTRL_Z);
+            return 0;
+        case 8:     // home
+            cpm->track = 0;
+            return 0;
+        case 9:     // select disk
+            if (c < I8080_CPM_DISKS && cpm->disk[c]) {
+                cpm->disk_current = c;
+                cpm_return(cpu, cpm_dph(cpm, cpu, c));
+            } else {
+                cpm_return(cpu, 0);
+            }
+            return 0;
+        case 10:    // set track
+            cpm->track = bc;
+            return 0;
+        case 11:    // set sector
+            cpm->sector = bc;
+            return 0;
+        case 12:    // set DMA address
+            cpm->disk_dma = (uns16)bc;
+            return 0;
+        case 13:    // read
+        case 14:    // write
+            cpm_return(cpu, cpm_sector(cpm, cpu, n == 14));
+            return 0;
+        case 15:    // list status
+            cpm_return(cpu, 0xff);
+            return 0;
+        case 16:    // sector translate: none, HL = BC
+            i8080_save(cpu, &state);
+            state.hl = (uns16)bc;
+            i8080_restore(cpu, &state);
+            return 0;
+    }
+    return 0;          // list, punch
+}
+
+static int cpm_trap(struct i8080 *cpu, void *data) {
+    struct i8080_cpm* const cpm = (struct i8080_cpm *)data;
+    int const pc = i8080_pc(cpu);
+    if (pc == 0x0000)
+        return 1;
+    if (pc == BDOS_RET)
+        return cpm_bdos(cpm, cpu);
+    if (pc >= I8080_CPM_BIOS && pc < I8080_CPM_BIOS + BIOS_ENTRIES * 3)
+        return cpm_bios(cpm, cpu, (pc - I8080_CPM_BIOS) / 3);
+    return 1;
+}
+
+void i8080_cpm_init(struct i8080_cpm *cpm, FILE *in, FILE *out,
+    const char *directory) {
+    memset(cpm, 0, sizeof(*cpm));
+    cpm->console_in = in;
+    cpm->console_out = out;
+    cpm->drive[0] = directory;
+    cpm->dma = 0x80;
+    cpm->disk_dma = 0x80;
+}
+
+void i8080_cpm_attach(struct i8080_cpm *cpm, struct i8080 *cpu) {
+    int i;
+    // jmp wboot, jmp bdos; the entries of the BDOS and the BIOS just
+    // return after the trap.
+    i8080_poke(cpu, 0x0000, 0xC3);
+    cpm_poke_word(cpu, 0x0001, I8080_CPM_BIOS + 3);
+    i8080_poke(cpu, 0x0005, 0xC3);
+    cpm_poke_word(cpu, 0x0006, BDOS_RET);
+    i8080_poke(cpu, BDOS_RET, 0xC9);
+    I8080_ADDR_SET(cpm->traps, 0x0000);
+    I8080_ADDR_SET(cpm->traps, BDOS_RET);
+    for (i = 0; i < BIOS_ENTRIES; ++i) {
+        i8080_poke(cpu, I8080_CPM_BIOS + i * 3, 0xC9);
+        I8080_ADDR_SET(cpm->traps, I8080_CPM_BIOS + i * 3);
+    }
+    cpu->traps = cpm->traps;
+    cpu->trap_handler = cpm_trap;
+    cpu->trap_data = cpm;
+}
+
+int i8080_cpm_disk(struct i8080_cpm *cpm, int disk, const char *path,
+    int spt) {
+    FILE *f;
+    if (disk < 0 || disk >= I8080_CPM_DISKS || spt <= 0)
+        return -1;
+    f = fopen(path, "r+b");
+    if (!f)
+        return -1;
+    if (cpm->disk[disk])
+        fclose(cpm->disk[disk]);
+    cpm->disk[disk] = f;
+    cpm->spt[disk] = spt;
+    return 0;
+}
+
+void i8080_cpm_close(struct i8080_cpm *cpm) {
+    int i;
+    i8080_cpm_flush(cpm);
+    for (i = 0; i < I8080_CPM_FILES; ++i) {
+        if (cpm->file[i])
+            fclose(cpm->file[i]);
+        cpm->file[i] = 0;
+    }
+    for (i = 0; i < I8080_CPM_DISKS; ++i) {
+        if (cpm->disk[i])
+            fclose(cpm->disk[i]);
+        cpm->disk[i] = 0;
+    }
+#ifndef _WIN32
+    if (cpm->search)
+        closedir((DIR *)cpm->search);
+#endif
+    cpm->search = 0;
+}
@@ -0,0 +1,111 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifndef I8080_CPM_H
+#define I8080_CPM_H
+
+#include <stdio.h>
+
+#include "i8080.h"
+
+// A high-level emulation of CP/M 2.2. The BDOS and the BIOS are not guest
+// code: their entry points are traps of the CPU handled by the host, so a
+// system call costs one trap. The BDOS keeps the files in host
+// directories, one per drive, and the BIOS disk calls go to disk images of
+// 128-byte sectors. The names are matched to the host files without case,
+// and a name with a character which CP/M does not allow (a delimiter, '/'
+// or '\', and a wildcard outside of the search patterns) is rejected, so a
+// guest cannot leave its directory. The console output is buffered and
+// written out in large blocks, before every console input and by
+// `i8080_cpm_flush()`.
+//
+// `i8080_cpm_attach()` installs page zero (the jumps to the warm boot at
+// 0000 and to the BDOS at 0005), the BDOS entry and the BIOS jump table,
+// and takes the trap bitmap and handler of the CPU. `i8080_run()` with
+// I8080_STOP_TRAP then runs the guest until it reboots (jumps to 0000,
+// calls the BDOS function 0 or the BIOS warm boot), and stops with PC at
+// 0000 and I8080_STOP_TRAP.
+
+#define I8080_CPM_BDOS          0xFE06
+#define I8080_CPM_BIOS          0xFF00
+
+#define I8080_CPM_DRIVES        16
+#define I8080_CPM_DISKS         4
+#define I8080_CPM_FILES         16
+#define I8080_CPM_OUTPUT        4096
+
+struct i8080_cpm {
+    FILE *console_in;           // 0 reads as the end of input (^Z).
+    FILE *console_out;
+    char output[I8080_CPM_OUTPUT];
+    int buffered;
+    unsigned long written;      // Characters written to the console.
+
+    // The host directory of every drive, or 0; only A: by default.
+    const char *drive[I8080_CPM_DRIVES];
+    int current;
+    int user;
+    uns16 dma;
+    FILE *file[I8080_CPM_FILES];
+    void *search;               // The directory listed by the search.
+    uns8 pattern[12];
+
+    // The disk images of the BIOS with their sectors per track, the
+    // selected disk, track, sector and DMA address.
+    FILE *disk[I8080_CPM_DISKS];
+    int spt[I8080_CPM_DISKS];
+    int disk_current, track, sector;
+    uns16 disk_dma;
+
+    uns8 traps[I8080_ADDR_MAP_SIZE];
+};
+
+// Sets up the emulation with the host console files and the directory of
+// the drive A:.
+extern void i8080_cpm_init(struct i8080_cpm *cpm, FILE *in, FILE *out,
+    const char *directory);
+
+extern void i8080_cpm_attach(struct i8080_cpm *cpm, struct i8080 *cpu);
+
+// Opens the image of the BIOS disk `disk` with `spt` sectors per track
+// (26 for the standard 8" disk). Returns 0 or -1.
+extern int i8080_cpm_disk(struct i8080_cpm *cpm, int disk, const char *path,
+    int spt);
+
+extern void i8080_cpm_flush(struct i8080_cpm *cpm);
+
+// Flushes the console, closes the files and disks.
+extern void i8080_cpm_close(struct i8080_cpm *cpm);
+
+#endif
@@ -0,0 +1,236 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+// The differential tester: runs a guest in two CPUs side by side, the
+// reference executing by `i8080_instruction()` and the candidate by
+// `i8080_run()` with the block cache (and the JIT) when it is built in,
+// and stops at the first difference of their state.
+//
+//     i8080_diff [-f CASES] [-s SEED] [FILE.COM ...]
+//
+// The candidate runs in slices of random length, and the reference
+// catches up with it instruction by instruction; then the registers, the
+// flags and the cycle counters must match, and every 64 slices the
+// memory too. The programs are the tests by default; -f adds that many
+// cases of random code and data in random machine states.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i8080.h"
+#include "i8080_hal.h"
+
+#define MEMORY_CHECK_SLICES     64
+#define MAX_SLICE               512
+#define FUZZ_CYCLES             200000
+
+static unsigned char ref_memory[0x10000];
+static unsigned char cand_memory[0x10000];
+static unsigned char traps[I8080_ADDR_MAP_SIZE];
+#ifdef I8080_BLOCK_CACHE
+static struct i8080_blocks blocks;
+#endif
+
+static unsigned long seed = 1;
+
+static int random_byte(void) {
+    seed = seed * 1103515245 + 12345;
+    return (int)((seed >> 16) & 0xff);
+}
+
+static void setup(struct i8080 *cpu, unsigned char *memory,
+    const unsigned char *image, const struct i8080_state *state) {
+    memcpy(memory, image, 0x10000);
+    cpu->hal = memory;
+    i8080_init(cpu);
+#ifdef I8080_PAGE_TABLE
+    i8080_map(cpu, 0, 0x10000, memory, I8080_PAGE_READ | I8080_PAGE_WRITE);
+#endif
+    i8080_restore(cpu, state);
+    cpu->traps = traps;
+}
+
+static void print_state(const char *name, const struct i8080_state *s) {
+    printf("  %-9s PC=%04X AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X "
+        "IFF=%d halted=%d cycles=%llu (last PC %04X)\n", name, s->pc,
+        s->af, s->bc, s->de, s->hl, s->sp, s->iff, s->halted,
+        (unsigned long long)s->cycles, s->last_pc);
+}
+
+static int same_state(const struct i8080_state *a,
+    const struct i8080_state *b) {
+    return a->af == b->af && a->bc == b->bc && a->de == b->de &&
+        a->hl == b->hl && a->sp == b->sp && a->pc == b->pc &&
+        a->iff == b->iff && a->halted == b->halted &&
+        a->pending == b->pending && a->cycles == b->cycles;
+}
+
+// Compares the CPUs, and the memory if `memory` is set. Prints the
+// difference and returns 0 if there is one.
+static int compare(const char *name, struct i8080 *ref, struct i8080 *cand,
+    int memory) {
+    struct i8080_state a, b;
+    int addr;
+    i8080_save(ref, &a);
+    i8080_save(cand, &b);
+    if (!same_state(&a, &b)) {
+        printf("%s: the state differs\n", name);
+        print_state("reference", &a);
+        print_state("candidate", &b);
+        return 0;
+    }
+    if (memory && memcmp(ref_memory, cand_memory, 0x10000) != 0) {
+        for (addr = 0; ref_memory[addr] == cand_memory[addr]; ++addr)
+            ;
+        printf("%s: the memory differs at %04X (%02X, %02X) by PC=%04X, "
+            "cycles=%llu\n", name, addr, ref_memory[addr],
+            cand_memory[addr], a.pc, (unsigned long long)a.cycles);
+        return 0;
+    }
+    return 1;
+}
+
+// Runs both CPUs for `limit` cycles, or until the guest jumps to 0000 or
+// halts. Returns 0 at a difference.
+static int run(const char *name, const unsigned char *image,
+    const struct i8080_state *state, uns64 limit) {
+    struct i8080 ref, cand;
+    uns64 slices = 0;
+
+    setup(&ref, ref_memory, image, state);
+    setup(&cand, cand_memory, image, state);
+#ifdef I8080_BLOCK_CACHE
+    i8080_blocks_attach(&cand, &blocks);
+#endif
+
+    while (i8080_cycles(&cand) < limit) {
+        int const slice = 1 + random_byte() * MAX_SLICE / 256;
+        i8080_run(&cand, slice, I8080_STOP_HLT | I8080_STOP_TRAP);
+        while (i8080_cycles(&ref) < i8080_cycles(&cand)) {
+            i8080_instruction(&ref);
+            if (I8080_ADDR_TST(traps, i8080_pc(&ref)) || i8080_halted(&ref))
+                break;
+        }
+        if (!compare(name, &ref, &cand,
+                ++slices % MEMORY_CHECK_SLICES == 0))
+            return 0;
+        if (I8080_ADDR_TST(traps, i8080_pc(&cand)) || i8080_halted(&cand))
+            break;
+    }
+    return compare(name, &ref, &cand, 1);
+}
+
+static int run_file(const char *file) {
+    static unsigned char image[0x10000];
+    struct i8080_state state;
+    FILE* const f = fopen(file, "rb");
+    if (!f) {
+        fprintf(stderr, "Unable to open file \"%s\"\n", file);
+        exit(2);
+    }
+    memset(image, 0, sizeof(image));
+    fread(image + 0x100, 1, 0x10000 - 0x100, f);
+    fclose(f);
+    image[5] = 0xC9;    // RET for the BDOS calls, which are not printed.
+
+    memset(&state, 0, sizeof(state));
+    state.pc = 0x100;
+    I8080_ADDR_SET(traps, 0x0000);
+    if (!run(file, image, &state, I8080_NEVER))
+        return 0;
+    printf("%s: same\n", file);
+    return 1;
+}
+
+// Random bytes everywhere run from a random state: whatever the code
+// does, including writing over itself, both CPUs must agree.
+static int run_fuzz(int cases) {
+    static unsigned char image[0x10000];
+    struct i8080_state state;
+    char name[32];
+    int i, addr;
+
+    I8080_ADDR_CLR(traps, 0x0000);
+    for (i = 0; i < cases; ++i) {
+        for (addr = 0; addr < 0x10000; ++addr)
+            image[addr] = (unsigned char)random_byte();
+        memset(&state, 0, sizeof(state));
+        state.af = (uns16)(random_byte() << 8 | random_byte());
+        state.bc = (uns16)(random_byte() << 8 | random_byte());
+        state.de = (uns16)(random_byte() << 8 | random_byte());
+        state.hl = (uns16)(random_byte() << 8 | random_byte());
+        state.sp = (uns16)(random_byte() << 8 | random_byte());
+        state.pc = (uns16)(random_byte() << 8 | random_byte());
+        sprintf(name, "fuzz case %d", i);
+        if (!run(name, image, &state, FUZZ_CYCLES))
+            return 0;
+    }
+    printf("%d fuzz cases: same\n", cases);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    static const char *tests[] = {
+        "CPUTEST.COM", "TEST.COM", "8080PRE.COM", "8080EX1.COM", 0
+    };
+    int cases = 0, files = 0, i;
+
+    for (i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            cases = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            seed = strtoul(argv[++i], 0, 10);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Usage: %s [-f CASES] [-s SEED] [FILE.COM ...]\n",
+                argv[0]);
+            return 2;
+        } else {
+            files++;
+        }
+    }
+
+    for (i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-f") || !strcmp(argv[i], "-s"))
+            ++i;
+        else if (!run_file(argv[i]))
+            return 1;
+    }
+    for (i = 0; !files && tests[i]; ++i)
+        if (!run_file(tests[i]))
+            return 1;
+    if (cases && !run_fuzz(cases))
+        return 1;
+    return 0;
+}
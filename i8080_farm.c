@@ -0,0 +1,241 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifdef __linux__
+#define _GNU_SOURCE     // pthread_setaffinity_np()
+#endif
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "i8080_farm.h"
+
+// A queue of guests of one thread. The owner takes the guests from the
+// head and puts them back at the tail after their slice, so its guests
+// take turns; the other threads steal them from the tail. A guest is in at
+// most one queue, so a ring of `count` slots never overflows.
+struct farm_queue {
+    pthread_mutex_t lock;
+    struct i8080 **slot;
+    int head, size;
+};
+
+struct farm;
+
+struct farm_worker {
+    struct farm *farm;
+    int index;
+    pthread_t thread;
+    struct i8080_farm_stats stats;
+};
+
+struct farm {
+    const struct i8080_farm_config *config;
+    int count;
+    struct farm_queue *queue;
+    struct farm_worker *worker;
+    pthread_mutex_t lock;
+    int remaining;              // The guests not finished yet.
+};
+
+static uns64 farm_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uns64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void farm_push(struct farm *farm, struct farm_queue *q,
+                      struct i8080 *cpu) {
+    pthread_mutex_lock(&q->lock);
+    q->slot[(q->head + q->size) % farm->count] = cpu;
+    q->size += 1;
+    pthread_mutex_unlock(&q->lock);
+}
+
+static struct i8080 *farm_pop(struct farm *farm, struct farm_queue *q) {
+    struct i8080 *cpu = 0;
+    pthread_mutex_lock(&q->lock);
+    if (q->size > 0) {
+        cpu = q->slot[q->head];
+        q->head = (q->head + 1) % farm->count;
+        q->size -= 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return cpu;
+}
+
+static struct i8080 *farm_steal(struct farm *farm, struct farm_queue *q) {
+    struct i8080 *cpu = 0;
+    pthread_mutex_lock(&q->lock);
+    if (q->size > 0) {
+        q->size -= 1;
+        cpu = q->slot[(q->head + q->size) % farm->count];
+    }
+    pthread_mutex_unlock(&q->lock);
+    return cpu;
+}
+
+static int farm_remaining(struct farm *farm) {
+    int remaining;
+    pthread_mutex_lock(&farm->lock);
+    remaining = farm->remaining;
+    pthread_mutex_unlock(&farm->lock);
+    return remaining;
+}
+
+static void farm_pin(int index) {
+#ifdef __linux__
+    long const cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index % (cpus > 0 ? cpus : 1), &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)index;
+#endif
+}
+
+static void *farm_worker(void *arg) {
+    struct farm_worker* const w = (struct farm_worker *)arg;
+    struct farm* const farm = w->farm;
+    const struct i8080_farm_config* const config = farm->config;
+    struct farm_queue* const own = &farm->queue[w->index];
+    uns64 const start = farm_now();
+
+    if (config->pin)
+        farm_pin(w->index);
+
+    for (;;) {
+        struct i8080 *cpu = farm_pop(farm, own);
+        uns64 begin;
+        int alive;
+
+        if (!cpu) {
+            int i;
+            for (i = 1; i < config->threads && !cpu; ++i) {
+                int const victim = (w->index + i) % config->threads;
+                cpu = farm_steal(farm, &farm->queue[victim]);
+            }
+            if (!cpu) {
+                if (farm_remaining(farm) == 0)
+                    break;
+                sched_yield();
+                continue;
+            }
+            w->stats.steals += 1;
+        }
+
+        begin = farm_now();
+        i8080_run(cpu, config->slice, config->stop_mask);
+        alive = 1;
+        if (cpu->stop_reason != I8080_STOP_BUDGET)
+            alive = config->handler ? config->handler(cpu, config->data) : 0;
+        w->stats.busy_ns += farm_now() - begin;
+        w->stats.slices += 1;
+
+        if (alive) {
+            farm_push(farm, own, cpu);
+        } else {
+            pthread_mutex_lock(&farm->lock);
+            farm->remaining -= 1;
+            pthread_mutex_unlock(&farm->lock);
+        }
+    }
+
+    w->stats.wall_ns = farm_now() - start;
+    return 0;
+}
+
+int i8080_farm_run(struct i8080 **cpus, int count,
+                   const struct i8080_farm_config *config,
+                   struct i8080_farm_stats *stats) {
+    int const threads = config->threads > 0 ? config->threads : 1;
+    struct i8080_farm_config actual = *config;
+    struct farm farm;
+    int i, result = 0;
+
+    actual.threads = threads;
+    farm.config = &actual;
+    farm.count = count > 0 ? count : 1;
+    farm.remaining = count;
+    farm.queue = (struct farm_queue *)calloc(threads, sizeof(*farm.queue));
+    farm.worker = (struct farm_worker *)calloc(threads, sizeof(*farm.worker));
+    if (!farm.queue || !farm.worker) {
+        free(farm.queue);
+        free(farm.worker);
+        return -1;
+    }
+    pthread_mutex_init(&farm.lock, 0);
+    for (i = 0; i < threads; ++i) {
+        pthread_mutex_init(&farm.queue[i].lock, 0);
+        farm.queue[i].slot =
+            (struct i8080 **)malloc(farm.count * sizeof(struct i8080 *));
+        if (!farm.queue[i].slot)
+            result = -1;
+        farm.worker[i].farm = &farm;
+        farm.worker[i].index = i;
+    }
+    if (result < 0)
+        goto cleanup;
+    for (i = 0; i < count; ++i)
+        farm_push(&farm, &farm.queue[i % threads], cpus[i]);
+
+    for (i = 1; i < threads; ++i) {
+        if (pthread_create(&farm.worker[i].thread, 0, farm_worker,
+                           &farm.worker[i]) != 0) {
+            farm.worker[i].index = -1;
+            result = -1;
+        }
+    }
+    farm_worker(&farm.worker[0]);
+    for (i = 1; i < threads; ++i) {
+        if (farm.worker[i].index >= 0)
+            pthread_join(farm.worker[i].thread, 0);
+    }
+
+cleanup:
+    for (i = 0; i < threads; ++i) {
+        if (stats)
+            stats[i] = farm.worker[i].stats;
+        pthread_mutex_destroy(&farm.queue[i].lock);
+        free(farm.queue[i].slot);
+    }
+    pthread_mutex_destroy(&farm.lock);
+    free(farm.queue);
+    free(farm.worker);
+    return result;
+}
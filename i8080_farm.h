@@ -0,0 +1,76 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifndef I8080_FARM_H
+#define I8080_FARM_H
+
+#include "i8080.h"
+
+// The farm runs many CPU contexts on a pool of threads. Every guest runs in
+// time slices of `slice` cycles by `i8080_run()`. Between the slices the
+// guests sit in the per-thread queues, and an idle thread steals them from
+// the other threads, so the load spreads evenly even if the guests need
+// very different time.
+
+// Called by the thread running a guest when `i8080_run()` has stopped for
+// one of the reasons in `stop_mask`. Returns non-zero to keep the guest
+// running, zero when it is finished.
+typedef int (*i8080_farm_handler)(struct i8080 *cpu, void *data);
+
+struct i8080_farm_config {
+    int threads;                // The number of threads, at least 1.
+    int slice;                  // The cycles per time slice.
+    int stop_mask;              // Passed to `i8080_run()`.
+    i8080_farm_handler handler;
+    void *data;                 // Passed to the handler.
+    int pin;                    // Pin thread n to the host CPU n (Linux).
+};
+
+// What every thread has done.
+struct i8080_farm_stats {
+    uns64 busy_ns;              // Time spent running guests and handlers.
+    uns64 wall_ns;              // Time the thread has existed.
+    uns64 slices;
+    uns64 steals;               // Guests taken from other threads.
+};
+
+// Runs the guests until the handler finishes each of them. The guests are
+// dealt out to the threads at the start, and the calling thread is the
+// thread 0. `stats`, if not 0, receives `config->threads` entries. Returns
+// 0, or -1 if some thread could not be created; the guests are finished by
+// the other threads anyway.
+extern int i8080_farm_run(struct i8080 **cpus, int count,
+    const struct i8080_farm_config *config, struct i8080_farm_stats *stats);
+
+#endif
@@ -31,41 +31,43 @@
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 
+#include "i8080.h"
 #include "i8080_hal.h"
 
-unsigned char memory[0x10000];
+// The test HAL binds each CPU to a flat 64K array pointed by `cpu->hal`.
+#define MEMORY(cpu) ((unsigned char *)(cpu)->hal)
 
-int i8080_hal_memory_read_word(int addr) {
+int i8080_hal_memory_read_word(struct i8080 *cpu, int addr) {
     return 
-        (i8080_hal_memory_read_byte(addr + 1) << 8) |
-        i8080_hal_memory_read_byte(addr);
+        (i8080_hal_memory_read_byte(cpu, addr + 1) << 8) |
+        i8080_hal_memory_read_byte(cpu, addr);
 }
 
-void i8080_hal_memory_write_word(int addr, int word) {
-    i8080_hal_memory_write_byte(addr, word & 0xff);
-    i8080_hal_memory_write_byte(addr + 1, (word >> 8) & 0xff);
+void i8080_hal_memory_write_word(struct i8080 *cpu, int addr, int word) {
+    i8080_hal_memory_write_byte(cpu, addr, word & 0xff);
+    i8080_hal_memory_write_byte(cpu, addr + 1, (word >> 8) & 0xff);
 }
 
-int i8080_hal_memory_read_byte(int addr) {
-    return memory[addr & 0xffff];
+int i8080_hal_memory_read_byte(struct i8080 *cpu, int addr) {
+    return MEMORY(cpu)[addr & 0xffff];
 }
 
-void i8080_hal_memory_write_byte(int addr, int byte) {
-    memory[addr & 0xffff] = byte;
+void i8080_hal_memory_write_byte(struct i8080 *cpu, int addr, int byte) {
+    MEMORY(cpu)[addr & 0xffff] = byte;
 }
 
-int i8080_hal_io_input(int port) {
+int i8080_hal_io_input(struct i8080 *cpu, int port) {
     return 0;
 }
 
-void i8080_hal_io_output(int port, int value) {
+void i8080_hal_io_output(struct i8080 *cpu, int port, int value) {
     // Nothing.
 }
 
-void i8080_hal_iff(int on) {
+void i8080_hal_iff(struct i8080 *cpu, int on) {
     // Northing.
 }
 
-unsigned char* i8080_hal_memory(void) {
-    return &memory[0];
+unsigned char* i8080_hal_memory(struct i8080 *cpu) {
+    return MEMORY(cpu);
 }
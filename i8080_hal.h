@@ -34,17 +34,19 @@
 #ifndef I8080_HAL_H
 #define I8080_HAL_H
 
-extern int i8080_hal_memory_read_word(int addr);
-extern void i8080_hal_memory_write_word(int addr, int word);
+struct i8080;
 
-extern int i8080_hal_memory_read_byte(int addr);
-extern void i8080_hal_memory_write_byte(int addr, int byte);
+extern int i8080_hal_memory_read_word(struct i8080 *cpu, int addr);
+extern void i8080_hal_memory_write_word(struct i8080 *cpu, int addr, int word);
 
-extern int i8080_hal_io_input(int port);
-extern void i8080_hal_io_output(int port, int value);
+extern int i8080_hal_memory_read_byte(struct i8080 *cpu, int addr);
+extern void i8080_hal_memory_write_byte(struct i8080 *cpu, int addr, int byte);
 
-extern void i8080_hal_iff(int on);
+extern int i8080_hal_io_input(struct i8080 *cpu, int port);
+extern void i8080_hal_io_output(struct i8080 *cpu, int port, int value);
 
-extern unsigned char* i8080_hal_memory(void);
+extern void i8080_hal_iff(struct i8080 *cpu, int on);
+
+extern unsigned char* i8080_hal_memory(struct i8080 *cpu);
 
 #endif
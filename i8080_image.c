@@ -0,0 +1,116 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define IMAGE_MMAP
+#endif
+
+#include "i8080_image.h"
+
+#define IMAGE_PAGES(size) (((size) + 0xff) & ~0xffL)
+
+// Reads the file into a buffer when it cannot be mapped.
+static int image_read(struct i8080_image *image, const char *path) {
+    FILE* const f = fopen(path, "rb");
+    long size;
+    if (!f)
+        return -1;
+    if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0 ||
+        fseek(f, 0, SEEK_SET) != 0) {
+        fclose(f);
+        return -1;
+    }
+    image->length = IMAGE_PAGES(size) ? IMAGE_PAGES(size) : 0x100;
+    image->data = (uns8 *)calloc(image->length, 1);
+    if (!image->data || fread(image->data, 1, size, f) != (size_t)size) {
+        free(image->data);
+        image->data = 0;
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    image->size = size;
+    image->mapped = 0;
+    return 0;
+}
+
+int i8080_image_open(struct i8080_image *image, const char *path,
+    int flags) {
+#ifdef IMAGE_MMAP
+    struct stat st;
+    void *data;
+    int const fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return image_read(image, path);
+    }
+    // The part of the last host page past the end of the file reads as
+    // zeros, and the host pages are multiples of 256 bytes.
+    data = mmap(0, IMAGE_PAGES(st.st_size),
+        PROT_READ | (flags & I8080_IMAGE_WRITABLE ? PROT_WRITE : 0),
+        MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return image_read(image, path);
+    image->data = (uns8 *)data;
+    image->size = (long)st.st_size;
+    image->length = IMAGE_PAGES(st.st_size);
+    image->mapped = 1;
+    return 0;
+#else
+    (void)flags;
+    return image_read(image, path);
+#endif
+}
+
+void i8080_image_close(struct i8080_image *image) {
+#ifdef IMAGE_MMAP
+    if (image->mapped)
+        munmap(image->data, image->length);
+    else
+#endif
+        free(image->data);
+    image->data = 0;
+    image->size = image->length = 0;
+}
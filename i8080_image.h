@@ -0,0 +1,68 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifndef I8080_IMAGE_H
+#define I8080_IMAGE_H
+
+#include "i8080.h"
+
+// A ROM or disk image file mapped into the host memory. On POSIX systems
+// the file is mapped by mmap(), so opening it copies nothing and all the
+// guests using the same file share the pages of the host page cache;
+// elsewhere it is read into an allocated buffer.
+//
+// The image is padded with zeros to whole 256-byte pages, so it can be
+// put straight into the page table of a CPU:
+//
+//     i8080_image_open(&rom, "BIOS.ROM", 0);
+//     i8080_map(&cpu, 0xF800, rom.size, rom.data, I8080_PAGE_READ);
+struct i8080_image {
+    uns8 *data;
+    long size;                  // The size of the file.
+    long length;                // The size of `data`.
+    int mapped;
+};
+
+// The image may be written to. The writes are private to the process and
+// never reach the file; the host copies the pages written to. Without
+// this flag the image is read-only, and only mapped by I8080_PAGE_READ.
+#define I8080_IMAGE_WRITABLE    0x01
+
+// Opens the image, returns 0 or -1 if the file cannot be read.
+extern int i8080_image_open(struct i8080_image *image, const char *path,
+    int flags);
+
+extern void i8080_image_close(struct i8080_image *image);
+
+#endif
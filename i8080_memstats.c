@@ -0,0 +1,75 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#include "i8080_memstats.h"
+
+void i8080_memstats_write(const struct i8080_memstats *stats, FILE *file) {
+    int page;
+    fprintf(file, "Page        reads       writes      fetches  code writes\n");
+    for (page = 0; page < 256; ++page) {
+        if (!stats->reads[page] && !stats->writes[page] &&
+            !stats->fetches[page])
+            continue;
+        fprintf(file, "%02XXX %12lu %12lu %12lu %12lu\n", page,
+            (unsigned long)stats->reads[page],
+            (unsigned long)stats->writes[page],
+            (unsigned long)stats->fetches[page],
+            (unsigned long)stats->code_writes[page]);
+    }
+    if (stats->code_writes[stats->code_write_addr >> 8])
+        fprintf(file, "Last write into code: %04X from %04X\n",
+            stats->code_write_addr, stats->code_write_pc);
+}
+
+#if I8080_EVENTS > 0
+
+static void memstats_dump(struct i8080 *cpu, void *data) {
+    struct i8080_memstats_dump* const dump =
+        (struct i8080_memstats_dump *)data;
+    fprintf(dump->file, "Cycles %llu\n",
+        (unsigned long long)i8080_cycles(cpu));
+    i8080_memstats_write(dump->stats, dump->file);
+    fflush(dump->file);
+    i8080_schedule(cpu, i8080_cycles(cpu) + dump->period, memstats_dump,
+        dump);
+}
+
+void i8080_memstats_dump(struct i8080 *cpu, struct i8080_memstats_dump *dump) {
+    i8080_cancel(cpu, memstats_dump, dump);
+    if (dump->period)
+        i8080_schedule(cpu, i8080_cycles(cpu) + dump->period, memstats_dump,
+            dump);
+}
+
+#endif
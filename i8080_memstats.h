@@ -0,0 +1,65 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifndef I8080_MEMSTATS_H
+#define I8080_MEMSTATS_H
+
+#include <stdio.h>
+
+#include "i8080.h"
+
+#ifndef I8080_MEMSTATS
+#error "The memory statistics need the core built with I8080_MEMSTATS"
+#endif
+
+// Writes a line per page accessed in `stats`: its reads, writes, fetches
+// and writes into code, then the last write into code, if any.
+extern void i8080_memstats_write(const struct i8080_memstats *stats,
+    FILE *file);
+
+#if I8080_EVENTS > 0
+// The periodic dump of `stats` into `file` every `period` cycles.
+struct i8080_memstats_dump {
+    struct i8080_memstats *stats;
+    FILE *file;
+    uns64 period;
+};
+
+// Starts writing the cycle count and the statistics of `dump` every
+// period from now, using an event, or stops if the period is 0.
+extern void i8080_memstats_dump(struct i8080 *cpu,
+    struct i8080_memstats_dump *dump);
+#endif
+
+#endif
@@ -0,0 +1,129 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#include <stdlib.h>
+
+#include "i8080_profile.h"
+
+static void profile_write_path(const struct i8080_profile *profile, int n,
+    FILE *file) {
+    if (n) {
+        profile_write_path(profile, profile->node[n].parent, file);
+        fputc(';', file);
+    }
+    fprintf(file, "%04X", profile->node[n].addr);
+}
+
+void i8080_profile_write_folded(const struct i8080_profile *profile,
+    FILE *file) {
+    int n;
+    for (n = 0; n < profile->nodes; ++n) {
+        if (!profile->node[n].cycles)
+            continue;
+        profile_write_path(profile, n, file);
+        fprintf(file, " %llu\n",
+            (unsigned long long)profile->node[n].cycles);
+    }
+}
+
+// Picks the indices of the `top` biggest of `count` values into `index`
+// and returns how many there are (the zero values are skipped).
+static int profile_top(const uns64 *value, int count, int top, int *index) {
+    int found = 0, i, j;
+    for (i = 0; i < count; ++i) {
+        if (!value[i] ||
+            (found == top && value[index[top - 1]] >= value[i]))
+            continue;
+        j = found < top ? found++ : top - 1;
+        for (; j > 0 && value[index[j - 1]] < value[i]; --j)
+            index[j] = index[j - 1];
+        index[j] = i;
+    }
+    return found;
+}
+
+// The values of the opcodes are followed by their mnemonics.
+static void profile_write_top(FILE *file, const char *title,
+    const char *format, const uns64 *value, int count, int top,
+    int opcodes) {
+    int* const index = (int *)malloc(top * sizeof(int));
+    int found, i;
+    if (!index)
+        return;
+    found = profile_top(value, count, top, index);
+    fprintf(file, "%s\n", title);
+    for (i = 0; i < found; ++i) {
+        fprintf(file, format, index[i]);
+        fprintf(file, " %12llu", (unsigned long long)value[index[i]]);
+        if (opcodes)
+            fprintf(file, "  %s", i8080_opcodes[index[i]].mnemonic);
+        fputc('\n', file);
+    }
+    free(index);
+}
+
+void i8080_profile_write_report(const struct i8080_profile *profile,
+    FILE *file, int top) {
+    uns64* const value = (uns64 *)calloc(0x10000, sizeof(uns64));
+    int i;
+    if (!value || top <= 0) {
+        free(value);
+        return;
+    }
+
+    for (i = 0; i < 0x10000; ++i)
+        value[i] = profile->pc_count[i];
+    profile_write_top(file, "Address  executions", "%04X   ", value,
+        0x10000, top, 0);
+
+    for (i = 0; i < 256; ++i)
+        value[i] = profile->opcode_count[i];
+    profile_write_top(file, "Opcode   executions", "%02X     ", value,
+        256, top, 1);
+    profile_write_top(file, "Opcode       cycles", "%02X     ",
+        profile->opcode_cycles, 256, top, 1);
+
+    for (i = 0; i < 0x10000; ++i)
+        value[i] = 0;
+    for (i = 0; i < profile->nodes; ++i)
+        value[profile->node[i].addr] += profile->node[i].cycles;
+    profile_write_top(file, "Routine      cycles", "%04X   ", value,
+        0x10000, top, 0);
+
+    for (i = 0; i < 256; ++i)
+        value[i] = (uns64)profile->reads[i] + profile->writes[i];
+    profile_write_top(file, "Page       accesses", "%02XXX   ", value,
+        256, top, 0);
+    free(value);
+}
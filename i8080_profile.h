@@ -0,0 +1,58 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifndef I8080_PROFILE_H
+#define I8080_PROFILE_H
+
+#include <stdio.h>
+
+#include "i8080.h"
+
+#ifndef I8080_PROFILE
+#error "The profile needs the core built with I8080_PROFILE"
+#endif
+
+// Writes the call tree of `profile` in the folded format of the flame
+// graph tools (flamegraph.pl, speedscope, inferno): a line per call path,
+// the hexadecimal addresses of its routines from the outermost one
+// separated by `;`, then the cycles spent in the innermost routine.
+extern void i8080_profile_write_folded(const struct i8080_profile *profile,
+    FILE *file);
+
+// Writes the `top` hottest instruction addresses, opcodes, routines (self
+// cycles over all their call paths) and memory pages of `profile`.
+extern void i8080_profile_write_report(const struct i8080_profile *profile,
+    FILE *file, int top);
+
+#endif
@@ -0,0 +1,129 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i8080_image.h"
+#include "i8080_replay.h"
+
+struct i8080_replay_file {
+    struct i8080_replay replay;
+    struct i8080 *cpu;
+    FILE *file;                 // When recording.
+    struct i8080_image image;   // When playing.
+    long written;
+    int error;
+};
+
+static void replay_flush(struct i8080 *cpu, struct i8080_replay *replay) {
+    struct i8080_replay_file* const file =
+        (struct i8080_replay_file *)replay->data;
+    (void)cpu;
+    if (fwrite(replay->log, 1, replay->length, file->file) !=
+        (size_t)replay->length)
+        file->error = 1;
+    file->written += replay->length;
+    replay->length = 0;
+}
+
+struct i8080_replay_file *i8080_replay_open(const char *path, int mode,
+    int size) {
+    struct i8080_replay_file* const file =
+        (struct i8080_replay_file *)calloc(1, sizeof(*file));
+    if (!file)
+        return 0;
+    file->replay.mode = mode;
+    file->replay.data = file;
+    if (mode == I8080_REPLAY_RECORD) {
+        if (size < I8080_REPLAY_ITEM)
+            size = I8080_REPLAY_ITEM;
+        file->replay.log = (uns8 *)malloc(size);
+        file->replay.size = size;
+        file->replay.flush = replay_flush;
+        file->file = fopen(path, "wb");
+        if (!file->replay.log || !file->file ||
+            fwrite(I8080_REPLAY_MAGIC, 1, 8, file->file) != 8)
+            goto fail;
+        return file;
+    }
+    if (mode == I8080_REPLAY_PLAY &&
+        i8080_image_open(&file->image, path, 0) == 0) {
+        if (file->image.size >= 8 &&
+            memcmp(file->image.data, I8080_REPLAY_MAGIC, 8) == 0) {
+            file->replay.log = file->image.data + 8;
+            file->replay.size = file->image.size - 8;
+            file->replay.length = file->replay.size;
+            return file;
+        }
+        i8080_image_close(&file->image);
+    }
+
+fail:
+    if (file->file)
+        fclose(file->file);
+    free(mode == I8080_REPLAY_RECORD ? file->replay.log : 0);
+    free(file);
+    return 0;
+}
+
+void i8080_replay_start(struct i8080_replay_file *file, struct i8080 *cpu) {
+    if (file->cpu)
+        i8080_replay_attach(file->cpu, 0);
+    file->cpu = cpu;
+    i8080_replay_attach(cpu, &file->replay);
+}
+
+long i8080_replay_close(struct i8080_replay_file *file) {
+    long bytes;
+    if (file->cpu)
+        i8080_replay_attach(file->cpu, 0);
+    if (file->file) {
+        if (file->replay.length)
+            replay_flush(file->cpu, &file->replay);
+        if (fclose(file->file) != 0)
+            file->error = 1;
+        free(file->replay.log);
+        bytes = file->written;
+    } else {
+        i8080_image_close(&file->image);
+        bytes = file->replay.pos;
+        if (file->replay.diverged)
+            file->error = 1;
+    }
+    bytes = file->error ? -1 : bytes;
+    free(file);
+    return bytes;
+}
@@ -0,0 +1,71 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifndef I8080_REPLAY_H
+#define I8080_REPLAY_H
+
+#include "i8080.h"
+
+#ifndef I8080_REPLAY
+#error "The replay files need the core built with I8080_REPLAY"
+#endif
+
+// The replay files keep the log of a CPU (see `struct i8080_replay`) on
+// disk. A recording writes the log out every `size` bytes, so a session
+// of hours needs only a small buffer; a replay maps the whole file by
+// `i8080_image_open()` and plays it in place.
+//
+// The file is I8080_REPLAY_MAGIC followed by the items of the log.
+
+#define I8080_REPLAY_MAGIC      "I8080RPL"
+
+struct i8080_replay_file;
+
+// Creates the file `path` to record into (I8080_REPLAY_RECORD) with a
+// buffer of `size` bytes, or opens it to play (I8080_REPLAY_PLAY).
+// Returns 0 on failure.
+extern struct i8080_replay_file *i8080_replay_open(const char *path,
+    int mode, int size);
+
+// Starts recording or playing `cpu` from now, see `i8080_replay_attach()`.
+// A file is used by one CPU at a time.
+extern void i8080_replay_start(struct i8080_replay_file *file,
+    struct i8080 *cpu);
+
+// Stops the CPU recording or playing, and closes the file. Returns the
+// bytes of the log written or played, or -1 on a write error or if the
+// guest diverged from the log.
+extern long i8080_replay_close(struct i8080_replay_file *file);
+
+#endif
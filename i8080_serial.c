@@ -0,0 +1,320 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#include <string.h>
+
+#include "i8080_serial.h"
+
+#define PAGE_BIT(bits, page)    ((bits)[(page) >> 3] & (1 << ((page) & 7)))
+
+static uns8 *put16(uns8 *p, unsigned value) {
+    p[0] = (uns8)(value & 0xff);
+    p[1] = (uns8)((value >> 8) & 0xff);
+    return p + 2;
+}
+
+static unsigned get16(const uns8 *p) {
+    return p[0] | ((unsigned)p[1] << 8);
+}
+
+static int zero_page(const uns8 *data) {
+    int n;
+    for (n = 0; n < 256; ++n) {
+        if (data[n])
+            return 0;
+    }
+    return 1;
+}
+
+// Packs a page as runs of literals (a byte c < 128 and c + 1 bytes) and
+// matches of earlier bytes of the page (a byte c >= 128, the length is
+// c - 128 + 3, and a byte o, the distance is o + 1). Returns the size, or
+// 256 if the page does not shrink.
+static int pack_page(const uns8 *data, uns8 *out) {
+    int head[256], prev[256];
+    int pos = 0, size = 0, literals = 0, n;
+    for (n = 0; n < 256; ++n)
+        head[n] = -1;
+    while (pos < 256) {
+        int best = 0, from = 0, chain = 16, length;
+        if (pos + 3 <= 256) {
+            const int hash = (data[pos] * 33 + data[pos + 1]) * 33 +
+                data[pos + 2];
+            int match;
+            for (match = head[hash & 0xff]; match >= 0 && chain > 0;
+                 match = prev[match], --chain) {
+                for (length = 0; pos + length < 256 && length < 130 &&
+                     data[match + length] == data[pos + length]; ++length)
+                    ;
+                if (length > best) {
+                    best = length;
+                    from = match;
+                }
+            }
+        }
+        length = best >= 3 ? best : 1;
+        if (best < 3) {
+            if (literals == 0 || out[literals - 1] == 127) {
+                if (size + 2 > 255)
+                    return 256;
+                literals = size + 1;
+                out[size++] = 0;
+            } else {
+                if (size + 1 > 255)
+                    return 256;
+                out[literals - 1] += 1;
+            }
+            out[size++] = data[pos];
+        } else {
+            if (size + 2 > 255)
+                return 256;
+            out[size++] = (uns8)(128 + best - 3);
+            out[size++] = (uns8)(pos - from - 1);
+            literals = 0;
+        }
+        // Index the positions passed over.
+        for (n = pos; n < pos + length && n + 3 <= 256; ++n) {
+            const int hash = ((data[n] * 33 + data[n + 1]) * 33 +
+                data[n + 2]) & 0xff;
+            prev[n] = head[hash];
+            head[hash] = n;
+        }
+        pos += length;
+    }
+    return size;
+}
+
+static int unpack_page(const uns8 *in, int size, uns8 *data) {
+    int pos = 0, n = 0;
+    while (n < size) {
+        const int c = in[n++];
+        if (c < 128) {
+            if (n + c + 1 > size || pos + c + 1 > 256)
+                return -1;
+            memcpy(data + pos, in + n, c + 1);
+            pos += c + 1;
+            n += c + 1;
+        } else {
+            int length = c - 128 + 3, from;
+            if (n >= size)
+                return -1;
+            from = pos - in[n++] - 1;
+            if (from < 0 || pos + length > 256)
+                return -1;
+            // The copies overlap for the runs of a byte, by byte.
+            for (; length > 0; --length)
+                data[pos++] = data[from++];
+        }
+    }
+    return pos == 256 ? 0 : -1;
+}
+
+int i8080_serial_write(const struct i8080_snapshot *snapshot,
+    const struct i8080_snapshot *base, int flags,
+    i8080_serial_output output, void *data) {
+    const struct i8080_state* const state = &snapshot->state;
+    uns8 header[80], record[4 + 256];
+    uns8 *p = header;
+    int page;
+
+    flags &= I8080_SERIAL_PACK;
+    if (base)
+        flags |= I8080_SERIAL_DELTA;
+#ifdef I8080_8085
+    flags |= I8080_SERIAL_8085;
+#endif
+    memcpy(p, "I80S", 4);
+    p[4] = I8080_SERIAL_VERSION;
+    p[5] = (uns8)flags;
+    p = put16(p + 6, state->af);
+    p = put16(p, state->bc);
+    p = put16(p, state->de);
+    p = put16(p, state->hl);
+    p = put16(p, state->sp);
+    p = put16(p, state->pc);
+    p = put16(p, state->iff);
+    p = put16(p, state->last_pc);
+    p = put16(p, (unsigned)state->irq);
+    *p++ = state->pending;
+    *p++ = state->halted;
+    p = put16(p, (unsigned)(state->cycles & 0xffff));
+    p = put16(p, (unsigned)((state->cycles >> 16) & 0xffff));
+    p = put16(p, (unsigned)((state->cycles >> 32) & 0xffff));
+    p = put16(p, (unsigned)((state->cycles >> 48) & 0xffff));
+#ifdef I8080_8085
+    *p++ = state->lines;
+    *p++ = state->latched;
+    *p++ = state->masks;
+    *p++ = state->sod;
+    *p++ = state->trap_ie;
+#endif
+    memset(p, 0, 32);
+    for (page = 0; page < 256; ++page) {
+        if (snapshot->page[page])
+            p[page >> 3] |= (uns8)(1 << (page & 7));
+    }
+    p += 32;
+    if (output(data, header, (int)(p - header)) != 0)
+        return -1;
+
+    for (page = 0; page < 256; ++page) {
+        const struct i8080_page* const q = snapshot->page[page];
+        int size;
+        if (!q || (base && base->page[page] == q))
+            continue;
+        record[1] = (uns8)page;
+        if (zero_page(q->data)) {
+            // Zero is what a full stream leaves out.
+            if (!base)
+                continue;
+            record[0] = I8080_SERIAL_ZERO;
+            size = 2;
+        } else if ((flags & I8080_SERIAL_PACK) &&
+                   (size = pack_page(q->data, record + 4)) < 256) {
+            record[0] = I8080_SERIAL_PACKED;
+            put16(record + 2, size);
+            size += 4;
+        } else {
+            record[0] = I8080_SERIAL_RAW;
+            memcpy(record + 2, q->data, 256);
+            size = 2 + 256;
+        }
+        if (output(data, record, size) != 0)
+            return -1;
+    }
+    record[0] = I8080_SERIAL_END;
+    return output(data, record, 1);
+}
+
+int i8080_serial_read(struct i8080 *cpu, i8080_serial_input input,
+    void *data) {
+    struct i8080_state state;
+    uns8 header[80], bits[32], seen[32], record[256], page_data[256];
+    uns8 *p = header;
+    int flags, page, size;
+#ifdef I8080_8085
+    const int size_state = 6 + 2 * 9 + 2 + 8 + 5;
+#else
+    const int size_state = 6 + 2 * 9 + 2 + 8;
+#endif
+
+    if (input(data, header, size_state) != 0 ||
+        memcmp(header, "I80S", 4) != 0 ||
+        header[4] != I8080_SERIAL_VERSION)
+        return -1;
+    flags = header[5];
+#ifdef I8080_8085
+    if (!(flags & I8080_SERIAL_8085))
+        return -1;
+#else
+    if (flags & I8080_SERIAL_8085)
+        return -1;
+#endif
+    p += 6;
+    state.af = (uns16)get16(p);
+    state.bc = (uns16)get16(p + 2);
+    state.de = (uns16)get16(p + 4);
+    state.hl = (uns16)get16(p + 6);
+    state.sp = (uns16)get16(p + 8);
+    state.pc = (uns16)get16(p + 10);
+    state.iff = (uns16)get16(p + 12);
+    state.last_pc = (uns16)get16(p + 14);
+    state.irq = (int)get16(p + 16);
+    state.pending = p[18];
+    state.halted = p[19];
+    state.cycles = get16(p + 20) | ((uns64)get16(p + 22) << 16) |
+        ((uns64)get16(p + 24) << 32) | ((uns64)get16(p + 26) << 48);
+#ifdef I8080_8085
+    state.lines = p[28];
+    state.latched = p[29];
+    state.masks = p[30];
+    state.sod = p[31];
+    state.trap_ie = p[32];
+#endif
+    if (input(data, bits, 32) != 0)
+        return -1;
+    i8080_restore(cpu, &state);
+
+    memset(seen, 0, 32);
+    while (1) {
+        if (input(data, record, 1) != 0)
+            return -1;
+        if (record[0] == I8080_SERIAL_END)
+            break;
+        if (input(data, record + 1, 1) != 0)
+            return -1;
+        page = record[1];
+        if (!PAGE_BIT(bits, page) || PAGE_BIT(seen, page))
+            return -1;
+        seen[page >> 3] |= (uns8)(1 << (page & 7));
+        switch (record[0]) {
+        case I8080_SERIAL_RAW:
+            if (input(data, page_data, 256) != 0)
+                return -1;
+            break;
+        case I8080_SERIAL_PACKED:
+            if (input(data, record, 2) != 0)
+                return -1;
+            size = (int)get16(record);
+            if (size >= 256 || input(data, record, size) != 0 ||
+                unpack_page(record, size, page_data) != 0)
+                return -1;
+            break;
+        case I8080_SERIAL_ZERO:
+            memset(page_data, 0, 256);
+            break;
+        default:
+            return -1;
+        }
+        if (i8080_snapshot_map(cpu, page << 8, 0x100, page_data) != 0)
+            return -1;
+    }
+
+    for (page = 0; page < 256; ++page) {
+        if (PAGE_BIT(seen, page))
+            continue;
+        if (!PAGE_BIT(bits, page)) {
+            // Not RAM of the snapshot: back to what the host maps.
+            if (cpu->cow[page])
+                i8080_map(cpu, page << 8, 0x100, 0, 0);
+        } else if (flags & I8080_SERIAL_DELTA) {
+            // Unchanged from the base the CPU is restored from.
+            if (!cpu->cow[page])
+                return -1;
+        } else if (i8080_snapshot_map(cpu, page << 8, 0x100, 0) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifndef I8080_SERIAL_H
+#define I8080_SERIAL_H
+
+#include "i8080.h"
+
+#ifndef I8080_SNAPSHOT
+#error "The serialized state needs the core built with I8080_SNAPSHOT"
+#endif
+
+// The serialized state of a machine, to move a guest to another host. The
+// stream holds the CPU state of a snapshot and its copy-on-write pages,
+// all numbers are little endian, so it reads back on any host:
+//
+//     "I80S", version, flags (I8080_SERIAL_xxx)
+//     af, bc, de, hl, sp, pc, iff, last_pc, irq     16 bits each
+//     pending, halted                               8 bits each
+//     cycles                                        64 bits
+//     lines, latched, masks, sod, trap_ie           with I8080_SERIAL_8085
+//     the copy-on-write pages, a bit per page       32 bytes
+//     records of their contents, then a 0 byte
+//
+// A record is its kind, the page number, and the contents: 256 bytes for
+// I8080_SERIAL_RAW, a 16-bit size and the packed bytes for
+// I8080_SERIAL_PACKED, nothing for I8080_SERIAL_ZERO. The pages left out
+// are zero, or unchanged in a delta from a base snapshot, so a mostly
+// empty guest takes little more than its header. The other pages (ROM,
+// devices) are not part of the state: the host maps them as before.
+#define I8080_SERIAL_VERSION    1
+
+// The flags of the stream.
+#define I8080_SERIAL_PACK       0x01    // Pack the pages if they shrink.
+#define I8080_SERIAL_DELTA      0x02    // Only the pages changed from a base.
+#define I8080_SERIAL_8085       0x04
+
+// The kinds of the records.
+#define I8080_SERIAL_END        0
+#define I8080_SERIAL_RAW        1
+#define I8080_SERIAL_PACKED     2
+#define I8080_SERIAL_ZERO       3
+
+// Called with the next `size` bytes of the stream. Return 0, or -1 to
+// stop with an error.
+typedef int (*i8080_serial_output)(void *data, const uns8 *bytes, int size);
+typedef int (*i8080_serial_input)(void *data, uns8 *bytes, int size);
+
+// Writes `snapshot` to `output`, packing the pages with I8080_SERIAL_PACK.
+// If `base` is not 0, only the pages not shared with it are written, so
+// the stream reads back over a CPU restored from the same base. Nothing
+// is allocated. Returns 0, or -1 if `output` fails.
+extern int i8080_serial_write(const struct i8080_snapshot *snapshot,
+    const struct i8080_snapshot *base, int flags,
+    i8080_serial_output output, void *data);
+
+// Reads a stream from `input` into `cpu`: its state, and the pages put in
+// fresh copy-on-write pages by `i8080_snapshot_map()`. Returns 0, or -1
+// if `input` fails, the stream is not valid for this build, a delta comes
+// with a page the CPU does not have, or a page cannot be allocated.
+extern int i8080_serial_read(struct i8080 *cpu, i8080_serial_input input,
+    void *data);
+
+#endif
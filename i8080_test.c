@@ -36,65 +36,1510 @@
 #include <string.h>
 
 #include "i8080.h"
+#include "i8080_cpm.h"
 #include "i8080_hal.h"
+#include "i8080_image.h"
 
-void load_file(const char* name, unsigned char* load_to) {
-    FILE* f = fopen(name, "r+b");
-    int sz;
-    if (!f) {
+// Opens the program, mapped into the memory if possible.
+static void open_file(const char* name, struct i8080_image* image,
+    int flags) {
+    if (i8080_image_open(image, name, flags) != 0) {
         fprintf(stderr, "Unable to open file \"%s\"\n", name);
         exit(1);
     }
-    sz = 0;
-    while (!feof(f)) {
-        int const read = fread((void *)load_to, 1, 1024, f);
-        if (read == 0) break;
-        sz += read;
-        load_to += read;
-    }
     printf("\n*********************************\n");
-    printf("File \"%s\" loaded, size %d\n", name, sz);
+    printf("File \"%s\" loaded, size %ld\n", name, image->size);
+}
+
+void load_file(const char* name, unsigned char* load_to) {
+    struct i8080_image image;
+    open_file(name, &image, 0);
+    memcpy(load_to, image.data, image.size);
+    i8080_image_close(&image);
+}
+
+static unsigned char memory[0x10000];
+#if I8080_LANES > 0 || defined(I8080_FARM) || \
+    defined(I8080_TRACE) || defined(I8080_PROFILE)
+static unsigned char traps[I8080_ADDR_MAP_SIZE];
+#endif
+#ifdef I8080_BLOCK_CACHE
+static struct i8080_blocks blocks;
+#endif
+
+// The guest memory, as the guest sees it.
+#ifdef I8080_PAGE_TABLE
+#define PEEK(addr) (cpu.page[((addr) >> 8) & 0xff][(addr) & 0xff])
+#else
+#define PEEK(addr) (mem[addr])
+#endif
+
+#ifdef I8080_SNAPSHOT
+
+#include "i8080_serial.h"
+
+static unsigned char stream[0x20000];
+static int stream_size, stream_pos;
+
+static int stream_output(void *data, const uns8 *bytes, int size) {
+    (void)data;
+    if (stream_size + size > (int)sizeof(stream))
+        return -1;
+    memcpy(stream + stream_size, bytes, size);
+    stream_size += size;
+    return 0;
+}
+
+static int stream_input(void *data, uns8 *bytes, int size) {
+    (void)data;
+    if (stream_pos + size > stream_size)
+        return -1;
+    memcpy(bytes, stream + stream_pos, size);
+    stream_pos += size;
+    return 0;
+}
+
+// Reads the stream into `copy` and compares it with the snapshot.
+static int serial_check(struct i8080 *copy, struct i8080_snapshot *end) {
+    struct i8080_state state;
+    int addr;
+    stream_pos = 0;
+    if (i8080_serial_read(copy, stream_input, 0) != 0 ||
+        stream_pos != stream_size)
+        return 1;
+    memset(&state, 0, sizeof(state));
+    i8080_save(copy, &state);
+    if (memcmp(&state, &end->state, sizeof(state)) != 0)
+        return 1;
+    for (addr = 0; addr < 0x10000; ++addr) {
+        if (copy->page[addr >> 8][addr & 0xff] !=
+            end->page[addr >> 8]->data[addr & 0xff])
+            return 1;
+    }
+    return 0;
+}
+
+// Moves the state at the end of a test to other CPUs: the whole machine
+// into a new one, and the pages written into one forked from the start.
+static void execute_serial(struct i8080 *cpu, struct i8080_snapshot *start) {
+    struct i8080_snapshot end;
+    struct i8080 copy;
+    int failed = 0, full;
+
+    memset(&end.state, 0, sizeof(end.state));
+    i8080_snapshot_take(cpu, &end);
+    copy.hal = memory;
+    i8080_init(&copy);
+    i8080_map(&copy, 0, 0x10000, memory, I8080_PAGE_READ | I8080_PAGE_WRITE);
+    stream_size = 0;
+    if (i8080_serial_write(&end, 0, I8080_SERIAL_PACK, stream_output, 0) != 0 ||
+        serial_check(&copy, &end))
+        failed = 1;
+    full = stream_size;
+    i8080_snapshot_unmap(&copy);
+
+    i8080_init(&copy);
+    i8080_map(&copy, 0, 0x10000, memory, I8080_PAGE_READ | I8080_PAGE_WRITE);
+    i8080_snapshot_restore(&copy, start);
+    stream_size = 0;
+    if (i8080_serial_write(&end, start, I8080_SERIAL_PACK, stream_output,
+            0) != 0 || serial_check(&copy, &end))
+        failed = 1;
+    i8080_snapshot_unmap(&copy);
+    i8080_snapshot_release(&end);
+
+    printf("Serial state %s, %d bytes, %d bytes from the start\n",
+        failed ? "failed" : "OK", full, stream_size);
+    if (failed)
+        exit(1);
 }
 
+#endif
+
 void execute_test(const char* filename, int success_check) {
-    unsigned char* mem = i8080_hal_memory();
-    int success = 0;
+    struct i8080 cpu;
+    struct i8080_cpm cpm;
+    unsigned char* mem;
+#ifdef I8080_SNAPSHOT
+    struct i8080_snapshot start;
+    int addr;
+#elif defined(I8080_PAGE_TABLE)
+    struct i8080_image image;
+#endif
+
+    cpu.hal = memory;
+    mem = i8080_hal_memory(&cpu);
 
     memset(mem, 0, 0x10000);
+#if defined(I8080_PAGE_TABLE) && !defined(I8080_SNAPSHOT)
+    open_file(filename, &image, I8080_IMAGE_WRITABLE);
+#else
     load_file(filename, mem + 0x100);
+#endif
+
+    i8080_init(&cpu);
+#ifdef I8080_PAGE_TABLE
+    i8080_map(&cpu, 0, 0x10000, mem, I8080_PAGE_READ | I8080_PAGE_WRITE);
+#endif
+    // The tests call the BDOS at 0005, and end by the jump to 0000.
+    i8080_cpm_init(&cpm, stdin, stdout, ".");
+    i8080_cpm_attach(&cpm, &cpu);
+#if defined(I8080_SNAPSHOT)
+    // The guest runs in copy-on-write pages, `mem` keeps the image.
+    if (i8080_snapshot_map(&cpu, 0, 0x10000, mem) != 0) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+#elif defined(I8080_PAGE_TABLE)
+    // The program runs in place in its image, with no copy.
+    i8080_map(&cpu, 0x100, (int)image.size, image.data,
+        I8080_PAGE_READ | I8080_PAGE_WRITE);
+#endif
+    i8080_jump(&cpu, 0x100);
+#ifdef I8080_SNAPSHOT
+    i8080_snapshot_take(&cpu, &start);
+#endif
+#ifdef I8080_BLOCK_CACHE
+    i8080_blocks_attach(&cpu, &blocks);
+#endif
 
-    mem[5] = 0xC9;  // Inject RET at 0x0005 to handle "CALL 5".
-    i8080_init();
-    i8080_jump(0x100);
     while (1) {
-        int const pc = i8080_pc();
-        if (mem[pc] == 0x76) {
-            printf("HLT at %04X\n", pc);
+        i8080_run(&cpu, 0x7fffffff, I8080_STOP_HLT | I8080_STOP_TRAP);
+        if (cpu.stop_reason == I8080_STOP_HLT) {
+            i8080_cpm_flush(&cpm);
+            printf("HLT at %04X\n", i8080_pc(&cpu));
             exit(1);
         }
-        if (pc == 0x0005) {
-            if (i8080_regs_c() == 9) {
-                int i;
-                for (i = i8080_regs_de(); mem[i] != '$'; i += 1)
-                    putchar(mem[i]);
-                success = 1;
+        if (cpu.stop_reason != I8080_STOP_TRAP)
+            continue;
+        i8080_cpm_close(&cpm);
+        printf("\nJump to 0000 from %04X\n", cpu.last_pc);
+        if (success_check && cpm.written == 0)
+            exit(1);
+#ifdef I8080_SNAPSHOT
+        execute_serial(&cpu, &start);
+        // Roll back to the start: the memory must be the image again.
+        i8080_snapshot_restore(&cpu, &start);
+        for (addr = 0; addr < 0x10000; ++addr) {
+            if (PEEK(addr) != mem[addr] || i8080_pc(&cpu) != 0x100 ||
+                i8080_cycles(&cpu) != 0) {
+                printf("Snapshot restore failed\n");
+                exit(1);
             }
-            if (i8080_regs_c() == 2) putchar((char)i8080_regs_e());
         }
-        i8080_instruction();
-        if (i8080_pc() == 0) {
-            printf("\nJump to 0000 from %04X\n", pc);
-            if (success_check && !success)
+        i8080_snapshot_release(&start);
+        i8080_snapshot_unmap(&cpu);
+#elif defined(I8080_PAGE_TABLE)
+        i8080_image_close(&image);
+#endif
+        return;
+    }
+}
+
+#if I8080_LANES > 0
+
+static unsigned char lane_memory[I8080_LANES][0x10000];
+static struct i8080_lanes lanes;
+
+// Runs the test in all lanes in lockstep. The lanes run the same program,
+// so they must end in the same state. Lane 0 prints the output.
+void execute_test_lanes(const char* filename, int success_check) {
+    struct i8080 cpu;
+    int success = 0, done = 0;
+    int n;
+
+    load_file(filename, memory + 0x100);
+    i8080_lanes_init(&lanes, I8080_LANES);
+    for (n = 0; n < I8080_LANES; ++n) {
+        unsigned char* const mem = lane_memory[n];
+        memset(mem, 0, 0x10000);
+        memcpy(mem + 0x100, memory + 0x100, 0x10000 - 0x100);
+        mem[5] = 0xC9;  // Inject RET at 0x0005 to handle "CALL 5".
+        lanes.memory[n] = mem;
+        lanes.pc[n].w = 0x100;
+    }
+    memset(memory, 0, 0x10000);
+
+    I8080_ADDR_SET(traps, 0x0000);
+    I8080_ADDR_SET(traps, 0x0005);
+    lanes.traps = traps;
+
+    i8080_init(&cpu);
+    while (done < I8080_LANES) {
+        i8080_lanes_run(&lanes, 0x7fffffff);
+        for (n = 0; n < I8080_LANES; ++n) {
+            unsigned char* const mem = lane_memory[n];
+            if (!lanes.stop_reason[n])
+                continue;
+            cpu.hal = mem;
+            i8080_lanes_get(&lanes, n, &cpu);
+            if (lanes.stop_reason[n] == I8080_STOP_HLT) {
+                printf("HLT at %04X\n", i8080_pc(&cpu));
                 exit(1);
-            return;
+            }
+            if (lanes.stop_reason[n] == I8080_STOP_IO) {
+                i8080_instruction(&cpu);
+                i8080_lanes_put(&lanes, n, &cpu);
+                continue;
+            }
+            if (i8080_pc(&cpu) == 0x0005 && n == 0) {
+                if (i8080_regs_c(&cpu) == 9) {
+                    int i;
+                    for (i = i8080_regs_de(&cpu); mem[i] != '$'; i += 1)
+                        putchar(mem[i]);
+                    success = 1;
+                }
+                if (i8080_regs_c(&cpu) == 2) putchar((char)i8080_regs_e(&cpu));
+            }
+            if (i8080_pc(&cpu) == 0) {
+                done += 1;
+                continue;   // The lane stays stopped.
+            }
+            i8080_lanes_put(&lanes, n, &cpu);
+        }
+    }
+
+    for (n = 1; n < I8080_LANES; ++n) {
+        if (lanes.af[n].w != lanes.af[0].w || lanes.hl[n].w != lanes.hl[0].w ||
+            lanes.sp[n].w != lanes.sp[0].w ||
+            lanes.cycles[n] != lanes.cycles[0]) {
+            printf("\nLane %d diverged\n", n);
+            exit(1);
+        }
+    }
+    printf("\nJump to 0000 in %d lanes\n", I8080_LANES);
+    if (success_check && !success)
+        exit(1);
+}
+
+// Seeds lane `n` with its own registers and data, by the immediates of the
+// first LXI instructions and the bytes at 0200.
+static void lanes_seed(int n, unsigned char* mem) {
+    static const unsigned char code[] = {
+        0x01, 0x00, 0x00,   // 0100 lxi b,seed
+        0x11, 0x00, 0x00,   // 0103 lxi d,seed
+        0x31, 0x00, 0xF0,   // 0106 lxi sp,F000
+        0x21, 0x00, 0x02,   // 0109 lxi h,0200
+        0x7E,               // 010C mov a,m
+        0x81,               // 010D add c
+        0x77,               // 010E mov m,a
+        0x23,               // 010F inx h
+        0x05,               // 0110 dcr b
+        0xC2, 0x0C, 0x01,   // 0111 jnz 010C
+        0x7B,               // 0114 mov a,e
+        0xE6, 0x01,         // 0115 ani 1
+        0xC2, 0x00, 0x00,   // 0117 jnz 0000
+        0xEB,               // 011A xchg
+        0x19,               // 011B dad d
+        0xE5,               // 011C push h
+        0xC1,               // 011D pop b
+        0xCD, 0x30, 0x01,   // 011E call 0130
+        0xC3, 0x00, 0x00,   // 0121 jmp 0000
+    };
+    static const unsigned char call[] = {
+        0x1A,               // 0130 ldax d
+        0x8A,               // 0131 adc d
+        0x12,               // 0132 stax d
+        0x17,               // 0133 ral
+        0xD8,               // 0134 rc
+        0x13,               // 0135 inx d
+        0xC9,               // 0136 ret
+    };
+    int i;
+
+    memset(mem, 0, 0x10000);
+    memcpy(mem + 0x100, code, sizeof(code));
+    memcpy(mem + 0x130, call, sizeof(call));
+    mem[0x101] = (unsigned char)(n * 17 + 3);   // C
+    mem[0x102] = (unsigned char)(n * 5 + 1);    // B, the loop count
+    mem[0x104] = (unsigned char)n;              // E, odd lanes stop early
+    mem[0x105] = (unsigned char)(0x30 + n);     // D
+    for (i = 0; i < 0x100; ++i)
+        mem[0x200 + i] = (unsigned char)(n * 31 + i * 7);
+}
+
+// Runs lanes which take different paths, some of them stopping early, and
+// checks each against a scalar run of the same seed.
+void execute_lanes_divergent(void) {
+    struct i8080 cpu, lane;
+    int n, steps, failed = 0;
+
+    i8080_lanes_init(&lanes, I8080_LANES);
+    for (n = 0; n < I8080_LANES; ++n) {
+        lanes_seed(n, lane_memory[n]);
+        lanes.memory[n] = lane_memory[n];
+        lanes.pc[n].w = 0x100;
+    }
+    I8080_ADDR_SET(traps, 0x0000);
+    lanes.traps = traps;
+    for (steps = 0; steps < 1000; ++steps)
+        if (i8080_lanes_run(&lanes, 0x7fffffff) == I8080_LANES)
+            break;
+
+    for (n = 0; n < I8080_LANES; ++n) {
+        lanes_seed(n, memory);
+        cpu.hal = memory;
+        i8080_init(&cpu);
+        i8080_jump(&cpu, 0x100);
+        for (steps = 0; steps < 100000 && i8080_pc(&cpu) != 0; ++steps)
+            i8080_instruction(&cpu);
+        lane.hal = lane_memory[n];
+        i8080_init(&lane);
+        i8080_lanes_get(&lanes, n, &lane);
+        if (lanes.stop_reason[n] != I8080_STOP_TRAP ||
+            i8080_pc(&lane) != i8080_pc(&cpu) ||
+            i8080_regs_a(&lane) != i8080_regs_a(&cpu) ||
+            i8080_regs_bc(&lane) != i8080_regs_bc(&cpu) ||
+            i8080_regs_de(&lane) != i8080_regs_de(&cpu) ||
+            i8080_regs_hl(&lane) != i8080_regs_hl(&cpu) ||
+            i8080_regs_sp(&lane) != i8080_regs_sp(&cpu) ||
+            i8080_cycles(&lane) != i8080_cycles(&cpu) ||
+            memcmp(lane_memory[n], memory, 0x10000) != 0) {
+            printf("Lane %d differs from the scalar run\n", n);
+            failed = 1;
         }
     }
+    memset(memory, 0, 0x10000);
+    if (failed)
+        exit(1);
+    printf("Divergent lanes OK\n");
+}
+
+#define execute_test execute_test_lanes
+
+#endif
+
+#ifdef I8080_FARM
+
+#include "i8080_farm.h"
+
+#define FARM_GUESTS     16
+#define FARM_THREADS    4
+
+static unsigned char farm_memory[FARM_GUESTS][0x10000];
+static struct i8080 farm_cpu[FARM_GUESTS];
+static int farm_success[FARM_GUESTS];
+
+static int farm_bdos(struct i8080 *cpu, void *data) {
+    int* const success = (int *)data + (cpu - farm_cpu);
+    if (cpu->stop_reason == I8080_STOP_TRAP && i8080_pc(cpu) == 0x0005) {
+        if (i8080_regs_c(cpu) == 9) *success = 1;
+        return 1;
+    }
+    return 0;   // HLT, or the jump to 0000.
+}
+
+// Runs many copies of the test on the threads of the farm. The output is
+// not printed, but the test must print something.
+void execute_farm(const char* filename) {
+    struct i8080* cpus[FARM_GUESTS];
+    struct i8080_farm_config config;
+    struct i8080_farm_stats stats[FARM_THREADS];
+    int i, passed = 0;
+
+    load_file(filename, farm_memory[0] + 0x100);
+    farm_memory[0][5] = 0xC9;
+    I8080_ADDR_SET(traps, 0x0000);
+    I8080_ADDR_SET(traps, 0x0005);
+    for (i = 0; i < FARM_GUESTS; ++i) {
+        memcpy(farm_memory[i], farm_memory[0], 0x10000);
+        farm_cpu[i].hal = farm_memory[i];
+        i8080_init(&farm_cpu[i]);
+        i8080_jump(&farm_cpu[i], 0x100);
+        farm_cpu[i].traps = traps;
+        farm_success[i] = 0;
+        cpus[i] = &farm_cpu[i];
+    }
+
+    config.threads = FARM_THREADS;
+    config.slice = 10000;
+    config.stop_mask = I8080_STOP_HLT | I8080_STOP_TRAP;
+    config.handler = farm_bdos;
+    config.data = farm_success;
+    config.pin = 0;
+    if (i8080_farm_run(cpus, FARM_GUESTS, &config, stats) != 0)
+        printf("Some farm threads failed to start\n");
+
+    for (i = 0; i < FARM_GUESTS; ++i)
+        passed += farm_success[i];
+    for (i = 0; i < FARM_THREADS; ++i) {
+        printf("Thread %d: %d%% busy, %llu slices, %llu steals\n", i,
+            stats[i].wall_ns ?
+                (int)(stats[i].busy_ns * 100 / stats[i].wall_ns) : 0,
+            (unsigned long long)stats[i].slices,
+            (unsigned long long)stats[i].steals);
+    }
+    printf("%d of %d guests passed on the farm\n", passed, FARM_GUESTS);
+    if (passed != FARM_GUESTS)
+        exit(1);
+}
+
+#define FAIR_GUESTS     3
+#define FAIR_SLICE      10000
+
+static int fair_finished;
+static int fair_starved;
+
+static int fair_halt(struct i8080 *cpu, void *data) {
+    int i;
+    (void)data;
+    // When the first guest is done, the others must have had their turns.
+    if (fair_finished++ == 0) {
+        for (i = 0; i < FAIR_GUESTS; ++i)
+            if (&farm_cpu[i] != cpu &&
+                i8080_cycles(&farm_cpu[i]) + FAIR_SLICE < i8080_cycles(cpu))
+                fair_starved = 1;
+    }
+    return 0;
+}
+
+// Runs three guests needing five slices each on one thread: they must take
+// turns, not run one after the other.
+void execute_farm_slices(void) {
+    static const unsigned char code[] = {
+        0x01, 0xD0, 0x07,   // 0100 lxi b,07D0
+        0x0B,               // 0103 dcx b
+        0x78,               // 0104 mov a,b
+        0xB1,               // 0105 ora c
+        0xC2, 0x03, 0x01,   // 0106 jnz 0103
+        0x76,               // 0109 hlt
+    };
+    struct i8080* cpus[FAIR_GUESTS];
+    struct i8080_farm_config config;
+    int i;
+
+    for (i = 0; i < FAIR_GUESTS; ++i) {
+        memset(farm_memory[i], 0, 0x10000);
+        memcpy(farm_memory[i] + 0x100, code, sizeof(code));
+        farm_cpu[i].hal = farm_memory[i];
+        i8080_init(&farm_cpu[i]);
+        i8080_jump(&farm_cpu[i], 0x100);
+        cpus[i] = &farm_cpu[i];
+    }
+    config.threads = 1;
+    config.slice = FAIR_SLICE;
+    config.stop_mask = I8080_STOP_HLT;
+    config.handler = fair_halt;
+    config.data = 0;
+    config.pin = 0;
+    fair_finished = fair_starved = 0;
+    if (i8080_farm_run(cpus, FAIR_GUESTS, &config, 0) != 0 ||
+        fair_finished != FAIR_GUESTS || fair_starved) {
+        printf("Farm time slices failed\n");
+        exit(1);
+    }
+    printf("Farm time slices OK\n");
+}
+
+#endif
+
+#ifdef I8080_PAGE_TABLE
+
+#include "i8080_banks.h"
+
+#define BANKS 4
+
+static unsigned char bank_memory[BANKS][0x4000];
+
+// Switches four banks of 16K at 8000 by OUT 10, and lets a guest store a
+// byte into each bank, then read them back in another order. Without the
+// port table the test does what the HAL would do on OUT 10.
+void execute_banks(void) {
+    static const unsigned char code[] = {
+        0x79,           // 0100 mov a,c
+        0xD3, 0x10,     // 0101 out 10
+        0x78,           // 0103 mov a,b
+        0x77,           // 0104 mov m,a
+        0x76,           // 0105 hlt
+        0x79,           // 0106 mov a,c
+        0xD3, 0x10,     // 0107 out 10
+        0x7E,           // 0109 mov a,m
+        0x76,           // 010A hlt
+    };
+    struct i8080 cpu;
+    struct i8080_banks banks;
+    struct i8080_state state;
+    unsigned char* mem;
+    int bank, window, failed = 0;
+
+    cpu.hal = memory;
+    mem = i8080_hal_memory(&cpu);
+    memset(mem, 0, 0x10000);
+    memcpy(mem + 0x100, code, sizeof(code));
+    i8080_init(&cpu);
+    i8080_map(&cpu, 0, 0x10000, mem, I8080_PAGE_READ | I8080_PAGE_WRITE);
+    i8080_banks_init(&banks);
+    window = i8080_banks_add(&cpu, &banks, 0x8000, 0x4000, bank_memory[0],
+        BANKS, I8080_PAGE_READ | I8080_PAGE_WRITE);
+    i8080_banks_port(&banks, 0x10, window);
+#ifdef I8080_IO_TABLE
+    i8080_io_output(&cpu, 0x10, i8080_banks_handler, &banks);
+#endif
+
+    for (bank = 0; bank < 2 * BANKS; ++bank) {
+        int const load = bank >= BANKS;
+        int const b = load ? (BANKS - 1) - bank % BANKS : bank;
+#ifndef I8080_IO_TABLE
+        i8080_banks_output(&cpu, &banks, 0x10, b);
+#endif
+        i8080_save(&cpu, &state);
+        state.bc = (uns16)((0x40 + b) << 8 | b);
+        state.hl = 0x8123;
+        state.pc = load ? 0x106 : 0x100;
+        state.halted = 0;
+        i8080_restore(&cpu, &state);
+        i8080_run(&cpu, 1000, I8080_STOP_HLT);
+        if (load && i8080_regs_a(&cpu) != 0x40 + b)
+            failed = 1;
+    }
+    for (bank = 0; bank < BANKS; ++bank)
+        if (bank_memory[bank][0x123] != 0x40 + bank || mem[0x8123] != 0)
+            failed = 1;
+    printf("\nBank switching %s\n", failed ? "failed" : "OK");
+    if (failed)
+        exit(1);
+}
+
+static unsigned char watch_read[I8080_ADDR_MAP_SIZE];
+static unsigned char watch_write[I8080_ADDR_MAP_SIZE];
+
+// Watches the write of 2002 and the read of 2110. The run stops right after
+// each access, also in the middle of a cached block.
+void execute_watch(void) {
+    static const unsigned char code[] = {
+        0x21, 0x00, 0x20,   // 0100 lxi h,2000
+        0x7E,               // 0103 mov a,m
+        0x2C,               // 0104 inr l
+        0x2C,               // 0105 inr l
+        0x77,               // 0106 mov m,a
+        0x3A, 0x10, 0x21,   // 0107 lda 2110
+        0x32, 0x10, 0x21,   // 010A sta 2110
+        0x76,               // 010D hlt
+    };
+    static const int stops[3][3] = {
+        { I8080_STOP_WATCHPOINT, 0x0107, 0x2002 },
+        { I8080_STOP_WATCHPOINT, 0x010A, 0x2110 },
+        { I8080_STOP_HLT, 0x010D, 0x2110 },
+    };
+    int const mask = I8080_STOP_HLT | I8080_STOP_WATCHPOINT;
+    struct i8080 cpu;
+    unsigned char* mem;
+    int i, failed = 0;
+
+    cpu.hal = memory;
+    mem = i8080_hal_memory(&cpu);
+    memset(mem, 0, 0x10000);
+    memcpy(mem + 0x100, code, sizeof(code));
+    i8080_init(&cpu);
+    i8080_map(&cpu, 0, 0x10000, mem, I8080_PAGE_READ | I8080_PAGE_WRITE);
+#ifdef I8080_BLOCK_CACHE
+    i8080_blocks_attach(&cpu, &blocks);
+#endif
+    I8080_ADDR_SET(watch_write, 0x2002);
+    I8080_ADDR_SET(watch_read, 0x2110);
+    i8080_watch(&cpu, watch_read, watch_write);
+    i8080_jump(&cpu, 0x100);
+    i8080_peek(&cpu, 0x2110);
+    for (i = 0; i < 3; ++i) {
+        i8080_run(&cpu, 1000, mask);
+        if (cpu.stop_reason != stops[i][0] || i8080_pc(&cpu) != stops[i][1] ||
+            cpu.watch_addr != stops[i][2])
+            failed = 1;
+    }
+    if (cpu.watch_access != I8080_WATCH_READ)
+        failed = 1;
+    printf("\nWatchpoints %s\n", failed ? "failed" : "OK");
+    if (failed)
+        exit(1);
+}
+
+#endif
+
+#ifdef I8080_IO_TABLE
+
+static int port_reads;
+
+static int read_port(struct i8080 *cpu, int port, void *data) {
+    port_reads += 1;
+    return port + *(int *)data;
+}
+
+// IN and OUT go to the handlers, a constant port keeps its value when
+// written to, and an echoing one the last value written, in every decoder.
+void execute_ports(void) {
+    static const unsigned char code[] = {
+        0xDB, 0x20,     // 0100 in 20
+        0x47,           // 0102 mov b,a
+        0x3E, 0x33,     // 0103 mvi a,33
+        0xD3, 0x20,     // 0105 out 20
+        0xDB, 0x20,     // 0107 in 20
+        0x4F,           // 0109 mov c,a
+        0xD3, 0x22,     // 010A out 22
+        0xDB, 0x22,     // 010C in 22
+        0x57,           // 010E mov d,a
+        0xDB, 0x21,     // 010F in 21
+        0x76,           // 0111 hlt
+    };
+    struct i8080 cpu;
+    unsigned char* mem;
+    int add = 1;
+
+    cpu.hal = memory;
+    mem = i8080_hal_memory(&cpu);
+    memset(mem, 0, 0x10000);
+    memcpy(mem + 0x100, code, sizeof(code));
+    i8080_init(&cpu);
+#ifdef I8080_PAGE_TABLE
+    i8080_map(&cpu, 0, 0x10000, mem, I8080_PAGE_READ | I8080_PAGE_WRITE);
+#endif
+#ifdef I8080_BLOCK_CACHE
+    i8080_blocks_attach(&cpu, &blocks);
+#endif
+    i8080_io_constant(&cpu, 0x20, 0x5A | I8080_PORT_ECHO);
+    i8080_io_constant(&cpu, 0x22, 0xA5);
+    i8080_io_input(&cpu, 0x21, read_port, &add);
+    i8080_jump(&cpu, 0x100);
+    port_reads = 0;
+    i8080_run(&cpu, 1000, I8080_STOP_HLT);
+    if (i8080_regs_b(&cpu) != 0x5A || i8080_regs_c(&cpu) != 0x33 ||
+        i8080_regs_d(&cpu) != 0xA5 || i8080_regs_a(&cpu) != 0x22 ||
+        port_reads != 1) {
+        printf("\nPort table failed\n");
+        exit(1);
+    }
+    printf("\nPort table OK\n");
+}
+
+#endif
+
+#if defined(I8080_IDLE) && defined(I8080_IO_TABLE) && I8080_EVENTS > 0
+
+static void ready(struct i8080 *cpu, void *data) {
+    i8080_io_constant(cpu, 0x10, 1);
+}
+
+// The polling loop is skipped up to the event making the port ready, and
+// it ends at the same cycle as when run.
+void execute_idle(void) {
+    static const unsigned char code[] = {
+        0xDB, 0x10,         // 0100 in 10
+        0xE6, 0x01,         // 0102 ani 01
+        0xCA, 0x00, 0x01,   // 0104 jz 0100
+        0x76,               // 0107 hlt
+    };
+    struct i8080 cpu;
+    unsigned char* mem;
+    int cycles;
+
+    cpu.hal = memory;
+    mem = i8080_hal_memory(&cpu);
+    memset(mem, 0, 0x10000);
+    memcpy(mem + 0x100, code, sizeof(code));
+    i8080_init(&cpu);
+#ifdef I8080_PAGE_TABLE
+    i8080_map(&cpu, 0, 0x10000, mem, I8080_PAGE_READ | I8080_PAGE_WRITE);
+#endif
+#ifdef I8080_BLOCK_CACHE
+    i8080_blocks_attach(&cpu, &blocks);
+#endif
+    i8080_io_constant(&cpu, 0x10, 0);
+    i8080_schedule(&cpu, 10000, ready, 0);
+    i8080_jump(&cpu, 0x100);
+    cycles = i8080_run(&cpu, 20000, I8080_STOP_HLT);
+    // The event comes after IN at 10000, so the loop goes around once more.
+#ifdef I8080_8085
+    if (cycles != 10017 + 10 + 7 + 7 + 5) {
+#else
+    if (cycles != 10017 + 10 + 7 + 10 + 7) {
+#endif
+        printf("\nIdle loop failed: %d cycles\n", cycles);
+        exit(1);
+    }
+    printf("\nIdle loop OK\n");
+}
+
+#endif
+
+#if defined(I8080_BUS) && !defined(I8080_8085)
+
+static int bus_log[16][3];
+static int bus_cycles;
+
+// Logs the machine cycles at their T-states, and makes the writes to the
+// video RAM at 2000-3FFF wait for 2 T-states.
+static int bus_cycle(struct i8080 *cpu, int cycle, int addr, int offset,
+    void *data) {
+    int const t = (int)i8080_cycles(cpu) + offset;
+    if (bus_cycles < 16) {
+        bus_log[bus_cycles][0] = cycle;
+        bus_log[bus_cycles][1] = addr;
+        bus_log[bus_cycles][2] = t;
+    }
+    bus_cycles += 1;
+    return cycle == I8080_BUS_WRITE && (addr & 0xE000) == 0x2000 ? 2 : 0;
+}
+
+// The machine cycles come at the T-states of the 8080 data sheet, delayed
+// by the wait states, also with the block cache attached.
+void execute_bus(void) {
+    static const unsigned char code[] = {
+        0x31, 0x00, 0x02,   // 0100 lxi sp,0200
+        0x3E, 0x5A,         // 0103 mvi a,5a
+        0x32, 0x00, 0x20,   // 0105 sta 2000
+        0xC5,               // 0108 push b
+        0xD3, 0x10,         // 0109 out 10
+        0x76,               // 010B hlt
+    };
+    static const int expected[][3] = {
+        { I8080_BUS_FETCH,  0x0100,  0 },
+        { I8080_BUS_READ,   0x0101,  4 },
+        { I8080_BUS_READ,   0x0102,  7 },
+        { I8080_BUS_FETCH,  0x0103, 10 },
+        { I8080_BUS_READ,   0x0104, 14 },
+        { I8080_BUS_FETCH,  0x0105, 17 },
+        { I8080_BUS_READ,   0x0106, 21 },
+        { I8080_BUS_READ,   0x0107, 24 },
+        { I8080_BUS_WRITE,  0x2000, 27 },
+        { I8080_BUS_FETCH,  0x0108, 32 },
+        { I8080_BUS_WRITE,  0x01FF, 37 },
+        { I8080_BUS_WRITE,  0x01FE, 40 },
+        { I8080_BUS_FETCH,  0x0109, 43 },
+        { I8080_BUS_READ,   0x010A, 47 },
+        { I8080_BUS_OUTPUT, 0x0010, 50 },
+        { I8080_BUS_FETCH,  0x010B, 53 },
+    };
+    struct i8080 cpu;
+    unsigned char* mem;
+    int i, failed = 0;
+
+    cpu.hal = memory;
+    mem = i8080_hal_memory(&cpu);
+    memset(mem, 0, 0x10000);
+    memcpy(mem + 0x100, code, sizeof(code));
+    i8080_init(&cpu);
+#ifdef I8080_PAGE_TABLE
+    i8080_map(&cpu, 0, 0x10000, mem, I8080_PAGE_READ | I8080_PAGE_WRITE);
+#endif
+#ifdef I8080_BLOCK_CACHE
+    i8080_blocks_attach(&cpu, &blocks);
+#endif
+    i8080_bus_attach(&cpu, bus_cycle, 0);
+    i8080_jump(&cpu, 0x100);
+    bus_cycles = 0;
+    i8080_run(&cpu, 1000, I8080_STOP_HLT);
+    if (bus_cycles != 16 || i8080_cycles(&cpu) != 60 || mem[0x2000] != 0x5A)
+        failed = 1;
+    for (i = 0; i < 16 && !failed; ++i)
+        if (bus_log[i][0] != expected[i][0] ||
+            bus_log[i][1] != expected[i][1] || bus_log[i][2] != expected[i][2])
+            failed = 1;
+    printf("\nBus cycles %s\n", failed ? "failed" : "OK");
+    if (failed)
+        exit(1);
+}
+
+#endif
+
+#ifdef I8080_8085
+
+// The undocumented instructions and their cycles, then RST 5.5 taken at
+// HLT and TRAP taken with the interrupts disabled, each reading RIM.
+void execute_8085(void) {
+    static const unsigned char code[] = {
+        0x31, 0x00, 0x02,   // 0100 lxi sp,0200
+        0x21, 0x34, 0x12,   // 0103 lxi h,1234
+        0x01, 0x34, 0x02,   // 0106 lxi b,0234
+        0x08,               // 0109 dsub
+        0x28, 0x10,         // 010A ldhi 10
+        0xD9,               // 010C shlx
+        0x10,               // 010D arhl
+        0xED,               // 010E lhlx
+        0x18,               // 010F rdel
+        0x01, 0xFF, 0xFF,   // 0110 lxi b,ffff
+        0x03,               // 0113 inx b
+        0xDD, 0x00, 0x00,   // 0114 jnk 0000
+        0x3E, 0x0E,         // 0117 mvi a,0e
+        0x30,               // 0119 sim
+        0xFB,               // 011A ei
+        0x76,               // 011B hlt
+    };
+    static const unsigned char handler[] = {
+        0x20,               // rim
+        0x76,               // hlt
+    };
+    struct i8080 cpu;
+    unsigned char* mem;
+    int failed = 0;
+
+    cpu.hal = memory;
+    mem = i8080_hal_memory(&cpu);
+    memset(mem, 0, 0x10000);
+    memcpy(mem + 0x100, code, sizeof(code));
+    memcpy(mem + 0x24, handler, sizeof(handler));
+    memcpy(mem + 0x2C, handler, sizeof(handler));
+    i8080_init(&cpu);
+#ifdef I8080_PAGE_TABLE
+    i8080_map(&cpu, 0, 0x10000, mem, I8080_PAGE_READ | I8080_PAGE_WRITE);
+#endif
+#ifdef I8080_BLOCK_CACHE
+    i8080_blocks_attach(&cpu, &blocks);
+#endif
+    i8080_jump(&cpu, 0x100);
+    i8080_run(&cpu, 1000, I8080_STOP_HLT);
+    if (i8080_pc(&cpu) != 0x11B || i8080_cycles(&cpu) != 130 ||
+        i8080_regs_hl(&cpu) != 0x1000 || i8080_regs_de(&cpu) != 0x2020 ||
+        mem[0x1010] != 0x00 || mem[0x1011] != 0x10)
+        failed = 1;
+
+    i8080_line(&cpu, I8080_LINE_RST55, 1);
+    i8080_run(&cpu, 1000, I8080_STOP_HLT);
+    if (i8080_pc(&cpu) != 0x2D || i8080_regs_a(&cpu) != 0x16 ||
+        i8080_regs_sp(&cpu) != 0x1FE || mem[0x1FE] != 0x1C || mem[0x1FF] != 0x01)
+        failed = 1;
+
+    i8080_line(&cpu, I8080_LINE_TRAP, 1);
+    i8080_run(&cpu, 1000, I8080_STOP_HLT);
+    if (i8080_pc(&cpu) != 0x25 || i8080_regs_a(&cpu) != 0x16 ||
+        i8080_regs_sp(&cpu) != 0x1FC)
+        failed = 1;
+    printf("\n8085 %s\n", failed ? "failed" : "OK");
+    if (failed)
+        exit(1);
+}
+
+#endif
+
+#if defined(I8080_TRACE) || defined(I8080_PROFILE)
+
+// Sets up a test to run without its output, stopping at 0000 only.
+static void load_quiet(struct i8080 *cpu, const char* filename) {
+    unsigned char* mem;
+    cpu->hal = memory;
+    mem = i8080_hal_memory(cpu);
+    memset(mem, 0, 0x10000);
+    load_file(filename, mem + 0x100);
+    mem[5] = 0xC9;
+    i8080_init(cpu);
+#ifdef I8080_PAGE_TABLE
+    i8080_map(cpu, 0, 0x10000, mem, I8080_PAGE_READ | I8080_PAGE_WRITE);
+#endif
+    i8080_jump(cpu, 0x100);
+    I8080_ADDR_CLR(traps, 0x0005);
+    I8080_ADDR_SET(traps, 0x0000);
+    cpu->traps = traps;
+}
+
+static void run_quiet(struct i8080 *cpu) {
+    do {
+        i8080_run(cpu, 0x7fffffff, I8080_STOP_HLT | I8080_STOP_TRAP);
+    } while (i8080_pc(cpu) != 0 && cpu->stop_reason != I8080_STOP_HLT);
+}
+
+#endif
+
+#ifdef I8080_TRACE
+
+#include "i8080_trace.h"
+
+#define TRACE_FILE "i8080_test.trc"
+
+// Runs the test silently with the tracer attached, then reads the trace
+// back: it must hold every instruction and all the cycles of the run.
+void execute_trace(const char* filename) {
+    struct i8080 cpu;
+    struct i8080_tracer *tracer;
+    struct i8080_trace_reader *reader;
+    struct i8080_trace_record record;
+    long written, read = 0;
+    uns64 cycles = 0;
+    int result;
+
+    load_quiet(&cpu, filename);
+
+    tracer = i8080_tracer_open(TRACE_FILE, 4096);
+    if (!tracer) {
+        printf("Cannot create \"%s\"\n", TRACE_FILE);
+        exit(1);
+    }
+    i8080_tracer_attach(tracer, &cpu);
+    run_quiet(&cpu);
+    written = i8080_tracer_close(tracer);
+
+    reader = i8080_trace_reader_open(TRACE_FILE);
+    if (!reader) {
+        printf("Cannot read \"%s\"\n", TRACE_FILE);
+        exit(1);
+    }
+    while ((result = i8080_trace_read(reader, &record)) > 0) {
+        if (read == 0 && record.pc != 0x100)
+            break;
+        cycles += record.cycles & ~I8080_TRACE_IRQ;
+        read += 1;
+    }
+    i8080_trace_reader_close(reader);
+    remove(TRACE_FILE);
+
+    printf("Traced %ld instructions, %llu cycles\n", read,
+        (unsigned long long)cycles);
+    if (result != 0 || written != read || cycles != i8080_cycles(&cpu)) {
+        printf("Trace mismatch\n");
+        exit(1);
+    }
+}
+
+#endif
+
+#ifdef I8080_REPLAY
+
+#include "i8080_replay.h"
+
+#define REPLAY_FILE "i8080_test.rpl"
+
+static unsigned long device_seed;
+static int device_reads;
+
+// The device: interrupts at random intervals, and random input values
+// (through the port table if there is one, the HAL reads zeros).
+static void device_tick(struct i8080 *cpu, void *data) {
+    device_seed = device_seed * 1103515245 + 12345;
+    i8080_irq(cpu, I8080_RST(1));
+    i8080_schedule(cpu, i8080_cycles(cpu) + 200 + (device_seed >> 16) % 900,
+        device_tick, data);
+}
+
+#ifdef I8080_IO_TABLE
+static int device_input(struct i8080 *cpu, int port, void *data) {
+    device_reads += 1;
+    device_seed = device_seed * 1103515245 + 12345;
+    return (int)(device_seed >> 16) & 0xff;
+}
+#endif
+
+static void replay_guest(struct i8080 *cpu, int live) {
+    static const unsigned char handler[] = {
+        0xF5,               // 0008 push psw
+        0xDB, 0x30,         // 0009 in 30
+        0x77,               // 000B mov m,a
+        0x23,               // 000C inx h
+        0x71,               // 000D mov m,c
+        0x23,               // 000E inx h
+        0xF1,               // 000F pop psw
+        0xFB,               // 0010 ei
+        0xC9,               // 0011 ret
+    };
+    static const unsigned char code[] = {
+        0x31, 0x00, 0xF0,   // 0100 lxi sp,F000
+        0x21, 0x00, 0x20,   // 0103 lxi h,2000
+        0x01, 0x00, 0x00,   // 0106 lxi b,0
+        0xFB,               // 0109 ei
+        0x03,               // 010A inx b
+        0x78,               // 010B mov a,b
+        0xFE, 0x10,         // 010C cpi 10
+        0xC2, 0x0A, 0x01,   // 010E jnz 010A
+        0x76,               // 0111 hlt
+    };
+    unsigned char* const mem = i8080_hal_memory(cpu);
+    memset(mem, 0, 0x10000);
+    memcpy(mem + 0x08, handler, sizeof(handler));
+    memcpy(mem + 0x100, code, sizeof(code));
+    i8080_init(cpu);
+#ifdef I8080_PAGE_TABLE
+    i8080_map(cpu, 0, 0x10000, mem, I8080_PAGE_READ | I8080_PAGE_WRITE);
+#endif
+#ifdef I8080_IO_TABLE
+    i8080_io_input(cpu, 0x30, device_input, 0);
+#endif
+    i8080_jump(cpu, 0x100);
+    device_seed = 1;
+    device_reads = 0;
+    if (live)
+        i8080_schedule(cpu, 500, device_tick, 0);
+}
+
+// Records a run with the device, then replays it with no device at all
+// (and with the block cache if there is one): the runs must be the same.
+void execute_replay(void) {
+    static unsigned char recorded[0x10000];
+    struct i8080 cpu;
+    struct i8080_replay_file *file;
+    uns64 cycles;
+    long written, played;
+    int failed = 0;
+
+    cpu.hal = memory;
+    replay_guest(&cpu, 1);
+    file = i8080_replay_open(REPLAY_FILE, I8080_REPLAY_RECORD, 256);
+    if (!file) {
+        printf("Cannot create \"%s\"\n", REPLAY_FILE);
+        exit(1);
+    }
+    i8080_replay_start(file, &cpu);
+    i8080_run(&cpu, 0x7fffffff, I8080_STOP_HLT);
+    written = i8080_replay_close(file);
+    cycles = i8080_cycles(&cpu);
+    memcpy(recorded, i8080_hal_memory(&cpu), 0x10000);
+
+    replay_guest(&cpu, 0);
+    file = i8080_replay_open(REPLAY_FILE, I8080_REPLAY_PLAY, 0);
+    if (!file) {
+        printf("Cannot read \"%s\"\n", REPLAY_FILE);
+        exit(1);
+    }
+#ifdef I8080_BLOCK_CACHE
+    i8080_blocks_attach(&cpu, &blocks);
+#endif
+    i8080_replay_start(file, &cpu);
+    i8080_run(&cpu, 0x7fffffff, I8080_STOP_HLT);
+    played = i8080_replay_close(file);
+    remove(REPLAY_FILE);
+
+    if (played != written || written <= 0 || device_reads != 0 ||
+        i8080_cycles(&cpu) != cycles ||
+        memcmp(recorded, i8080_hal_memory(&cpu), 0x10000) != 0)
+        failed = 1;
+    printf("\nReplay of %ld bytes %s\n", written, failed ? "failed" : "OK");
+    if (failed)
+        exit(1);
+}
+
+#endif
+
+#ifdef I8080_MEMSTATS
+
+#include "i8080_memstats.h"
+
+static struct i8080_memstats memstats;
+
+// Calls 0300 32 times, each time after a store into its page, so the JIT
+// compiles the store in the middle of a block.
+static void memstats_loop(void) {
+    static const unsigned char code[] = {
+        0x06, 0x20,         // 0100 mvi b,20
+        0x3E, 0x00,         // 0102 mvi a,00
+        0x32, 0x80, 0x03,   // 0104 sta 0380
+        0xCD, 0x00, 0x03,   // 0107 call 0300
+        0x05,               // 010A dcr b
+        0xC2, 0x02, 0x01,   // 010B jnz 0102
+        0x76,               // 010E hlt
+    };
+    struct i8080 cpu;
+    unsigned char* mem;
+
+    cpu.hal = memory;
+    mem = i8080_hal_memory(&cpu);
+    memset(mem, 0, 0x10000);
+    memcpy(mem + 0x100, code, sizeof(code));
+    mem[0x300] = 0xC9;      // 0300 ret
+    i8080_init(&cpu);
+#ifdef I8080_PAGE_TABLE
+    i8080_map(&cpu, 0, 0x10000, mem, I8080_PAGE_READ | I8080_PAGE_WRITE);
+#endif
+#ifdef I8080_BLOCK_CACHE
+    i8080_blocks_attach(&cpu, &blocks);
+#endif
+    i8080_jump(&cpu, 0x100);
+    i8080_memstats_attach(&cpu, &memstats);
+    i8080_run(&cpu, 10000, I8080_STOP_HLT);
+    i8080_memstats_attach(&cpu, 0);
+    if (memstats.writes[3] != 32 || memstats.code_writes[3] != 31 ||
+        memstats.code_write_addr != 0x380 || memstats.code_write_pc != 0x104) {
+        printf("Memory statistics of the loop failed\n");
+        exit(1);
+    }
+}
+
+// The program stores HLT over its next instruction but one, which is seen
+// as self-modifying code, in every decoder.
+void execute_memstats(void) {
+    static const unsigned char code[] = {
+        0x3E, 0x76,         // 0100 mvi a,76
+        0x32, 0x08, 0x01,   // 0102 sta 0108
+        0x3A, 0x00, 0x02,   // 0105 lda 0200
+        0x00,               // 0108 nop
+    };
+    struct i8080 cpu;
+    unsigned char* mem;
+
+    cpu.hal = memory;
+    mem = i8080_hal_memory(&cpu);
+    memset(mem, 0, 0x10000);
+    memcpy(mem + 0x100, code, sizeof(code));
+    i8080_init(&cpu);
+#ifdef I8080_PAGE_TABLE
+    i8080_map(&cpu, 0, 0x10000, mem, I8080_PAGE_READ | I8080_PAGE_WRITE);
+#endif
+#ifdef I8080_BLOCK_CACHE
+    i8080_blocks_attach(&cpu, &blocks);
+#endif
+    i8080_jump(&cpu, 0x100);
+    i8080_memstats_attach(&cpu, &memstats);
+    i8080_run(&cpu, 1000, I8080_STOP_HLT);
+    i8080_memstats_attach(&cpu, 0);
+    printf("\n");
+    i8080_memstats_write(&memstats, stdout);
+    if (memstats.fetches[1] != 4 || memstats.reads[1] != 5 ||
+        memstats.reads[2] != 1 || memstats.writes[1] != 1 ||
+        memstats.code_writes[1] != 1 || memstats.code_write_addr != 0x108 ||
+        memstats.code_write_pc != 0x102) {
+        printf("Memory statistics failed\n");
+        exit(1);
+    }
+    memstats_loop();
+    printf("Memory statistics OK\n");
+}
+
+#endif
+
+#ifdef I8080_PROFILE
+
+#include "i8080_profile.h"
+
+static struct i8080_profile profile;
+
+// Runs the test silently with the profiler attached and prints the hot
+// spots. Every instruction and cycle must be counted once.
+void execute_profile(const char* filename) {
+    struct i8080 cpu;
+    uns64 by_pc = 0, by_opcode = 0, cycles = 0;
+    int i;
+
+    load_quiet(&cpu, filename);
+    i8080_profile_attach(&cpu, &profile);
+    run_quiet(&cpu);
+    i8080_profile_attach(&cpu, 0);
+
+    for (i = 0; i < 0x10000; ++i)
+        by_pc += profile.pc_count[i];
+    for (i = 0; i < 256; ++i)
+        by_opcode += profile.opcode_count[i];
+    for (i = 0; i < profile.nodes; ++i)
+        cycles += profile.node[i].cycles;
+    i8080_profile_write_report(&profile, stdout, 3);
+    printf("Profiled %llu instructions, %llu cycles in %d call paths\n",
+        (unsigned long long)by_pc, (unsigned long long)cycles,
+        profile.nodes);
+    if (by_pc != by_opcode || cycles != i8080_cycles(&cpu)) {
+        printf("Profile mismatch\n");
+        exit(1);
+    }
+}
+
+#endif
+
+static unsigned char vectors[I8080_ADDR_MAP_SIZE];
+
+// Interrupts the loop at 0101 by RST 7, with a breakpoint at its vector,
+// then by RST 0, with a trap at 0000. The run stops at the vector, before
+// its first instruction.
+void execute_interrupt(void) {
+    static const unsigned char code[] = {
+        0xFB,               // 0100 ei
+        0xC3, 0x01, 0x01,   // 0101 jmp 0101
+    };
+    static const int stops[2][3] = {
+        { I8080_STOP_BREAKPOINT, 7, 0x0038 },
+        { I8080_STOP_TRAP, 0, 0x0000 },
+    };
+    struct i8080 cpu;
+    unsigned char* mem;
+    int i, failed = 0;
+
+    cpu.hal = memory;
+    mem = i8080_hal_memory(&cpu);
+    memset(mem, 0, 0x10000);
+    memcpy(mem + 0x100, code, sizeof(code));
+    i8080_init(&cpu);
+#ifdef I8080_BLOCK_CACHE
+    i8080_blocks_attach(&cpu, &blocks);
+#endif
+    memset(vectors, 0, sizeof(vectors));
+    I8080_ADDR_SET(vectors, 0x0038);
+    I8080_ADDR_SET(vectors, 0x0000);
+    cpu.breakpoints = vectors;
+    cpu.traps = vectors;
+    for (i = 0; i < 2; ++i) {
+        i8080_jump(&cpu, 0x100);
+        i8080_run(&cpu, 100, I8080_STOP_BREAKPOINT);
+        i8080_irq(&cpu, I8080_RST(stops[i][1]));
+        i8080_run(&cpu, 1000, stops[i][0]);
+        if (cpu.stop_reason != stops[i][0] || i8080_pc(&cpu) != stops[i][2])
+            failed = 1;
+    }
+    if (failed) {
+        printf("\nInterrupt at a breakpoint or trap failed\n");
+        exit(1);
+    }
+}
+
+#ifndef _WIN32
+
+#define CPM_FCB     0x005C
+#define CPM_DMA     0x0080
+#define CPM_SECTOR  0x2000
+
+// Calls `addr` (the BDOS or a BIOS entry) from 0100 with BC and DE, and
+// returns HL, or -1 if the call did not return.
+static int cpm_call(struct i8080 *cpu, int addr, int bc, int de) {
+    struct i8080_state state;
+    i8080_poke(cpu, 0x100, 0xCD);   // call addr
+    i8080_poke(cpu, 0x101, addr & 0xff);
+    i8080_poke(cpu, 0x102, addr >> 8);
+    i8080_poke(cpu, 0x103, 0x76);   // hlt
+    i8080_save(cpu, &state);
+    state.bc = (uns16)bc;
+    state.de = (uns16)de;
+    state.sp = 0xF000;
+    state.pc = 0x100;
+    state.halted = 0;
+    i8080_restore(cpu, &state);
+    i8080_run(cpu, 0x7fffffff, I8080_STOP_HLT | I8080_STOP_TRAP);
+    return cpu->stop_reason == I8080_STOP_HLT ? i8080_regs_hl(cpu) : -1;
+}
+
+static void cpm_fcb_set(struct i8080 *cpu, const char *name) {
+    int i;
+    for (i = 0; i < 36; ++i)
+        i8080_poke(cpu, CPM_FCB + i, 0);
+    for (i = 0; i < 11; ++i)
+        i8080_poke(cpu, CPM_FCB + 1 + i, name[i]);
+}
+
+// Calls the BDOS with the FCB, set to `name` first unless it is 0.
+static int cpm_bdos_call(struct i8080 *cpu, int function, const char *name) {
+    if (name)
+        cpm_fcb_set(cpu, name);
+    return cpm_call(cpu, 0x0005, function, CPM_FCB) & 0xff;
+}
+
+static int cpm_bios_call(struct i8080 *cpu, int entry, int bc) {
+    return cpm_call(cpu, I8080_CPM_BIOS + entry * 3, bc, 0);
+}
+
+static int cpm_dma_check(struct i8080 *cpu, int addr, int first) {
+    int i;
+    for (i = 0; i < 128; ++i)
+        if (i8080_peek(cpu, addr + i) != ((first + i) & 0xff))
+            return 0;
+    return 1;
+}
+
+// Calls the file functions of the BDOS on a temporary directory, with a
+// file made by the host in upper case and the names which must not reach
+// the host, and the BIOS disk calls on an image of three tracks.
+void execute_cpm_files(void) {
+    static const char* const illegal[] = {
+        "../ESC     ", "A/B     TXT", "A\\B     TXT", "A\001B     TXT",
+        "A B     TXT", "A*      TXT",
+    };
+    char dir[] = "/tmp/i8080_cpm.XXXXXX";
+    char path[64], disk[64];
+    struct i8080 cpu;
+    struct i8080_cpm cpm;
+    FILE* f;
+    int i, failed = 0;
+
+    if (!mkdtemp(dir)) {
+        printf("\nUnable to make a directory for CP/M\n");
+        exit(1);
+    }
+    sprintf(path, "%s/UPPER.TXT", dir);
+    f = fopen(path, "wb");
+    fputs("upper", f);
+    fclose(f);
+    sprintf(disk, "%s/disk.img", dir);
+    f = fopen(disk, "wb");
+    for (i = 0; i < 3 * 26 * 128; ++i)
+        putc(0xE5, f);
+    fclose(f);
+
+    cpu.hal = memory;
+    memset(i8080_hal_memory(&cpu), 0, 0x10000);
+    i8080_init(&cpu);
+#ifdef I8080_PAGE_TABLE
+    i8080_map(&cpu, 0, 0x10000, i8080_hal_memory(&cpu),
+        I8080_PAGE_READ | I8080_PAGE_WRITE);
+#endif
+    i8080_cpm_init(&cpm, 0, 0, dir);
+    i8080_cpm_attach(&cpm, &cpu);
+    if (i8080_cpm_disk(&cpm, 0, disk, 26) != 0)
+        failed = 1;
+
+    // Two records written, read back sequentially and at random.
+    if (cpm_bdos_call(&cpu, 22, "TEST    DAT") != 0)
+        failed = 1;
+    for (i = 0; i < 128; ++i)
+        i8080_poke(&cpu, CPM_DMA + i, i);
+    failed |= cpm_bdos_call(&cpu, 21, 0) != 0;
+    for (i = 0; i < 128; ++i)
+        i8080_poke(&cpu, CPM_DMA + i, 128 + i);
+    failed |= cpm_bdos_call(&cpu, 21, 0) != 0;
+    failed |= cpm_bdos_call(&cpu, 16, 0) != 0;
+    failed |= cpm_bdos_call(&cpu, 15, "TEST    DAT") != 0;
+    failed |= cpm_bdos_call(&cpu, 20, 0) != 0 ||
+        !cpm_dma_check(&cpu, CPM_DMA, 0);
+    failed |= cpm_bdos_call(&cpu, 20, 0) != 0 ||
+        !cpm_dma_check(&cpu, CPM_DMA, 128);
+    failed |= cpm_bdos_call(&cpu, 20, 0) != 1;
+    i8080_poke(&cpu, CPM_FCB + 33, 0);
+    failed |= cpm_bdos_call(&cpu, 33, 0) != 0 ||
+        !cpm_dma_check(&cpu, CPM_DMA, 0);
+    failed |= cpm_bdos_call(&cpu, 16, 0) != 0;
+
+    // The name listed by the search opens the host file in upper case.
+    failed |= cpm_bdos_call(&cpu, 17, "????????TXT") != 0;
+    for (i = 0; i < 11; ++i)
+        failed |= i8080_peek(&cpu, CPM_DMA + 1 + i) != "UPPER   TXT"[i];
+    failed |= cpm_bdos_call(&cpu, 18, 0) != 0xff;
+    failed |= cpm_bdos_call(&cpu, 15, "UPPER   TXT") != 0;
+    failed |= cpm_bdos_call(&cpu, 20, 0) != 0 ||
+        i8080_peek(&cpu, CPM_DMA) != 'u' ||
+        i8080_peek(&cpu, CPM_DMA + 5) != 0x1A;
+    failed |= cpm_bdos_call(&cpu, 16, 0) != 0;
+
+    // The new name of a file is lower-case on the host.
+    cpm_fcb_set(&cpu, "TEST    DAT");
+    for (i = 0; i < 11; ++i)
+        i8080_poke(&cpu, CPM_FCB + 17 + i, "NEW     DAT"[i]);
+    failed |= cpm_bdos_call(&cpu, 23, 0) != 0;
+    failed |= cpm_bdos_call(&cpu, 15, "TEST    DAT") != 0xff;
+    sprintf(path, "%s/new.dat", dir);
+    f = fopen(path, "rb");
+    if (!f)
+        failed = 1;
+    else
+        fclose(f);
+
+    for (i = 0; i < (int)(sizeof(illegal) / sizeof(illegal[0])); ++i)
+        failed |= cpm_bdos_call(&cpu, 22, illegal[i]) != 0xff;
+    sprintf(path, "%s/../esc", dir);
+    f = fopen(path, "rb");
+    if (f) {
+        fclose(f);
+        remove(path);
+        failed = 1;
+    }
+
+    failed |= cpm_bdos_call(&cpu, 19, "????????DAT") != 0;
+    failed |= cpm_bdos_call(&cpu, 19, "UPPER   TXT") != 0;
+    failed |= cpm_bdos_call(&cpu, 17, "????????DAT") != 0xff;
+
+    // A sector written at track 2, sector 5, and read back; track 3 is
+    // past the end of the image.
+    failed |= cpm_bios_call(&cpu, 9, 1) != 0;
+    failed |= cpm_bios_call(&cpu, 9, 0) == 0;
+    cpm_bios_call(&cpu, 10, 2);
+    cpm_bios_call(&cpu, 11, 5);
+    cpm_bios_call(&cpu, 12, CPM_SECTOR);
+    for (i = 0; i < 128; ++i)
+        i8080_poke(&cpu, CPM_SECTOR + i, 64 + i);
+    failed |= cpm_bios_call(&cpu, 14, 0) != 0;
+    for (i = 0; i < 128; ++i)
+        i8080_poke(&cpu, CPM_SECTOR + i, 0);
+    failed |= cpm_bios_call(&cpu, 13, 0) != 0 ||
+        !cpm_dma_check(&cpu, CPM_SECTOR, 64);
+    cpm_bios_call(&cpu, 10, 3);
+    failed |= cpm_bios_call(&cpu, 13, 0) != 1;
+    i8080_cpm_close(&cpm);
+
+    f = fopen(disk, "rb");
+    fseek(f, (2 * 26 + 5) * 128, SEEK_SET);
+    for (i = 0; i < 128; ++i)
+        failed |= getc(f) != 64 + i;
+    fclose(f);
+    remove(disk);
+    // The directory is empty, unless a delete did not.
+    failed |= remove(dir) != 0;
+    if (failed) {
+        printf("\nCP/M file functions failed\n");
+        exit(1);
+    }
+}
+
+#endif
+
+// Disassembles a few instructions, and checks that the lengths of the
+// opcode metadata agree with the operands of the mnemonics.
+void execute_disassembler(void) {
+    static const struct {
+        uns8 bytes[3];
+        const char *text;
+    } expected[] = {
+        { { 0x31, 0x00, 0x07 }, "lxi sp,0700" },
+        { { 0x3E, 0xA5, 0x00 }, "mvi a,A5" },
+        { { 0xCD, 0x34, 0x12 }, "call 1234" },
+        { { 0x70, 0x00, 0x00 }, "mov m,b" },
+        { { 0xDB, 0x10, 0x00 }, "in 10" },
+    };
+    char text[I8080_DISASM_SIZE];
+    int i, failed = 0;
+
+    for (i = 0; i < (int)(sizeof(expected) / sizeof(expected[0])); ++i)
+        if (i8080_disassemble(expected[i].bytes, text) !=
+                i8080_opcode_length(expected[i].bytes[0]) ||
+            strcmp(text, expected[i].text) != 0)
+            failed = 1;
+    for (i = 0; i < 256; ++i) {
+        const char* const m = i8080_opcodes[i].mnemonic;
+        int const length = 1 + (strchr(m, '$') != 0) + 2 * (strchr(m, '#') != 0);
+        if (length != i8080_opcodes[i].length ||
+            i8080_opcodes[i].cycles > i8080_opcodes[i].cycles_taken)
+            failed = 1;
+    }
+    if (failed) {
+        printf("\nDisassembler failed\n");
+        exit(1);
+    }
 }
 
 int main() {
+    execute_disassembler();
+    execute_interrupt();
+#ifndef _WIN32
+    execute_cpm_files();
+#endif
+#ifndef I8080_8085
+    // These expect bits 1 and 5 of F to be fixed, not the 8085 V and K.
     execute_test("CPUTEST.COM", 0);
+#endif
     execute_test("TEST.COM", 0);
     execute_test("8080PRE.COM", 1);
+#ifndef I8080_8085
     execute_test("8080EX1.COM", 0);
+#endif
+#if I8080_LANES > 0
+    execute_lanes_divergent();
+#endif
+#ifdef I8080_FARM
+    execute_farm("8080PRE.COM");
+    execute_farm_slices();
+#endif
+#ifdef I8080_PAGE_TABLE
+    execute_banks();
+    execute_watch();
+#endif
+#ifdef I8080_IO_TABLE
+    execute_ports();
+#endif
+#ifdef I8080_8085
+    execute_8085();
+#endif
+#if defined(I8080_IDLE) && defined(I8080_IO_TABLE) && I8080_EVENTS > 0
+    execute_idle();
+#endif
+#if defined(I8080_BUS) && !defined(I8080_8085)
+    execute_bus();
+#endif
+#ifdef I8080_MEMSTATS
+    execute_memstats();
+#endif
+#ifdef I8080_TRACE
+    execute_trace("TEST.COM");
+#endif
+#ifdef I8080_PROFILE
+    execute_profile("TEST.COM");
+#endif
+#ifdef I8080_REPLAY
+    execute_replay();
+#endif
     return 0;
 }
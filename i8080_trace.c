@@ -0,0 +1,284 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i8080_trace.h"
+
+// The longest encoding of a record: the tag, PC, cycles, three bytes of
+// the instruction, A and F.
+#define TRACE_RECORD_MAX 9
+
+struct i8080_tracer {
+    struct i8080_trace trace;          // What the CPU sees.
+    struct i8080 *cpu;
+    struct i8080_trace_record *buffer[2];
+    FILE *file;
+    int error;
+    long records;
+
+    // The buffer handed over to the writer, or 0 when it is idle.
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct i8080_trace_record *full;
+    int full_count;
+    int stop;
+
+    // The writer's side: the previous record and the compressed output.
+    struct i8080_trace_record last;
+    uns8 *out;
+};
+
+// The address of the instruction following `record` if it does not jump.
+static uns16 trace_next_pc(const struct i8080_trace_record *record) {
+    if (record->cycles & I8080_TRACE_IRQ)
+        return record->pc;
+    return (uns16)(record->pc + i8080_opcode_length(record->opcode));
+}
+
+static uns8 *trace_encode(uns8 *out, const struct i8080_trace_record *last,
+    const struct i8080_trace_record *record) {
+    uns8* const tag = out++;
+    int length = record->cycles & I8080_TRACE_IRQ ?
+        1 : i8080_opcode_length(record->opcode);
+
+    *tag = 0;
+    if (record->pc != trace_next_pc(last)) {
+        *tag |= I8080_TRACE_PC;
+        *out++ = (uns8)(record->pc & 0xff);
+        *out++ = (uns8)(record->pc >> 8);
+    }
+    if (record->cycles != last->cycles) {
+        *tag |= I8080_TRACE_CYCLES;
+        *out++ = record->cycles;
+    }
+    *out++ = record->opcode;
+    if (length > 1)
+        *out++ = record->operand[0];
+    if (length > 2)
+        *out++ = record->operand[1];
+    if (record->a != last->a) {
+        *tag |= I8080_TRACE_A;
+        *out++ = record->a;
+    }
+    if (record->f != last->f) {
+        *tag |= I8080_TRACE_F;
+        *out++ = record->f;
+    }
+    return out;
+}
+
+// Compresses and writes out a buffer of records.
+static void trace_write(struct i8080_tracer *tracer,
+    const struct i8080_trace_record *record, int count) {
+    uns8 *out = tracer->out;
+    int i;
+    for (i = 0; i < count; ++i) {
+        out = trace_encode(out, &tracer->last, &record[i]);
+        tracer->last = record[i];
+    }
+    if (fwrite(tracer->out, 1, out - tracer->out, tracer->file) !=
+        (size_t)(out - tracer->out))
+        tracer->error = 1;
+    tracer->records += count;
+}
+
+static void *trace_writer(void *arg) {
+    struct i8080_tracer* const tracer = (struct i8080_tracer *)arg;
+    pthread_mutex_lock(&tracer->lock);
+    for (;;) {
+        while (!tracer->full && !tracer->stop)
+            pthread_cond_wait(&tracer->cond, &tracer->lock);
+        if (!tracer->full)
+            break;
+        pthread_mutex_unlock(&tracer->lock);
+        trace_write(tracer, tracer->full, tracer->full_count);
+        pthread_mutex_lock(&tracer->lock);
+        tracer->full = 0;
+        pthread_cond_broadcast(&tracer->cond);
+    }
+    pthread_mutex_unlock(&tracer->lock);
+    return 0;
+}
+
+// Hands the filled buffer over to the writer, once it is done with the
+// previous one, and gives the other buffer to the CPU.
+static void trace_flush(struct i8080 *cpu, struct i8080_trace *trace) {
+    struct i8080_tracer* const tracer = (struct i8080_tracer *)trace->data;
+    (void)cpu;
+    pthread_mutex_lock(&tracer->lock);
+    while (tracer->full)
+        pthread_cond_wait(&tracer->cond, &tracer->lock);
+    tracer->full = trace->record;
+    tracer->full_count = trace->count;
+    pthread_cond_broadcast(&tracer->cond);
+    pthread_mutex_unlock(&tracer->lock);
+    trace->record = trace->record == tracer->buffer[0] ?
+        tracer->buffer[1] : tracer->buffer[0];
+    trace->count = 0;
+}
+
+struct i8080_tracer *i8080_tracer_open(const char *path, int size) {
+    struct i8080_tracer* const tracer =
+        (struct i8080_tracer *)calloc(1, sizeof(*tracer));
+    if (!tracer)
+        return 0;
+    tracer->buffer[0] = (struct i8080_trace_record *)
+        malloc(2 * size * sizeof(struct i8080_trace_record));
+    tracer->out = (uns8 *)malloc(size * TRACE_RECORD_MAX);
+    tracer->file = fopen(path, "wb");
+    if (!tracer->buffer[0] || !tracer->out || !tracer->file)
+        goto fail;
+    tracer->buffer[1] = tracer->buffer[0] + size;
+    if (fwrite(I8080_TRACE_MAGIC, 1, 8, tracer->file) != 8)
+        goto fail;
+
+    tracer->trace.record = tracer->buffer[0];
+    tracer->trace.size = size;
+    tracer->trace.flush = trace_flush;
+    tracer->trace.data = tracer;
+    pthread_mutex_init(&tracer->lock, 0);
+    pthread_cond_init(&tracer->cond, 0);
+    if (pthread_create(&tracer->thread, 0, trace_writer, tracer) != 0) {
+        pthread_cond_destroy(&tracer->cond);
+        pthread_mutex_destroy(&tracer->lock);
+        goto fail;
+    }
+    return tracer;
+
+fail:
+    if (tracer->file)
+        fclose(tracer->file);
+    free(tracer->out);
+    free(tracer->buffer[0]);
+    free(tracer);
+    return 0;
+}
+
+void i8080_tracer_attach(struct i8080_tracer *tracer, struct i8080 *cpu) {
+    if (tracer->cpu)
+        tracer->cpu->trace = 0;
+    tracer->cpu = cpu;
+    cpu->trace = &tracer->trace;
+}
+
+long i8080_tracer_close(struct i8080_tracer *tracer) {
+    long records;
+    if (tracer->trace.count)
+        trace_flush(tracer->cpu, &tracer->trace);
+    if (tracer->cpu)
+        tracer->cpu->trace = 0;
+
+    pthread_mutex_lock(&tracer->lock);
+    tracer->stop = 1;
+    pthread_cond_broadcast(&tracer->cond);
+    pthread_mutex_unlock(&tracer->lock);
+    pthread_join(tracer->thread, 0);
+    pthread_cond_destroy(&tracer->cond);
+    pthread_mutex_destroy(&tracer->lock);
+
+    if (fclose(tracer->file) != 0)
+        tracer->error = 1;
+    records = tracer->error ? -1 : tracer->records;
+    free(tracer->out);
+    free(tracer->buffer[0]);
+    free(tracer);
+    return records;
+}
+
+struct i8080_trace_reader {
+    FILE *file;
+    struct i8080_trace_record last;
+};
+
+struct i8080_trace_reader *i8080_trace_reader_open(const char *path) {
+    struct i8080_trace_reader *reader;
+    char magic[8];
+    FILE* const file = fopen(path, "rb");
+    if (!file)
+        return 0;
+    if (fread(magic, 1, 8, file) != 8 ||
+        memcmp(magic, I8080_TRACE_MAGIC, 8) != 0 ||
+        !(reader = (struct i8080_trace_reader *)calloc(1, sizeof(*reader)))) {
+        fclose(file);
+        return 0;
+    }
+    reader->file = file;
+    return reader;
+}
+
+int i8080_trace_read(struct i8080_trace_reader *reader,
+    struct i8080_trace_record *record) {
+    FILE* const file = reader->file;
+    struct i8080_trace_record* const last = &reader->last;
+    int length;
+    int const tag = getc(file);
+    if (tag == EOF)
+        return 0;
+    if (tag & ~(I8080_TRACE_PC | I8080_TRACE_CYCLES | I8080_TRACE_A |
+        I8080_TRACE_F))
+        return -1;
+
+    *record = *last;
+    record->pc = trace_next_pc(last);
+    if (tag & I8080_TRACE_PC) {
+        record->pc = (uns16)getc(file);
+        record->pc |= (uns16)(getc(file) << 8);
+    }
+    if (tag & I8080_TRACE_CYCLES)
+        record->cycles = (uns8)getc(file);
+    record->opcode = (uns8)getc(file);
+    length = record->cycles & I8080_TRACE_IRQ ?
+        1 : i8080_opcode_length(record->opcode);
+    record->operand[0] = length > 1 ? (uns8)getc(file) : 0;
+    record->operand[1] = length > 2 ? (uns8)getc(file) : 0;
+    if (tag & I8080_TRACE_A)
+        record->a = (uns8)getc(file);
+    if (tag & I8080_TRACE_F)
+        record->f = (uns8)getc(file);
+    // The tag of a complete record is followed by all its fields.
+    if (feof(file) || ferror(file))
+        return -1;
+    *last = *record;
+    return 1;
+}
+
+void i8080_trace_reader_close(struct i8080_trace_reader *reader) {
+    fclose(reader->file);
+    free(reader);
+}
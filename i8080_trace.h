@@ -0,0 +1,93 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+#ifndef I8080_TRACE_H
+#define I8080_TRACE_H
+
+#include "i8080.h"
+
+#ifndef I8080_TRACE
+#error "The tracer needs the core built with I8080_TRACE"
+#endif
+
+// The tracer writes the trace of a CPU (see `struct i8080_trace`) to a
+// file. The CPU fills one of two buffers of records while a thread of the
+// tracer compresses the other one and writes it out; the buffers change
+// hands by swapping pointers, so the CPU does not copy the records.
+//
+// The file starts with I8080_TRACE_MAGIC. Every record is then stored as a
+// delta from the previous one (all zeros before the first):
+//
+//     tag         I8080_TRACE_xxx bits telling which fields follow
+//     pc          2 bytes, little endian, if not the next instruction
+//     cycles      if changed
+//     opcode
+//     operands    as many as the instruction has, none for I8080_TRACE_IRQ
+//     a           if changed
+//     f           if changed
+
+#define I8080_TRACE_MAGIC       "I8080TRC"
+
+#define I8080_TRACE_PC          0x01
+#define I8080_TRACE_CYCLES      0x02
+#define I8080_TRACE_A           0x04
+#define I8080_TRACE_F           0x08
+
+struct i8080_tracer;
+
+// Creates the file `path` and a tracer writing to it with the buffers of
+// `size` records. Returns 0 on failure.
+extern struct i8080_tracer *i8080_tracer_open(const char *path, int size);
+
+// Starts tracing `cpu`. A tracer traces one CPU at a time.
+extern void i8080_tracer_attach(struct i8080_tracer *tracer,
+    struct i8080 *cpu);
+
+// Writes the remaining records, stops tracing the CPU and closes the file.
+// Returns the number of records written, or -1 on a write error.
+extern long i8080_tracer_close(struct i8080_tracer *tracer);
+
+// Reads a trace file back.
+struct i8080_trace_reader;
+
+extern struct i8080_trace_reader *i8080_trace_reader_open(const char *path);
+
+// Reads the next record. Returns 1, 0 at the end of the file, or -1 if the
+// file is broken.
+extern int i8080_trace_read(struct i8080_trace_reader *reader,
+    struct i8080_trace_record *record);
+
+extern void i8080_trace_reader_close(struct i8080_trace_reader *reader);
+
+#endif
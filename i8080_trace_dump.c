@@ -0,0 +1,89 @@
+// Intel 8080 (KR580VM80A) microprocessor core model
+//
+// Copyright (C) 2012 Alexander Demin <alexander@demin.ws>
+//
+// Credits
+//
+// Viacheslav Slavinsky, Vector-06C FPGA Replica
+// http://code.google.com/p/vector06cc/
+//
+// Dmitry Tselikov, Bashrikia-2M and Radio-86RK on Altera DE1
+// http://bashkiria-2m.narod.ru/fpga.html
+//
+// Ian Bartholomew, 8080/8085 CPU Exerciser
+// http://www.idb.me.uk/sunhillow/8080.html
+//
+// Frank Cringle, The origianal exerciser for the Z80.
+//
+// Thanks to zx.pk.ru and nedopc.org/forum communities.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or (at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+
+// Prints a trace written by the tracer (see `i8080_trace.h`) as a listing
+// of the executed instructions:
+//
+//     i8080_trace_dump FILE
+
+#include <stdio.h>
+
+#include "i8080_trace.h"
+
+static void print_instruction(const struct i8080_trace_record *record) {
+    uns8 bytes[3];
+    char text[I8080_DISASM_SIZE];
+    bytes[0] = record->opcode;
+    bytes[1] = record->operand[0];
+    bytes[2] = record->operand[1];
+    i8080_disassemble(bytes, text);
+    printf("%-14s", text);
+}
+
+int main(int argc, char **argv) {
+    struct i8080_trace_reader *reader;
+    struct i8080_trace_record record;
+    int result, length, i;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s FILE\n", argv[0]);
+        return 2;
+    }
+    reader = i8080_trace_reader_open(argv[1]);
+    if (!reader) {
+        fprintf(stderr, "Cannot read trace \"%s\"\n", argv[1]);
+        return 1;
+    }
+    while ((result = i8080_trace_read(reader, &record)) > 0) {
+        int const irq = record.cycles & I8080_TRACE_IRQ;
+        length = irq ? 1 : i8080_opcode_length(record.opcode);
+        printf("%04X  %02X", record.pc, record.opcode);
+        for (i = 1; i < 3; ++i) {
+            if (i < length)
+                printf(" %02X", record.operand[i - 1]);
+            else
+                printf("   ");
+        }
+        printf("  ");
+        print_instruction(&record);
+        printf("A=%02X F=%02X %3d%s\n", record.a, record.f,
+            record.cycles & ~I8080_TRACE_IRQ, irq ? " irq" : "");
+    }
+    i8080_trace_reader_close(reader);
+    if (result < 0) {
+        fprintf(stderr, "Trace \"%s\" is broken\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}